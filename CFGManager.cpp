@@ -1,11 +1,11 @@
 #include "CFGManager.h"
 
-CFGManager::CFGManager()
+CFGManager::CFGManager(const QString &fileName)
 {
     root = 0;
     currentUser = 0;
     domDoc = new QDomDocument();
-    XMLFile = new QFile("config.xml");
+    XMLFile = new QFile(fileName);
     if (!XMLFile->exists())
     {
         root = new QDomElement(domDoc->createElement("configuration"));
@@ -68,6 +68,37 @@ QString CFGManager::getDBName() const
             firstChildElement("name").text();
 }
 
+QString CFGManager::getTraceFile() const
+{
+    return root->firstChildElement("debug").
+            firstChildElement("trace_file").text();
+}
+
+QString CFGManager::getSlowQueryLog() const
+{
+    QString fileName = root->firstChildElement("debug").
+            firstChildElement("slow_query_log").text();
+    return fileName.isEmpty()?"slow_queries.log":fileName;
+}
+
+int CFGManager::getSlowQueryThreshold() const
+{
+    return root->firstChildElement("debug").
+            firstChildElement("slow_query_ms").text().toInt();
+}
+
+bool CFGManager::getForceKeyVerification() const
+{
+    return root->firstChildElement("debug").
+            firstChildElement("force_key_verification").text() == "true";
+}
+
+bool CFGManager::getPerformanceReadout() const
+{
+    return root->firstChildElement("debug").
+            firstChildElement("performance_readout").text() == "true";
+}
+
 bool CFGManager::removeChildren() const
 {
     if (currentUser == 0)
@@ -108,6 +139,30 @@ int CFGManager::getBackupExpireDate() const
             firstChildElement("backup_expire_after").text().toInt();
 }
 
+QString CFGManager::getStorageFormat() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("tables").
+            firstChildElement("storage_format").text();
+}
+
+QString CFGManager::getCipherProfile() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("tables").
+            firstChildElement("cipher_profile").text();
+}
+
 int CFGManager::getRowCount() const
 {
     if (currentUser == 0)
@@ -206,6 +261,54 @@ QString CFGManager::getKey() const
             firstChildElement("key").text();
 }
 
+QString CFGManager::getPreparedKey() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("security").
+            firstChildElement("prepared_key").text();
+}
+
+QString CFGManager::getPreparedKeySource() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("security").
+            firstChildElement("prepared_key").attribute("source");
+}
+
+QString CFGManager::getPendingKey() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("security").
+            firstChildElement("pending_key").text();
+}
+
+QString CFGManager::getPendingPublicKey() const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return "";
+    }
+
+    return currentUser->firstChildElement("security").
+            firstChildElement("pending_key").attribute("public");
+}
+
 void CFGManager::emitErrorMessage(ErrorMessage m) const
 {
     if (m == NoUser)
@@ -232,6 +335,12 @@ void CFGManager::setCurrentUser(const QString &name) const
                 QDomElement expireDate = domDoc->createElement("backup_expire_after");
                 expireDate.appendChild(domDoc->createTextNode("0"));
                 database.appendChild(expireDate);
+                QDomElement storageFormat = domDoc->createElement("storage_format");
+                storageFormat.appendChild(domDoc->createTextNode("binary"));
+                database.appendChild(storageFormat);
+                QDomElement cipherProfile = domDoc->createElement("cipher_profile");
+                cipherProfile.appendChild(domDoc->createTextNode("ctr-hmac"));
+                database.appendChild(cipherProfile);
 
             QDomElement spreadsheet = domDoc->createElement("spreadsheet");
             currentUser->appendChild(spreadsheet);
@@ -331,6 +440,68 @@ void CFGManager::setDBName(const QString &name)
     currentValue.appendChild(domDoc->createTextNode(name));
 }
 
+void CFGManager::setTraceFile(const QString &fileName)
+{
+    QDomElement debug(root->firstChildElement("debug"));
+    if (debug.isNull())
+    {
+        debug = domDoc->createElement("debug");
+        root->appendChild(debug);
+    }
+    QDomElement currentValue(debug.firstChildElement("trace_file"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("trace_file");
+        debug.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(fileName));
+}
+
+void CFGManager::setSlowQueryLog(const QString &fileName, int msecs)
+{
+    QDomElement debug(root->firstChildElement("debug"));
+    if (debug.isNull())
+    {
+        debug = domDoc->createElement("debug");
+        root->appendChild(debug);
+    }
+    QDomElement logFile(debug.firstChildElement("slow_query_log"));
+    if (logFile.isNull())
+    {
+        logFile = domDoc->createElement("slow_query_log");
+        debug.appendChild(logFile);
+    }
+    logFile.removeChild(logFile.firstChild());
+    logFile.appendChild(domDoc->createTextNode(fileName));
+    QDomElement threshold(debug.firstChildElement("slow_query_ms"));
+    if (threshold.isNull())
+    {
+        threshold = domDoc->createElement("slow_query_ms");
+        debug.appendChild(threshold);
+    }
+    threshold.removeChild(threshold.firstChild());
+    threshold.appendChild(domDoc->createTextNode(QString::number(msecs)));
+}
+
+void CFGManager::setPerformanceReadout(bool show)
+{
+    QDomElement debug(root->firstChildElement("debug"));
+    if (debug.isNull())
+    {
+        debug = domDoc->createElement("debug");
+        root->appendChild(debug);
+    }
+    QDomElement currentValue(debug.firstChildElement("performance_readout"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("performance_readout");
+        debug.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(show?"true":"false"));
+}
+
 void CFGManager::setRemoveChildren(bool remove)
 {
     if (currentUser == 0)
@@ -375,6 +546,44 @@ void CFGManager::setBackupExpireDate(int afterNDays)
     currentValue.appendChild(domDoc->createTextNode(QString("%1").arg(afterNDays)));
 }
 
+void CFGManager::setStorageFormat(const QString &format)
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return;
+    }
+
+    QDomElement tables(currentUser->firstChildElement("tables"));
+    QDomElement currentValue(tables.firstChildElement("storage_format"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("storage_format");
+        tables.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(format));
+}
+
+void CFGManager::setCipherProfile(const QString &profile)
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return;
+    }
+
+    QDomElement tables(currentUser->firstChildElement("tables"));
+    QDomElement currentValue(tables.firstChildElement("cipher_profile"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("cipher_profile");
+        tables.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(profile));
+}
+
 void CFGManager::setRowCount(int count)
 {
     if (currentUser == 0)
@@ -492,3 +701,49 @@ void CFGManager::setKey(const QString &key) const
 
     saveDoc();
 }
+
+void CFGManager::setPreparedKey(const QString &key,
+                                const QString &source) const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return;
+    }
+
+    QDomElement security(currentUser->firstChildElement("security"));
+    QDomElement currentValue(security.firstChildElement("prepared_key"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("prepared_key");
+        security.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(key));
+    currentValue.setAttribute("source", source);
+
+    saveDoc();
+}
+
+void CFGManager::setPendingKey(const QString &publicKey,
+                               const QString &privateKey) const
+{
+    if (currentUser == 0)
+    {
+        emitErrorMessage(NoUser);
+        return;
+    }
+
+    QDomElement security(currentUser->firstChildElement("security"));
+    QDomElement currentValue(security.firstChildElement("pending_key"));
+    if (currentValue.isNull())
+    {
+        currentValue = domDoc->createElement("pending_key");
+        security.appendChild(currentValue);
+    }
+    currentValue.removeChild(currentValue.firstChild());
+    currentValue.appendChild(domDoc->createTextNode(privateKey));
+    currentValue.setAttribute("public", publicKey);
+
+    saveDoc();
+}
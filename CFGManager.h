@@ -8,7 +8,7 @@ class CFGManager : public QObject
 {
     Q_OBJECT
 public:
-    CFGManager();
+    CFGManager(const QString &fileName = "config.xml");
     ~CFGManager();
     //database configuration
     QString getDBType() const;
@@ -18,6 +18,8 @@ public:
     bool removeChildren() const;
     bool backupTables() const;
     int getBackupExpireDate() const;
+    QString getStorageFormat() const;
+    QString getCipherProfile() const;
     //spreadsheet configuration
     int getRowCount() const;
     int getColumnCount() const;
@@ -27,6 +29,16 @@ public:
     QSize getCellsSize() const;
     //security configuration
     QString getKey() const;
+    QString getPreparedKey() const;
+    QString getPreparedKeySource() const;
+    QString getPendingKey() const;
+    QString getPendingPublicKey() const;
+    //diagnostics
+    QString getTraceFile() const;
+    bool getPerformanceReadout() const;
+    QString getSlowQueryLog() const;
+    int getSlowQueryThreshold() const;
+    bool getForceKeyVerification() const;
     enum ErrorMessage { NoUser };
 
 private:
@@ -48,6 +60,8 @@ public slots:
     void setRemoveChildren(bool remove);
     void setBackupTables(bool backup);
     void setBackupExpireDate(int afterNDays);
+    void setStorageFormat(const QString &format);
+    void setCipherProfile(const QString &profile);
     //spreadsheet configuration
     void setRowCount(int count);
     void setColumnCount(int count);
@@ -58,6 +72,13 @@ public slots:
     void setColumnWidth(int width);
     //security configuration
     void setKey(const QString &key) const;
+    void setPreparedKey(const QString &key, const QString &source) const;
+    void setPendingKey(const QString &publicKey,
+                       const QString &privateKey) const;
+    //diagnostics
+    void setTraceFile(const QString &fileName);
+    void setPerformanceReadout(bool show);
+    void setSlowQueryLog(const QString &fileName, int msecs);
 
 signals:
     void errorMessage(const QString &msg) const;
@@ -20,15 +20,31 @@ QVariant Cell::data(int role) const
 void Cell::setData(int role, const QVariant &value)
 {
     QTableWidgetItem::setData(role, value);
-    if (tableWidget())
+    SpreadSheet *sheet = qobject_cast<SpreadSheet*>(tableWidget());
+    if (sheet)
+        sheet->markDirty();
+    else if (tableWidget())
         tableWidget()->viewport()->update();
 }
 
 QVariant Cell::display(const QString &data) const
 {
     QString temp = (data.isEmpty())?formula():data;
+    return evaluate(temp, (SpreadSheet*)tableWidget());
+}
+
+QString Cell::formula() const
+{
+    return QTableWidgetItem::data(Qt::DisplayRole).toString();
+}
+
+//brackets =a+b*c so that computeFormula honours operator precedence,
+//empty when the text is not a formula
+QString Cell::expression(const QString &formula) const
+{
+    QString temp = formula;
     if (!isValidFormula(temp))
-        return temp;
+        return QString();
 
     QString aux = "((";
     for (int i=1; i<temp.length(); i++)
@@ -49,17 +65,20 @@ QVariant Cell::display(const QString &data) const
     aux.append("))");
 
     if (!isValidFormula("=" + aux))
-        return temp;
-    QVariant result = computeFormula(aux, (SpreadSheet*)tableWidget());
-    return result;
+        return QString();
+    return aux;
 }
 
-QString Cell::formula() const
+//the value of a cell's text, also usable for cells outside a widget
+QVariant Cell::evaluate(const QString &text, const CellSource *widget) const
 {
-    return QTableWidgetItem::data(Qt::DisplayRole).toString();
+    QString aux = expression(text);
+    if (aux.isEmpty())
+        return text;
+    return computeFormula(aux, widget);
 }
 
-QVariant Cell::computeFormula(const QString &formula, SpreadSheet *widget) const
+QVariant Cell::computeFormula(const QString &formula, const CellSource *widget) const
 {
     QVariant result = QVariant::Invalid,
              firstOperand = QVariant::Invalid,
@@ -112,7 +131,7 @@ bool Cell::isValidFormula(const QString &formula) const
     return true;
 }
 
-QVariant Cell::parseMember(const QString &formula, SpreadSheet *widget) const
+QVariant Cell::parseMember(const QString &formula, const CellSource *widget) const
 {
     int fOp = firstOperatorPosition(formula);
     if (fOp == -1)
@@ -171,10 +190,7 @@ QVariant Cell::parseMember(const QString &formula, SpreadSheet *widget) const
             idx += importedData.matchedLength();
         }
         QString result = widget->getLinkData(formula, matches);
-        if (isValidFormula(result))
-            return display(result);
-        else
-            return result;
+        return evaluate(result, widget);
     }
     //celula A2
     else if (cellId.exactMatch(formula))
@@ -455,24 +471,14 @@ bool Cell::compareMembers(const QString &op, double &firstOperand, double &secon
 }
 
 QVariant Cell::getCellValue(const QString &id,
-              SpreadSheet *widget) const
+              const CellSource *widget) const
 {
     int column = ((int)(id[0].toAscii()))-65;
     QString s = id.mid(1,firstOperatorPosition(id));
     bool ok;
     int row = (s.toInt(&ok))-1;
-    if (ok
-        && row >= 0
-        && column >= 0
-        && row < widget->rowCount()
-        && column < widget->columnCount()
-        )
-    {
-        const QTableWidgetItem* value = widget->item(row,column);
-        if (value == 0)
-            return "#####";
-        return value->data(Qt::DisplayRole);
-    }
+    if (ok)
+        return widget->cellValue(row, column);
     else
         return "#####";
 }
@@ -4,6 +4,7 @@
 #include <QtCore>
 #include <QtGui>
 #include "SpreadSheet.h"
+#include "CellSource.h"
 
 class Cell : public QObject, public QTableWidgetItem
 {
@@ -16,17 +17,19 @@ public:
     void setData(int role, const QVariant &value);
     QVariant display(const QString &data = QString()) const;
     QString formula() const;
+    QString expression(const QString &formula) const;
+    QVariant evaluate(const QString &text, const CellSource *widget) const;
     QVariant computeFormula(const QString &formula,
-                            SpreadSheet *widget) const;
+                            const CellSource *widget) const;
 private:
     bool isValidFormula(const QString &formula) const;
     QVariant parseMember(const QString &formula,
-                         SpreadSheet *widget) const;
+                         const CellSource *widget) const;
     QString compareMembers(int &param_no, const QString &op,
                         double &firstOperand, double &secondOperand,
                         const QString &case1, const QString &case2) const;
     bool compareMembers(const QString &op, double &firstOperand, double &secondOperand) const;
-    QVariant getCellValue(const QString &id, SpreadSheet *widget) const;
+    QVariant getCellValue(const QString &id, const CellSource *widget) const;
     int firstOperatorPosition(const QString &formula) const;
 
 signals:
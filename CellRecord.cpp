@@ -0,0 +1,339 @@
+#include "CellRecord.h"
+
+//compact cell record:
+//magic, flags, [font string length, font string], [foreground rgba],
+//[background rgba], formula as utf-8 up to the end of the record,
+//cells with other styles are encoded as legacy records
+static const char compactMagic = '\xC5';
+static const int fontFlag = 0x01;
+static const int foregroundFlag = 0x02;
+static const int backgroundFlag = 0x04;
+
+static void appendRgba(QByteArray &data, QRgb rgba)
+{
+    data.append((char)(rgba >> 24));
+    data.append((char)(rgba >> 16));
+    data.append((char)(rgba >> 8));
+    data.append((char)rgba);
+}
+
+static QRgb readRgba(const QByteArray &data, int pos)
+{
+    const uchar *d = (const uchar*)data.constData() + pos;
+    return (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | d[3];
+}
+
+static QByteArray legacyEncode(const CellStyle &style, const QString &formula)
+{
+    QByteArray cellData;
+    QDataStream out(&cellData, QIODevice::WriteOnly);
+    out << style.font << style.foreground << style.background << formula;
+    return cellData.toHex();
+}
+
+//gradients, textures and patterns only survive in the legacy record
+static bool plainBrush(const QBrush &brush)
+{
+    return brush == QBrush() || (brush.style() == Qt::SolidPattern &&
+                                 brush.transform().isIdentity());
+}
+
+QByteArray CellCodec::encode(const CellStyle &style, const QString &formula)
+{
+    QByteArray font;
+    if (style.font != QFont())
+        font = style.font.toString().toUtf8();
+    if (font.size() > 255 || !plainBrush(style.foreground) ||
+        !plainBrush(style.background))
+        return legacyEncode(style, formula);
+
+    char flags = 0;
+    if (!font.isEmpty())
+        flags |= fontFlag;
+    if (style.foreground.style() != Qt::NoBrush)
+        flags |= foregroundFlag;
+    if (style.background.style() != Qt::NoBrush)
+        flags |= backgroundFlag;
+
+    QByteArray text = formula.toUtf8();
+    QByteArray result;
+    result.reserve(2 + 1 + font.size() + 8 + text.size());
+    result.append(compactMagic);
+    result.append(flags);
+    if (flags & fontFlag)
+    {
+        result.append((char)font.size());
+        result.append(font);
+    }
+    if (flags & foregroundFlag)
+        appendRgba(result, style.foreground.color().rgba());
+    if (flags & backgroundFlag)
+        appendRgba(result, style.background.color().rgba());
+    result.append(text);
+    return result;
+}
+
+bool CellCodec::isCompact(const QByteArray &data)
+{
+    return data.size() >= 2 && data.at(0) == compactMagic;
+}
+
+bool CellCodec::decode(const QByteArray &data, CellStyle *style,
+                       QString *formula, QByteArray *styleKey)
+{
+    if (data.isEmpty())
+    {
+        if (style)
+            *style = CellStyle();
+        if (formula)
+            formula->clear();
+        if (styleKey)
+            styleKey->clear();
+        return true;
+    }
+
+    if (!isCompact(data))
+    {
+        QByteArray cellData = QByteArray::fromHex(data);
+        QDataStream in(cellData);
+        QFont font;
+        QBrush foreground, background;
+        in >> font >> foreground >> background;
+        int styleEnd = (int)in.device()->pos();
+        if (style)
+        {
+            style->font = font;
+            style->foreground = foreground;
+            style->background = background;
+        }
+        if (formula)
+            in >> *formula;
+        if (styleKey)
+            *styleKey = cellData.left(styleEnd);
+        return in.status() == QDataStream::Ok;
+    }
+
+    int flags = (uchar)data.at(1);
+    int pos = 2;
+    int fontStart = -1;
+    int fontSize = 0;
+    if (flags & fontFlag)
+    {
+        if (pos >= data.size())
+            return false;
+        fontSize = (uchar)data.at(pos);
+        fontStart = pos + 1;
+        pos = fontStart + fontSize;
+    }
+    int foreground = -1;
+    if (flags & foregroundFlag)
+    {
+        foreground = pos;
+        pos += 4;
+    }
+    int background = -1;
+    if (flags & backgroundFlag)
+    {
+        background = pos;
+        pos += 4;
+    }
+    if (pos > data.size())
+        return false;
+
+    if (style)
+    {
+        style->font = QFont();
+        if (fontStart != -1)
+            style->font.fromString(QString::fromUtf8(data.constData() + fontStart,
+                                                     fontSize));
+        style->foreground = (foreground == -1)?QBrush():
+                            QBrush(QColor::fromRgba(readRgba(data, foreground)));
+        style->background = (background == -1)?QBrush():
+                            QBrush(QColor::fromRgba(readRgba(data, background)));
+    }
+    if (formula)
+        *formula = QString::fromUtf8(data.constData() + pos, data.size() - pos);
+    if (styleKey)
+        *styleKey = data.left(pos);
+    return true;
+}
+
+QByteArray CellCodec::toLegacy(const QByteArray &data)
+{
+    if (!isCompact(data))
+        return data;
+
+    CellStyle style;
+    QString formula;
+    if (!decode(data, &style, &formula))
+        return QByteArray();
+    return legacyEncode(style, formula);
+}
+
+QByteArray CellCodec::fromLegacy(const QByteArray &data)
+{
+    if (data.isEmpty() || isCompact(data))
+        return data;
+
+    //a record that does not decode is kept as it is
+    CellStyle style;
+    QString formula;
+    if (!decode(data, &style, &formula))
+        return data;
+    return encode(style, formula);
+}
+
+//row envelope:
+//cell count (16 bit), end offset of every cell (32 bit), cell records
+RowEnvelope::RowEnvelope()
+{
+}
+
+int RowEnvelope::count() const
+{
+    return ends.size();
+}
+
+QByteArray RowEnvelope::cell(int column) const
+{
+    if (column < 0 || column >= ends.size())
+        return QByteArray("");
+    int start = (column == 0)?0:ends.at(column-1);
+    return QByteArray(data.constData() + start, ends.at(column) - start);
+}
+
+QList<QByteArray> RowEnvelope::cells(int columns) const
+{
+    QList<QByteArray> result;
+    for (int c=0; c<columns; c++)
+        result.append(cell(c));
+    return result;
+}
+
+void RowEnvelope::setCell(int column, const QByteArray &cell)
+{
+    if (column < 0)
+        return;
+    while (ends.size() <= column)
+        ends.append(data.size());
+
+    int start = (column == 0)?0:ends.at(column-1);
+    int length = ends.at(column) - start;
+    data.replace(start, length, cell);
+    int delta = cell.size() - length;
+    for (int c=column; c<ends.size(); c++)
+        ends[c] += delta;
+}
+
+void RowEnvelope::removeCell(int column)
+{
+    if (column < 0 || column >= ends.size())
+        return;
+
+    int start = (column == 0)?0:ends.at(column-1);
+    int length = ends.at(column) - start;
+    data.remove(start, length);
+    ends.remove(column);
+    for (int c=column; c<ends.size(); c++)
+        ends[c] -= length;
+}
+
+QByteArray RowEnvelope::toBytes() const
+{
+    QByteArray result;
+    result.resize(2 + 4*ends.size());
+    uchar *d = (uchar*)result.data();
+    qToBigEndian<quint16>(ends.size(), d);
+    for (int c=0; c<ends.size(); c++)
+        qToBigEndian<quint32>(ends.at(c), d + 2 + 4*c);
+    result.append(data);
+    return result;
+}
+
+RowEnvelope RowEnvelope::fromBytes(const QByteArray &data)
+{
+    RowEnvelope result;
+    if (data.size() < 2)
+        return result;
+
+    const uchar *d = (const uchar*)data.constData();
+    int count = qFromBigEndian<quint16>(d);
+    int header = 2 + 4*count;
+    if (data.size() < header)
+        return result;
+
+    quint32 previous = 0;
+    result.ends.reserve(count);
+    for (int c=0; c<count; c++)
+    {
+        quint32 end = qFromBigEndian<quint32>(d + 2 + 4*c);
+        if (end < previous || end > (quint32)(data.size() - header))
+            return RowEnvelope();
+        result.ends.append(end);
+        previous = end;
+    }
+    result.data = data.mid(header);
+    return result;
+}
+
+RefreshPayload::RefreshPayload()
+{
+    table_id = -1;
+}
+
+static int unreadableStyle(RefreshPayload &payload,
+                           QHash<QByteArray, int> &style_ids)
+{
+    QHash<QByteArray, int>::const_iterator style = style_ids.constFind(QByteArray());
+    if (style != style_ids.constEnd())
+        return style.value();
+    style_ids.insert(QByteArray(), payload.styles.size());
+    payload.styles.append(CellStyle());
+    return payload.styles.size() - 1;
+}
+
+RefreshPayload RefreshPayload::decode(const QMap<int, QList<QByteArray> > &data,
+                                      int table_id)
+{
+    RefreshPayload result;
+    result.table_id = table_id;
+    QHash<QByteArray, int> style_ids = QHash<QByteArray, int>();
+
+    QMapIterator<int, QList<QByteArray> > it(data);
+    while (it.hasNext())
+    {
+        it.next();
+        const QList<QByteArray> &row = it.value();
+        for (int c=0; c<row.size(); c++)
+        {
+            CellRecord record;
+            record.row = it.key();
+            record.column = c;
+            //a null cell could not be decrypted
+            record.readable = !row.at(c).isNull();
+            if (!record.readable)
+            {
+                record.formula = "#####";
+                record.style = unreadableStyle(result, style_ids);
+                result.cells.append(record);
+                continue;
+            }
+
+            QByteArray styleKey;
+            CellCodec::decode(row.at(c), 0, &record.formula, &styleKey);
+            QHash<QByteArray, int>::const_iterator style = style_ids.constFind(styleKey);
+            if (style == style_ids.constEnd())
+            {
+                CellStyle s;
+                CellCodec::decode(row.at(c), &s, 0);
+                record.style = result.styles.size();
+                result.styles.append(s);
+                style_ids.insert(styleKey, record.style);
+            }
+            else
+                record.style = style.value();
+            result.cells.append(record);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef CELLRECORD_H
+#define CELLRECORD_H
+
+#include <QtCore>
+#include <QtGui>
+
+struct CellStyle
+{
+    QFont font;
+    QBrush foreground;
+    QBrush background;
+};
+
+struct CellRecord
+{
+    int row;
+    int column;
+    int style;
+    bool readable;
+    QString formula;
+};
+
+class CellCodec
+{
+public:
+    static QByteArray encode(const CellStyle &style, const QString &formula);
+    static bool decode(const QByteArray &data, CellStyle *style,
+                       QString *formula, QByteArray *styleKey = 0);
+    static bool isCompact(const QByteArray &data);
+    static QByteArray toLegacy(const QByteArray &data);
+    static QByteArray fromLegacy(const QByteArray &data);
+};
+
+class RowEnvelope
+{
+public:
+    RowEnvelope();
+
+    int count() const;
+    QByteArray cell(int column) const;
+    QList<QByteArray> cells(int columns) const;
+    void setCell(int column, const QByteArray &cell);
+    void removeCell(int column);
+
+    QByteArray toBytes() const;
+    static RowEnvelope fromBytes(const QByteArray &data);
+
+private:
+    QVector<quint32> ends;
+    QByteArray data;
+};
+
+class RefreshPayload
+{
+public:
+    RefreshPayload();
+
+    int table_id;
+    QList<CellRecord> cells;
+    QList<CellStyle> styles;
+
+    static RefreshPayload decode(const QMap<int, QList<QByteArray> > &data,
+                                 int table_id = -1);
+};
+
+#endif // CELLRECORD_H
@@ -0,0 +1,16 @@
+#ifndef CELLSOURCE_H
+#define CELLSOURCE_H
+
+#include <QtCore>
+
+//what formulas read: values of other cells and table:cell links
+class CellSource
+{
+public:
+    virtual ~CellSource() {}
+    virtual QVariant cellValue(int row, int column) const = 0;
+    virtual QString getLinkData(const QString &formula,
+                                const QHash<QString,QString> &matches) const = 0;
+};
+
+#endif // CELLSOURCE_H
@@ -0,0 +1,541 @@
+#include "CommandLine.h"
+#include "Cell.h"
+#include "Trace.h"
+
+//key pair generation for a new account runs on the thread pool
+static const int loginTimeout = 120000;
+
+//a decoded table for evaluating formulas without a SpreadSheet
+class SheetData : public CellSource
+{
+public:
+    SheetData(const QMap<int, QList<QByteArray> > &data,
+              const LinkProvider *links) : links(links)
+    {
+        QMapIterator<int, QList<QByteArray> > it(data);
+        while (it.hasNext())
+        {
+            it.next();
+            QStringList row;
+            for (int c=0; c<it.value().size(); c++)
+            {
+                QString formula = "";
+                CellCodec::decode(it.value().at(c), 0, &formula);
+                row << formula;
+            }
+            texts.insert(it.key(), row);
+        }
+    }
+
+    QString text(int row, int column) const
+    {
+        return texts.value(row).value(column);
+    }
+
+    //values are cached, the table does not change while recomputing
+    QVariant cellValue(int row, int column) const
+    {
+        QPair<int,int> id(row, column);
+        if (values.contains(id))
+            return values.value(id);
+        QString cell = text(row, column);
+        QVariant value = "#####";
+        if (!cell.isEmpty())
+            value = evaluator.evaluate(cell, this);
+        values.insert(id, value);
+        return value;
+    }
+
+    QString getLinkData(const QString &formula,
+                        const QHash<QString,QString> &matches) const
+    {
+        QHash<QString,QString> linked = links->getLinkData(matches);
+        QString result = formula;
+        QHashIterator<QString,QString> it(linked);
+        while (it.hasNext())
+        {
+            it.next();
+            result.replace(it.key(), it.value());
+        }
+        return result;
+    }
+
+private:
+    QMap<int, QStringList> texts;
+    mutable QHash<QPair<int,int>, QVariant> values;
+    const LinkProvider *links;
+    Cell evaluator;
+};
+
+//splits on separator, double quotes group and "" escapes a quote
+static QStringList splitFields(const QString &line, QChar separator)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i=0; i<line.length(); i++)
+    {
+        QChar c = line.at(i);
+        if (quoted)
+        {
+            if (c == '"' && i+1 < line.length() && line.at(i+1) == '"')
+            {
+                field.append('"');
+                i++;
+            }
+            else if (c == '"')
+                quoted = false;
+            else
+                field.append(c);
+        }
+        else if (c == '"')
+            quoted = true;
+        else if (c == separator)
+        {
+            fields << field;
+            field.clear();
+        }
+        else
+            field.append(c);
+    }
+    fields << field;
+    return fields;
+}
+
+//a quoted field can span lines, the quotes are balanced at a record's end
+static QString readRecord(QTextStream &in)
+{
+    QString record = in.readLine();
+    while (record.count('"') % 2 != 0 && !in.atEnd())
+        record.append('\n').append(in.readLine());
+    return record;
+}
+
+static QString csvField(const QString &text)
+{
+    if (!text.contains(',') && !text.contains('"') &&
+        !text.contains('\n') && !text.contains('\r'))
+        return text;
+    QString result = text;
+    result.replace('"', "\"\"");
+    return QString("\"%1\"").arg(result);
+}
+
+static QStringList splitCommand(const QString &line)
+{
+    QStringList words = splitFields(line.trimmed(), ' ');
+    words.removeAll("");
+    return words;
+}
+
+CommandLine::CommandLine(const QStringList &arguments, QObject *parent) :
+    QObject(parent), out(stdout), err(stderr)
+{
+    this->arguments = arguments;
+    cfg = 0;
+    db = 0;
+    wait = 0;
+    error_count = 0;
+    logged_in = false;
+    table_ready = false;
+    table_columns = 0;
+    table_rows = 0;
+}
+
+CommandLine::~CommandLine()
+{
+    if (db != 0)
+    {
+        db->disconnectDB();
+        delete db;
+    }
+    delete cfg;
+    Trace::stop();
+}
+
+void CommandLine::usage()
+{
+    err << "usage: StudentEvaluationManager --cli [--config FILE] "
+           "--user NAME [--password PASS] (--script FILE | COMMAND)" << endl
+        << "The password can also be given in SEM_PASSWORD." << endl
+        << "Commands, one per line in a script (# starts a comment):" << endl
+        << "  create TABLE COLUMNS ROWS [FOLDER]" << endl
+        << "  import TABLE FILE.csv      replaces the text of the rows listed "
+           "in the file" << endl
+        << "  export TABLE FILE.csv" << endl
+        << "  grant TABLE USER[,USER...] [read|write]" << endl
+        << "  recompute TABLE [FILE.csv] evaluates every formula" << endl;
+}
+
+int CommandLine::exec()
+{
+    QString config = "config.xml";
+    QString user;
+    QString password = QString::fromLocal8Bit(qgetenv("SEM_PASSWORD"));
+    QString script;
+    QStringList command;
+    for (int i=0; i<arguments.size(); i++)
+    {
+        QString arg = arguments.at(i);
+        bool hasValue = i+1 < arguments.size();
+        if (arg == "--config" && hasValue)
+            config = arguments.at(++i);
+        else if (arg == "--user" && hasValue)
+            user = arguments.at(++i);
+        else if (arg == "--password" && hasValue)
+            password = arguments.at(++i);
+        else if (arg == "--script" && hasValue)
+            script = arguments.at(++i);
+        else
+            command << arg;
+    }
+    if (user.isEmpty() || (script.isEmpty() && command.isEmpty()))
+    {
+        usage();
+        return 2;
+    }
+
+    QList<QStringList> commands;
+    if (!script.isEmpty())
+    {
+        QFile file(script);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            err << "Unable to read " << script << endl;
+            return 1;
+        }
+        QTextStream in(&file);
+        while (!in.atEnd())
+        {
+            QString line = in.readLine().trimmed();
+            if (!line.isEmpty() && !line.startsWith('#'))
+                commands << splitCommand(line);
+        }
+    }
+    if (!command.isEmpty())
+        commands << command;
+
+    cfg = new CFGManager(config);
+    Trace::start(cfg->getTraceFile());
+    db = new DBManager(cfg);
+    connect(db, SIGNAL(queryError(QString)), this, SLOT(failed(QString)));
+    connect(db, SIGNAL(loggedIn(int)), this, SLOT(loggedIn(int)));
+    connect(db, SIGNAL(userCreationProgress(QString,int,int)),
+            this, SLOT(showProgress(QString,int,int)));
+    connect(db, SIGNAL(message(QString)), this, SLOT(showMessage(QString)));
+    connect(db, SIGNAL(tableCreated(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(tableOpened(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(setSpreadsheetSize(int,int)),
+            this, SLOT(tableSize(int,int)));
+    connect(db, SIGNAL(givenDataLoaded(QMap<int,QList<QByteArray> >)),
+            this, SLOT(dataLoaded(QMap<int,QList<QByteArray> >)));
+
+    if (!login(user, password))
+        return 1;
+    for (int i=0; i<commands.size(); i++)
+        if (!run(commands.at(i)))
+        {
+            err << commands.at(i).join(" ") << ": " << last_error << endl;
+            return 1;
+        }
+    return 0;
+}
+
+bool CommandLine::login(const QString &user, const QString &password)
+{
+    db->connectDB(user, password);
+    if (!logged_in && error_count == 0)
+    {
+        QEventLoop loop;
+        wait = &loop;
+        QTimer::singleShot(loginTimeout, &loop, SLOT(quit()));
+        loop.exec();
+        wait = 0;
+    }
+    if (!logged_in)
+    {
+        err << "Unable to log in: "
+            << (last_error.isEmpty()?QString("timed out"):last_error) << endl;
+        return false;
+    }
+    return true;
+}
+
+bool CommandLine::run(const QStringList &command)
+{
+    last_error = "Invalid command, see --help";
+    QString name = command.value(0);
+    if (name == "create" && command.size() >= 4)
+        return createTable(command);
+    if (name == "import" && command.size() == 3)
+        return importTable(command);
+    if (name == "export" && command.size() == 3)
+        return exportTable(command);
+    if (name == "grant" && command.size() >= 3)
+        return grantRights(command);
+    if (name == "recompute" && command.size() >= 2)
+        return recompute(command);
+    return false;
+}
+
+bool CommandLine::createTable(const QStringList &command)
+{
+    bool ok1, ok2;
+    int columns = command.at(2).toInt(&ok1);
+    int rows = command.at(3).toInt(&ok2);
+    if (!ok1 || !ok2 || columns < 1 || rows < 1)
+    {
+        last_error = "The column and row counts must be positive numbers";
+        return false;
+    }
+    int errorsBefore = error_count;
+    table_ready = false;
+    db->createTable(command.at(1), columns, rows, command.value(4, "Root"));
+    if (!table_ready || error_count != errorsBefore)
+        return false;
+    out << "created " << command.at(1) << endl;
+    return true;
+}
+
+bool CommandLine::importTable(const QStringList &command)
+{
+    QFile file(command.at(2));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        last_error = QString("Unable to read %1").arg(command.at(2));
+        return false;
+    }
+    //current cells keep their formatting, only the text is replaced,
+    //an empty or missing field clears the text
+    if (!loadTable(command.at(1)) || !openTable(command.at(1)))
+        return false;
+
+    QMap<int, QList<QByteArray> > rows;
+    QTextStream in(&file);
+    for (int row=0; !in.atEnd(); row++)
+    {
+        QString line = readRecord(in);
+        if (line.isEmpty())
+            continue;
+        QStringList fields = splitFields(line, ',');
+        QList<QByteArray> current = table_data.value(row);
+        QList<QByteArray> cells;
+        for (int c=0; c<qMax(fields.size(), current.size()); c++)
+        {
+            QString text = fields.value(c);
+            if (text.isEmpty() && current.value(c).isEmpty())
+            {
+                cells << QByteArray();
+                continue;
+            }
+            CellStyle style;
+            if (!current.value(c).isEmpty())
+                CellCodec::decode(current.at(c), &style, 0);
+            cells << CellCodec::encode(style, text);
+        }
+        while (!cells.isEmpty() && cells.last().isEmpty())
+            cells.removeLast();
+        rows.insert(row, cells);
+    }
+
+    int errorsBefore = error_count;
+    if (!db->writeRows(rows) || error_count != errorsBefore)
+        return false;
+    out << "imported " << rows.size() << " rows into " << command.at(1)
+        << endl;
+    return true;
+}
+
+bool CommandLine::exportTable(const QStringList &command)
+{
+    if (!loadTable(command.at(1)))
+        return false;
+    QFile file(command.at(2));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        last_error = QString("Unable to write %1").arg(command.at(2));
+        return false;
+    }
+    QTextStream csv(&file);
+    int lastRow = table_data.isEmpty()?-1:(table_data.end()-1).key();
+    for (int r=0; r<=lastRow; r++)
+    {
+        QStringList fields;
+        QList<QByteArray> cells = table_data.value(r);
+        for (int c=0; c<cells.size(); c++)
+        {
+            QString formula = "";
+            CellCodec::decode(cells.at(c), 0, &formula);
+            fields << csvField(formula);
+        }
+        while (!fields.isEmpty() && fields.last().isEmpty())
+            fields.removeLast();
+        csv << fields.join(",") << "\n";
+    }
+    out << "exported " << table_data.size() << " rows of " << command.at(1)
+        << endl;
+    return true;
+}
+
+bool CommandLine::grantRights(const QStringList &command)
+{
+    QString mode = command.value(3, "read");
+    if (mode != "read" && mode != "write")
+    {
+        last_error = "The rights are either read or write";
+        return false;
+    }
+    if (!openTable(command.at(1)))
+        return false;
+
+    QList<int> columns;
+    for (int c=0; c<table_columns; c++)
+        columns << c;
+    QStringList users = command.at(2).split(',', QString::SkipEmptyParts);
+    for (int i=0; i<users.size(); i++)
+    {
+        int errorsBefore = error_count;
+        db->grantReadAccess(users.at(i));
+        if (mode == "write" && error_count == errorsBefore)
+            db->grantWriteAccess(users.at(i), columns);
+        if (error_count != errorsBefore)
+        {
+            last_error = QString("%1: %2").arg(users.at(i)).arg(last_error);
+            return false;
+        }
+    }
+    out << "granted " << mode << " access on " << command.at(1) << " to "
+        << users.size() << " users" << endl;
+    return true;
+}
+
+bool CommandLine::recompute(const QStringList &command)
+{
+    if (!loadTable(command.at(1)))
+        return false;
+
+    SheetData sheet(table_data, db);
+    int formulas = 0;
+    int invalid = 0;
+    QStringList lines;
+    int lastRow = table_data.isEmpty()?-1:(table_data.end()-1).key();
+    for (int r=0; r<=lastRow; r++)
+    {
+        QStringList fields;
+        for (int c=0; c<table_data.value(r).size(); c++)
+        {
+            QString text = sheet.text(r, c);
+            if (text.startsWith('='))
+            {
+                formulas++;
+                QVariant value = sheet.cellValue(r, c);
+                if (!value.isValid() || value == "#####")
+                    invalid++;
+                text = value.toString();
+            }
+            fields << csvField(text);
+        }
+        while (!fields.isEmpty() && fields.last().isEmpty())
+            fields.removeLast();
+        lines << fields.join(",");
+    }
+
+    if (command.size() > 2)
+    {
+        QFile file(command.at(2));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate |
+                       QIODevice::Text))
+        {
+            last_error = QString("Unable to write %1").arg(command.at(2));
+            return false;
+        }
+        QTextStream csv(&file);
+        for (int i=0; i<lines.size(); i++)
+            csv << lines.at(i) << "\n";
+    }
+    out << "recomputed " << formulas << " formulas of " << command.at(1)
+        << ", " << invalid << " invalid" << endl;
+    return true;
+}
+
+bool CommandLine::openTable(const QString &name)
+{
+    int errorsBefore = error_count;
+    table_ready = false;
+    db->openTable(name, 0, 0, "");
+    return table_ready && error_count == errorsBefore;
+}
+
+bool CommandLine::loadTable(const QString &name)
+{
+    int errorsBefore = error_count;
+    table_data.clear();
+    db->getData(name);
+    if (error_count != errorsBefore)
+        return false;
+
+    //null cells could not be decrypted, do not export or overwrite them
+    int unreadable = 0;
+    QMapIterator<int, QList<QByteArray> > it(table_data);
+    while (it.hasNext())
+    {
+        it.next();
+        for (int c=0; c<it.value().size(); c++)
+            if (it.value().at(c).isNull())
+                unreadable++;
+    }
+    if (unreadable > 0)
+    {
+        last_error = QString("%1 cells of %2 could not be decrypted").
+                     arg(unreadable).arg(name);
+        return false;
+    }
+    return true;
+}
+
+void CommandLine::failed(const QString &error)
+{
+    last_error = error;
+    error_count++;
+    if (wait != 0)
+        wait->quit();
+}
+
+void CommandLine::loggedIn(int uid)
+{
+    Q_UNUSED(uid);
+    logged_in = true;
+    if (wait != 0)
+        wait->quit();
+}
+
+void CommandLine::showProgress(const QString &step, int done, int total)
+{
+    err << step << " (" << done << "/" << total << ")" << endl;
+}
+
+void CommandLine::showMessage(const QString &msg)
+{
+    out << msg << endl;
+}
+
+void CommandLine::tableReady(const QString &name, int columns, int rows)
+{
+    Q_UNUSED(name);
+    table_ready = true;
+    table_columns = columns;
+    table_rows = rows;
+}
+
+void CommandLine::tableSize(int rows, int columns)
+{
+    table_rows = rows;
+    table_columns = columns;
+}
+
+void CommandLine::dataLoaded(const QMap<int, QList<QByteArray> > &data)
+{
+    table_data = data;
+}
@@ -0,0 +1,52 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QtCore>
+#include "CFGManager.h"
+#include "DBManager.h"
+
+class CommandLine : public QObject
+{
+    Q_OBJECT
+public:
+    CommandLine(const QStringList &arguments, QObject *parent = 0);
+    ~CommandLine();
+    int exec();
+
+private:
+    QStringList arguments;
+    CFGManager *cfg;
+    DBManager *db;
+    QEventLoop *wait;
+    QTextStream out;
+    QTextStream err;
+    QString last_error;
+    int error_count;
+    bool logged_in;
+    bool table_ready;
+    int table_columns;
+    int table_rows;
+    QMap<int, QList<QByteArray> > table_data;
+
+    bool login(const QString &user, const QString &password);
+    bool run(const QStringList &command);
+    bool createTable(const QStringList &command);
+    bool importTable(const QStringList &command);
+    bool exportTable(const QStringList &command);
+    bool grantRights(const QStringList &command);
+    bool recompute(const QStringList &command);
+    bool openTable(const QString &name);
+    bool loadTable(const QString &name);
+    void usage();
+
+private slots:
+    void failed(const QString &error);
+    void loggedIn(int uid);
+    void showProgress(const QString &step, int done, int total);
+    void showMessage(const QString &msg);
+    void tableReady(const QString &name, int columns, int rows);
+    void tableSize(int rows, int columns);
+    void dataLoaded(const QMap<int, QList<QByteArray> > &data);
+};
+
+#endif // COMMANDLINE_H
@@ -43,6 +43,7 @@ ConfigurationDialog::~ConfigurationDialog()
     delete spreadSheetTab;
 
     //security items
+    keygen->waitForFinished();
     delete generateKeysButton;
     delete securityLayout;
     delete securityTab;
@@ -198,6 +199,8 @@ void ConfigurationDialog::createSecurityTab()
     securityLayout->addWidget(generateKeysButton);
     connect(generateKeysButton, SIGNAL(pressed()),
             this, SLOT(prepareKeysGeneration()));
+    keygen = new QFutureWatcher<QPair<QString, QString> >(this);
+    connect(keygen, SIGNAL(finished()), this, SLOT(keysGenerated()));
 
     securityTab->setLayout(securityLayout);
 }
@@ -215,7 +218,25 @@ void ConfigurationDialog::prepareKeysGeneration()
 
 void ConfigurationDialog::generateKeys(const QString &name, const QString &pass)
 {
-    QString passphrase = Security::getHash(name+pass);
-    QPair<QString,QString> keys = Security::generateKeyPair(passphrase);
-    emit changeKeys(cfg->getKey(), keys.first, keys.second, passphrase);
+    if (keygen->isRunning())
+        return;
+    pending_passphrase = Security::getHash(name+pass);
+    generateKeysButton->setEnabled(false);
+    generateKeysButton->setText("Generating...");
+    keygen->setFuture(QtConcurrent::run(Security::generateKeyPair,
+                                        pending_passphrase));
+}
+
+void ConfigurationDialog::keysGenerated()
+{
+    generateKeysButton->setText("Generate");
+    generateKeysButton->setEnabled(true);
+    QPair<QString,QString> keys = keygen->result();
+    if (keys.first.isEmpty())
+    {
+        showMessage("Could not generate the keys");
+        return;
+    }
+    emit changeKeys(cfg->getKey(), keys.first, keys.second,
+                    pending_passphrase);
 }
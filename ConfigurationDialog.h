@@ -43,11 +43,14 @@ private:
     QWidget *securityTab;
     QVBoxLayout *securityLayout;
     QPushButton *generateKeysButton;
+    QFutureWatcher<QPair<QString, QString> > *keygen;
+    QString pending_passphrase;
 
 private slots:
     void prepareKeysGeneration();
     void generateKeys(const QString &name,
                    const QString &pass);
+    void keysGenerated();
 
 signals:
     void changeKeys(const QString &oldPrivateKey,
@@ -1,25 +1,434 @@
 #include "DBManager.h"
 #include "SpreadSheet.h"
+#include "Trace.h"
 
-DBManager::DBManager(const CFGManager *cfg)
+//context is Security::cellContext of where the value is stored
+static QByteArray decryptCell(const QVariant &value, int format,
+                              int profile, const QString &key,
+                              const QByteArray &context)
 {
-    this->cfg = cfg;
+    if (format == DBManager::BinaryStorage)
+        return Security::AESDecryptBytes(value.toByteArray(), key, profile,
+                                         context);
+    QString data = value.toString();
+    if (data.isEmpty())
+        return QByteArray("");
+    QString plain = Security::AESDecrypt(data, key);
+    return plain.isEmpty()?QByteArray():plain.toAscii();
+}
+
+static QVariant encryptCell(const QByteArray &cell, int format,
+                            int profile, const QString &key,
+                            const QByteArray &context)
+{
+    if (format == DBManager::BinaryStorage)
+        return cell.isEmpty()?cell:Security::AESEncryptBytes(cell, key, profile,
+                                                             context);
+    if (cell.isEmpty())
+        return QString("");
+    return Security::AESEncrypt(QString(CellCodec::toLegacy(cell)), key);
+}
+
+//ok is false when stored data could not be decrypted
+static RowEnvelope decryptEnvelope(const QVariant &value, int profile,
+                                   const QString &key,
+                                   const QByteArray &context, bool *ok = 0)
+{
+    QByteArray plain = Security::AESDecryptBytes(value.toByteArray(), key,
+                                                 profile, context);
+    if (ok)
+        *ok = !plain.isNull();
+    return RowEnvelope::fromBytes(plain);
+}
+
+//a null cell could not be decrypted
+static QList<QByteArray> unreadableCells(int columns)
+{
+    QList<QByteArray> result;
+    for (int c=0; c<columns; c++)
+        result.append(QByteArray());
+    return result;
+}
+
+static QByteArray rowCell(const QVariant &value, int profile,
+                          const QString &key, const QByteArray &context,
+                          int column)
+{
+    bool ok;
+    RowEnvelope envelope = decryptEnvelope(value, profile, key, context, &ok);
+    return ok?envelope.cell(column):QByteArray();
+}
+
+static bool readable(const QList<QByteArray> &cells)
+{
+    for (int c=0; c<cells.size(); c++)
+        if (cells.at(c).isNull())
+            return false;
+    return true;
+}
 
-    if (!QSqlDatabase::drivers().contains(cfg->getDBType()))
+//decrypted cells of the current record, fields start at column 3
+static QList<QByteArray> rowCells(const TimedQuery *query, int format,
+                                  int profile, int columns,
+                                  const QString &key, int table_id)
+{
+    int line = query->value(0).toInt();
+    if (format == DBManager::RowStorage)
     {
-        emit queryError("Database driver not found. Copy "
-                        "the driver into sqldrivers directory "
-                        "and restart the application");
+        bool ok;
+        RowEnvelope envelope = decryptEnvelope(query->value(3), profile, key,
+                                               Security::cellContext(table_id, line),
+                                               &ok);
+        return ok?envelope.cells(columns):unreadableCells(columns);
+    }
+
+    QList<QByteArray> row;
+    for (int i=0; i<columns; i++)
+        row.append(decryptCell(query->value(i+3), format, profile, key,
+                               Security::cellContext(table_id, line, i)));
+    return row;
+}
+
+typedef QMap<int, QList<QByteArray> > RowData;
+
+RefreshInfo::RefreshInfo() :
+    usecs(-1), rows(0), bytes(0), cells(0), decodeUsecs(0),
+    writes(0), writeUsecs(-1) {}
+
+//times a cell write until it returns on any path
+class WriteTimer
+{
+public:
+    WriteTimer(RefreshInfo *info) : info(info)
+    {
+        info->writes++;
+        clock.start();
+    }
+    ~WriteTimer()
+    {
+        info->writeUsecs = clock.nsecsElapsed() / 1000;
+    }
+
+private:
+    RefreshInfo *info;
+    QElapsedTimer clock;
+};
+
+static const int cellsPerBatch = 1024;
+
+//encrypted fields of consecutive rows, decrypted as one pool job
+struct RowBatch
+{
+    QList<int> rows;
+    QList<QVariantList> values;
+    QString key;
+    int table_id;
+    int cells;
+
+    RowBatch(int table_id = -1) : table_id(table_id), cells(0) {}
+};
+
+static RowData decryptBatch(const RowBatch &batch, int format, int profile,
+                            int columns, const QString &key)
+{
+    TraceSpan span("decrypt batch", "crypto");
+    span.setArgs(QString("\"rows\": %1").arg(batch.rows.size()));
+    RowData result;
+    if (format == DBManager::HexStorage)
+    {
+        for (int r=0; r<batch.rows.size(); r++)
+        {
+            QList<QByteArray> row;
+            const QVariantList &values = batch.values.at(r);
+            for (int i=0; i<values.size(); i++)
+                row.append(decryptCell(values.at(i), format, profile, key,
+                                       QByteArray()));
+            result.insert(batch.rows.at(r), row);
+        }
+        return result;
+    }
+
+    QList<QByteArray> encrypted;
+    QList<QByteArray> contexts;
+    for (int r=0; r<batch.rows.size(); r++)
+    {
+        const QVariantList &values = batch.values.at(r);
+        for (int i=0; i<values.size(); i++)
+        {
+            encrypted.append(values.at(i).toByteArray());
+            contexts.append((format == DBManager::RowStorage)?
+                            Security::cellContext(batch.table_id, batch.rows.at(r)):
+                            Security::cellContext(batch.table_id, batch.rows.at(r), i));
+        }
+    }
+    QList<QByteArray> plain = Security::AESDecryptBatch(encrypted, key, profile,
+                                                        contexts);
+
+    int k = 0;
+    for (int r=0; r<batch.rows.size(); r++)
+    {
+        int fields = batch.values.at(r).size();
+        if (format == DBManager::RowStorage)
+            result.insert(batch.rows.at(r), plain.at(k).isNull()?
+                          unreadableCells(columns):
+                          RowEnvelope::fromBytes(plain.at(k)).cells(columns));
+        else
+            result.insert(batch.rows.at(r), plain.mid(k, fields));
+        k += fields;
+    }
+    return result;
+}
+
+static void flushRows(RowBatch &batch, QList<QFuture<RowData> > &futures,
+                      int format, int profile, int columns)
+{
+    if (batch.rows.isEmpty())
         return;
+    futures.append(QtConcurrent::run(decryptBatch, batch, format,
+                                     profile, columns, batch.key));
+    batch = RowBatch(batch.table_id);
+}
+
+//queues the current record of the query, starting a pool job for full batches
+//or when the row needs a different key than the batch, returns its stored size
+static qint64 queueRow(const TimedQuery *query, int fields, RowBatch &batch,
+                       QList<QFuture<RowData> > &futures, int format,
+                       int profile, int columns, const QString &key)
+{
+    if (batch.key != key)
+    {
+        flushRows(batch, futures, format, profile, columns);
+        batch.key = key;
     }
-    db = QSqlDatabase::addDatabase(this->cfg->getDBType());
-    db.setHostName(this->cfg->getDBServer());
-    db.setPort(this->cfg->getDBPort());
-    db.setDatabaseName(this->cfg->getDBName());
+    qint64 bytes = 0;
+    QVariantList values;
+    for (int i=3; i<fields; i++)
+    {
+        values.append(query->value(i));
+        bytes += (format == DBManager::HexStorage)?
+                 values.last().toString().size():
+                 values.last().toByteArray().size();
+    }
+    batch.rows.append(query->value(0).toInt());
+    batch.values.append(values);
+    batch.cells += columns;
+
+    if (batch.cells >= cellsPerBatch)
+        flushRows(batch, futures, format, profile, columns);
+    return bytes;
+}
+
+//batches are merged in submission order, so rows stay ordered
+static RowData collectRows(const QList<QFuture<RowData> > &futures)
+{
+    RowData result;
+    for (int i=0; i<futures.size(); i++)
+    {
+        RowData batch = futures.at(i).result();
+        QMapIterator<int, QList<QByteArray> > it(batch);
+        while (it.hasNext())
+        {
+            it.next();
+            result.insert(it.key(), it.value());
+        }
+    }
+    return result;
+}
+
+static RefreshPayload decodeRows(const QList<QFuture<RowData> > &futures,
+                                 int table_id)
+{
+    TraceSpan span("decode rows", "refresh");
+    return RefreshPayload::decode(collectRows(futures), table_id);
+}
+
+static QString rowTimestamp()
+{
+    QString timestamp = QDate::currentDate().toString("dd/MM/yyyy");
+    timestamp.append("&");
+    timestamp.append(QTime::currentTime().toString("hh:mm:ss:zzz"));
+    return timestamp;
+}
+
+//rows of a table with the key state of the table appended, both are read
+//by one statement so a rotation cannot commit a chunk in between
+static QString selectRows(const QString &table, int table_id,
+                          const QString &columns = "t.*")
+{
+    return QString("SELECT %1, f.rotation_row, f.key_version "
+                   "FROM %2 t, files f "
+                   "WHERE f.file_id=%3").arg(columns).arg(table).arg(table_id);
+}
+
+//the key a fetched row is encrypted with, rows below rotation_row already
+//use the new key and all of them do once the version moved on, an empty
+//key means the key state changed after it was loaded
+static QString fetchedRowKey(int row, int watermark, int version,
+                             int keyVersion, const QString &key,
+                             const QString &newKey)
+{
+    if (version == keyVersion)
+        return (row < watermark)?newKey:key;
+    if (version == keyVersion + 1 && row >= watermark)
+        return newKey;
+    return QString();
+}
+
+static QStringList generateUserKeys(const QString &passphrase)
+{
+    QPair<QString, QString> keys = Security::generateKeyPair(passphrase);
+    QStringList result;
+    result << keys.first << keys.second
+           << Security::prepareKey(keys.second, passphrase);
+    return result;
+}
+
+struct RekeyAccessKey
+{
+    typedef AccessKeyUpdate result_type;
+
+    RekeyAccessKey(const QString &oldPrivateKey, const QString &publicKey,
+                   const QString &privateKey, const QString &passphrase)
+        : oldPrivateKey(oldPrivateKey), publicKey(publicKey),
+          privateKey(privateKey), passphrase(passphrase) {}
+
+    //the keys are parsed once per worker thread by the Security cache
+    AccessKeyUpdate operator()(const AccessKeyUpdate &item) const
+    {
+        AccessKeyUpdate result = item;
+        QString accKey = Security::RSADecrypt(item.access_key,
+                                              oldPrivateKey, passphrase);
+        result.access_key = Security::RSAEncrypt(accKey, publicKey);
+        result.signed_key = Security::RSASign(accKey, privateKey, passphrase);
+        result.ok = !accKey.isEmpty() && !result.access_key.isEmpty() &&
+                    !result.signed_key.isEmpty();
+        //the new key of a running rotation keeps the owner's signature
+        if (!item.rotation_key.isEmpty())
+        {
+            QString newKey = Security::RSADecrypt(item.rotation_key,
+                                                  oldPrivateKey, passphrase);
+            result.rotation_key = Security::RSAEncrypt(newKey, publicKey);
+            result.ok = result.ok && !newKey.isEmpty() &&
+                        !result.rotation_key.isEmpty();
+        }
+        return result;
+    }
+
+    QString oldPrivateKey;
+    QString publicKey;
+    QString privateKey;
+    QString passphrase;
+};
+
+static const int rowsPerImportBatch = 500;
+
+static const int rowsPerRotationChunk = 256;
+static const int rotationPause = 20;
+static const int rotationRetries = 5;
+static const int rowWriteRetries = 5;
+
+struct ReencryptRow
+{
+    typedef RotatedRow result_type;
+
+    ReencryptRow(int table_id, int format, int profile, const QString &oldKey,
+                 const QString &newKey)
+        : table_id(table_id), format(format), profile(profile),
+          oldKey(oldKey), newKey(newKey) {}
+
+    RotatedRow operator()(const RotatedRow &row) const
+    {
+        RotatedRow result = row;
+        result.ok = true;
+        for (int i=0; i<row.values.size(); i++)
+        {
+            if (format == DBManager::HexStorage)
+            {
+                QString data = row.values.at(i).toString();
+                if (data.isEmpty())
+                    continue;
+                QString plain = Security::AESDecrypt(data, oldKey);
+                //a cell that does not decrypt is left as it is
+                if (plain.isEmpty())
+                {
+                    result.ok = false;
+                    continue;
+                }
+                result.values[i] = Security::AESEncrypt(plain, newKey);
+            }
+            else
+            {
+                QByteArray data = row.values.at(i).toByteArray();
+                if (data.isEmpty())
+                    continue;
+                QByteArray context = (format == DBManager::RowStorage)?
+                            Security::cellContext(table_id, row.row):
+                            Security::cellContext(table_id, row.row, i);
+                QByteArray plain = Security::AESDecryptBytes(data, oldKey,
+                                                             profile, context);
+                if (plain.isNull())
+                {
+                    result.ok = false;
+                    continue;
+                }
+                result.values[i] = Security::AESEncryptBytes(plain, newKey,
+                                                             profile, context);
+            }
+        }
+        return result;
+    }
+
+    int table_id;
+    int format;
+    int profile;
+    QString oldKey;
+    QString newKey;
+};
+
+DBManager::DBManager(const CFGManager *cfg, const QString &connection)
+{
+    this->cfg = cfg;
+    spreadsheet = 0;
+    stats = new QueryStats();
+    //a threshold in config.xml or SEM_SLOW_QUERY_MS turns the slow query log on
+    QByteArray slowMsecs = qgetenv("SEM_SLOW_QUERY_MS");
+    int threshold = slowMsecs.isEmpty()?cfg->getSlowQueryThreshold():
+                                        slowMsecs.toInt();
+    if (threshold > 0)
+        stats->setSlowLog(new SlowQueryLog(cfg->getSlowQueryLog(), threshold));
+    //fetched bytes are only counted when SEM_QUERY_STATS writes them out
+    stats->setCountBytes(!qgetenv("SEM_QUERY_STATS").isEmpty());
+    decoder = new QFutureWatcher<RefreshPayload>(this);
+    connect(decoder, SIGNAL(finished()), this, SLOT(decodeFinished()));
+    keygen = new QFutureWatcher<QStringList>(this);
+    connect(keygen, SIGNAL(finished()), this, SLOT(keyPairGenerated()));
+    rekeyer = new QFutureWatcher<AccessKeyUpdate>(this);
+    connect(rekeyer, SIGNAL(progressValueChanged(int)),
+            this, SLOT(rekeyProgress(int)));
+    connect(rekeyer, SIGNAL(finished()), this, SLOT(rekeyFinished()));
+    rotator = new QFutureWatcher<RotatedRow>(this);
+    connect(rotator, SIGNAL(finished()), this, SLOT(rotationChunkDone()));
+    rotation.table_id = -1;
+    rotation.aborting = false;
+    rotation.abort_requested = false;
+    current_key_version = 0;
+    current_rotation_row = 0;
+    //config.xml or SEM_VERIFY_KEYS=1 verifies access keys on every open
+    QByteArray verifyKeys = qgetenv("SEM_VERIFY_KEYS");
+    setForceKeyVerification(verifyKeys.isEmpty()?
+                            cfg->getForceKeyVerification():verifyKeys != "0");
+    connection_name = connection;
+    db_prepared = false;
+    drivers_started = false;
+    pulled_rows = 0;
+    pulled_bytes = 0;
 
     current_table = new QString();
     current_user_id = -1;
     current_table_id = -1;
+    current_format = HexStorage;
+    current_profile = Security::CBCProfile;
+    current_columns = 0;
 
     security = new Security();
 }
@@ -28,8 +437,8 @@ void DBManager::setCurrentSpreadSheet(SpreadSheet *spreadsheet)
 {
     this->spreadsheet = spreadsheet;
 
-    connect(this, SIGNAL(dataLoaded(QMap<int,QString>)),
-            this->spreadsheet, SLOT(loadData(QMap<int,QString>)));
+    connect(this, SIGNAL(dataDecoded(RefreshPayload)),
+            this->spreadsheet, SLOT(applyData(RefreshPayload)));
     connect(this, SIGNAL(rightsLoaded(QList<int>)),
             this->spreadsheet, SLOT(setRights(QList<int>)));
     connect(this, SIGNAL(rowsHeightLoaded(QMap<int,int>)),
@@ -58,6 +467,7 @@ void DBManager::removeCurrentData()
 {
     current_table->clear();
     current_table_id = -1;
+    spreadsheet = 0;
 }
 
 //OK, TESTED, WORKING
@@ -70,7 +480,7 @@ void DBManager::initializeDatabase(const QString &username,
         emit queryError("Unable to initialize database");
         return;
     }
-    query = new QSqlQuery(db);
+    query = new TimedQuery(db, stats);
     if (!query->exec(QString("CREATE DATABASE %1").arg(cfg->getDBName())))
     {
         emit queryError("Unable to create database");
@@ -118,7 +528,7 @@ void DBManager::grantReadAccess(const QString &username)
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         emit queryError("User does not exist");
         return;
@@ -143,19 +553,30 @@ void DBManager::grantReadAccess(const QString &username)
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() > 0)
+    if (query->rowCount() > 0)
     {
         emit queryError("User has read access");
         return;
     }
     
     query->prepare("INSERT INTO access_keys "
-                   "VALUES (:tid, :uid, :key, :signedkey)");
+                   "(table_id, user_id, access_key, signed_key, "
+                   "rotation_key, rotation_signed_key) "
+                   "VALUES (:tid, :uid, :key, :signedkey, "
+                   ":rotationkey, :rotationsigned)");
     query->bindValue(":tid", current_table_id);
     query->bindValue(":uid", uid);
     query->bindValue(":key", Security::RSAEncrypt(security->getAESkey(), 
                                                   pubkey));
     query->bindValue(":signedkey", security->RSASign(security->getAESkey()));
+    //while the key rotates the new user needs the new key as well
+    bool rotating = !current_rotation_key.isEmpty();
+    query->bindValue(":rotationkey", rotating?
+                     QVariant(Security::RSAEncrypt(current_rotation_key, pubkey)):
+                     QVariant(QVariant::String));
+    query->bindValue(":rotationsigned", rotating?
+                     QVariant(security->RSASign(current_rotation_key)):
+                     QVariant(QVariant::String));
     if (!query->exec())
     {
         emit queryError("Please check your database connection");
@@ -176,7 +597,7 @@ void DBManager::grantWriteAccess(const QString &username, const QList<int> colum
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         emit queryError("User does not exist");
         return;
@@ -197,7 +618,7 @@ void DBManager::grantWriteAccess(const QString &username, const QList<int> colum
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         emit queryError("User does not have read access on this table");
         return;
@@ -218,7 +639,7 @@ void DBManager::grantWriteAccess(const QString &username, const QList<int> colum
             emit queryError("Please check your database connection");
             return;
         }
-        if (query->size() > 0)
+        if (query->rowCount() > 0)
             continue;
 
         query->prepare("INSERT INTO rights "
@@ -237,40 +658,61 @@ void DBManager::grantWriteAccess(const QString &username, const QList<int> colum
 }
 
 //OK, TESTED, WORKING
-bool DBManager::writeData(int line, int column, const QString& cell_data)
+bool DBManager::writeData(int line, int column, const QByteArray& cell_data)
 {   
-    QString dataToWrite;
-    (cell_data == "")?(dataToWrite = ""):
-            (dataToWrite = security->AESEncrypt(cell_data));
+    PhaseTimer timer(stats, "writeData", "total");
+    WriteTimer write(&last_refresh);
+    db.transaction();
+    if (!checkTableKey(true))
+    {
+        db.rollback();
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return false;
+    }
+    if (current_format == RowStorage)
+        return writeRowData(line, column, cell_data);
+
+    QElapsedTimer encrypt;
+    encrypt.start();
+    QVariant dataToWrite = encryptCell(cell_data, current_format,
+                                       current_profile, rowKey(line),
+                                       Security::cellContext(current_table_id,
+                                                             line, column));
+    stats->addPhase("writeData", "encrypt", encrypt.nsecsElapsed() / 1000);
     query->prepare(QString("SELECT row_index FROM %1 "
                            "WHERE row_index = %2")
                            .arg(*current_table).arg(line));
     if (!query->exec())
     {
+        db.rollback();
         emit queryError("Please check your database connection");
         return false;
     }
 
-    QString timestamp = QDate::currentDate().toString("dd/MM/yyyy");
-    timestamp.append("&");
-    timestamp.append(QTime::currentTime().toString("hh:mm:ss:zzz"));
+    QString timestamp = rowTimestamp();
 
-    int size = query->size();
+    int size = query->rowCount();
     
     if (size == 0)
     {
-        if (dataToWrite == "")
+        if (cell_data.isEmpty())
+        {
+            db.rollback();
             return false;
+        }
         
-        QString q = QString("INSERT INTO %1 "
-                            "(row_index, row_timestamp, row_height, field%2) "
-                            "VALUES (%3, '%4', %5, '%6')").
-                        arg(*current_table).arg(column).arg(line).
-                        arg(timestamp).arg(spreadsheet->rowHeight(line)).
-                        arg(dataToWrite);
-        
-        if (!query->exec(q))
+        query->prepare(QString("INSERT INTO %1 "
+                               "(row_index, row_timestamp, row_height, field%2) "
+                               "VALUES (:row, :timestamp, :height, :data)").
+                           arg(*current_table).arg(column));
+        query->bindValue(":row", line);
+        query->bindValue(":timestamp", timestamp);
+        query->bindValue(":height", spreadsheet->rowHeight(line));
+        query->bindValue(":data", dataToWrite);
+        if (!query->exec() || !db.commit())
         {
+            db.rollback();
             emit queryError("Please check your database connection");
             return false;
         }
@@ -279,107 +721,148 @@ bool DBManager::writeData(int line, int column, const QString& cell_data)
     }
     else if (size > 0)
     {
-        QString q = QString("UPDATE %1 "
-                            "SET row_timestamp = '%2', "
-                            "field%3 = '%4' "
-                            "WHERE row_index = %5").
-                        arg(*current_table).
-                        arg(timestamp).
-                        arg(column).
-                        arg(dataToWrite).
-                        arg(line);
-        if (!query->exec(q))
+        query->prepare(QString("UPDATE %1 "
+                               "SET row_timestamp = :timestamp, "
+                               "field%2 = :data "
+                               "WHERE row_index = :row").
+                           arg(*current_table).arg(column));
+        query->bindValue(":timestamp", timestamp);
+        query->bindValue(":data", dataToWrite);
+        query->bindValue(":row", line);
+        if (!query->exec() || !db.commit())
         {
+            db.rollback();
             emit queryError("Please check your database connection");
             return false;
         }
         spreadsheet->replaceTimestamp(line, timestamp);
         return true;
     }
+    db.rollback();
     emit queryError("Please check your database connection");
     return false;
 }
 
-void DBManager::connectDB(const QString &uname, const QString &pass)
-{
-    db.setUserName(uname);
-    db.setPassword(pass);
-    if (!db.open())
-    {
-        QString error = db.lastError().text();
-        emit queryError(QString("Unable to connect to database\nError: ").
-                        append(error));
-        /*
-        emit initializeDatabaseRequest(uname, pass,
-                                       QString("Unable to connect to database\nError: ").
-                                       append(error));*/
-    }
-    else
-    {
-        query = new QSqlQuery(db);
-        login(uname, pass);
-    }
-}
-
-//OK, TESTED, WORKING
-void DBManager::getData()
+//the row is only replaced while it still has the timestamp it was read
+//with, a write of another session in between makes it read the row again
+bool DBManager::writeRowData(int line, int column, const QByteArray &cell_data)
 {
-    QString aux = QString("SELECT * "
-                          "FROM %1").arg(*current_table);
-    int timestampCount = spreadsheet->timestampCount();
-    QString aux2 = "";
-    if (timestampCount > 0)
+    QByteArray context = Security::cellContext(current_table_id, line);
+    for (int attempt=0; attempt<rowWriteRetries; attempt++)
     {
-        aux2.append(" WHERE row_timestamp NOT IN (");
-        for (int i=0; i<timestampCount; i++)
+        //the first attempt runs in the transaction writeData opened
+        if (attempt > 0)
         {
-            aux2.append("'");
-            aux2.append(spreadsheet->getTimestamp(i));
-            aux2.append("', ");
+            db.transaction();
+            if (!checkTableKey(true))
+            {
+                db.rollback();
+                emit queryError("The table is being converted or its key "
+                                "rotated, try again later");
+                return false;
+            }
+        }
+        QString key = rowKey(line);
+        query->prepare(QString("SELECT row_timestamp, row_data FROM %1 "
+                               "WHERE row_index = :row").arg(*current_table));
+        query->bindValue(":row", line);
+        if (!query->exec())
+        {
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
+        }
+        bool exists = false, ok = true;
+        QString previous;
+        RowEnvelope envelope;
+        while (query->next())
+        {
+            exists = true;
+            previous = query->value(0).toString();
+            envelope = decryptEnvelope(query->value(1), current_profile, key,
+                                       context, &ok);
+        }
+        //writing back an empty envelope would delete the other cells
+        if (!ok)
+        {
+            db.rollback();
+            emit queryError("The row could not be decrypted, "
+                            "the cell was not saved");
+            return false;
+        }
+        if (!exists && cell_data.isEmpty())
+        {
+            db.rollback();
+            return false;
         }
-        aux2.remove(aux2.length()-2, 2);
-        aux2.append(")");
-    }
-    aux.append(aux2);
-    aux.append(" ORDER BY row_index");
 
-    if (!query->exec(aux))
-    {
-        emit queryError("Please check your database connection");
-        return;
+        envelope.setCell(column, cell_data);
+        QString timestamp = rowTimestamp();
+        if (exists)
+        {
+            query->prepare(QString("UPDATE %1 "
+                                   "SET row_timestamp = :timestamp, "
+                                   "row_data = :data "
+                                   "WHERE row_index = :row "
+                                   "AND row_timestamp = :previous").
+                               arg(*current_table));
+            query->bindValue(":previous", previous);
+        }
+        else
+        {
+            query->prepare(QString("INSERT INTO %1 "
+                                   "(row_index, row_timestamp, row_height, row_data) "
+                                   "VALUES (:row, :timestamp, :height, :data)").
+                               arg(*current_table));
+            query->bindValue(":height", spreadsheet->rowHeight(line));
+        }
+        query->bindValue(":row", line);
+        query->bindValue(":timestamp", timestamp);
+        query->bindValue(":data", Security::AESEncryptBytes(envelope.toBytes(), key,
+                                                            current_profile,
+                                                            context));
+        //an insert fails when another session inserted the row first
+        bool written = query->exec();
+        if (!written && exists)
+        {
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
+        }
+        if (!written || query->numRowsAffected() == 0)
+        {
+            db.rollback();
+            continue;
+        }
+        db.commit();
+
+        //a row changed by another session since the last refresh keeps its
+        //old timestamp, so that the next refresh shows the other cells
+        if (!exists)
+            spreadsheet->addTimestamp(line, timestamp);
+        else if (previous == spreadsheet->getTimestamp(line))
+            spreadsheet->replaceTimestamp(line, timestamp);
+        return true;
     }
+    emit queryError("The row is being changed by other users, "
+                    "please try again");
+    return false;
+}
 
-    int columns = query->record().count();
-    if (columns == 0)
-        return;
-
-    spreadsheet->setColumnCount(columns-3);
-    
-    bool add = false;
-    if (timestampCount == 0)
-        add = true;
-    QMap<int, QString> current_data = QMap<int, QString>();
-    QMap<int,int> rows_height = QMap<int,int>();
-    while (query->next())
+//replaces whole rows of the current table without a spreadsheet,
+//committing every rowsPerImportBatch rows
+bool DBManager::writeRows(const QMap<int, QList<QByteArray> > &rows)
+{
+    PhaseTimer timer(stats, "writeRows", "total");
+    if (!checkTableKey())
     {
-        aux.clear();
-        for (int i=3; i<columns; i++)
-        {
-            QString data = query->value(i).toString();
-            QString decryptedData;
-            (data == "")?(decryptedData = ""):
-                    (decryptedData = security->AESDecrypt(data));
-            aux.append(decryptedData+"\n");
-        }
-        aux.remove(aux.length()-1, 1);
-        current_data.insert(query->value(0).toInt(), aux);
-        rows_height.insert(query->value(0).toInt(),
-                           query->value(2).toInt());
-        if (add)
-            spreadsheet->addTimestamp(query->value(0).toInt(), query->value(1).toString());
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return false;
     }
+    int columns = (current_format == RowStorage)?current_columns:
+                  db.record(*current_table).count() - 3;
 
-    QList<int> writable_columns = QList<int>();
     query->prepare("SELECT column_id "
                    "FROM rights "
                    "WHERE table_id=:tid "
@@ -389,39 +872,343 @@ void DBManager::getData()
     if (!query->exec())
     {
         emit queryError("Please check your database connection");
-        return;
+        return false;
     }
+    QSet<int> writable;
     while (query->next())
-        writable_columns.append(query->value(0).toInt());
+        writable.insert(query->value(0).toInt());
+    //whole rows are replaced, so every column has to be writable
+    for (int c=0; c<columns; c++)
+        if (!writable.contains(c))
+        {
+            emit queryError(QString("You don't have rights for writing "
+                                    "column %1").arg(c+1));
+            return false;
+        }
 
-    QMap<int,int> columns_width = QMap<int,int>();
-    QMap<int,QString> headers_text = QMap<int,QString>();
-    query->prepare("SELECT column_id, width, header_text "
-                   "FROM tables_settings "
-                   "WHERE table_id=:tid");
-    query->bindValue(":tid", current_table_id);
-    if (!query->exec())
+    int lastRow = -1;
+    QMapIterator<int, QList<QByteArray> > it(rows);
+    while (it.hasNext())
+    {
+        it.next();
+        if (it.value().size() > columns)
+        {
+            emit queryError(QString("Row %1 has more cells than the table "
+                                    "has columns").arg(it.key()+1));
+            return false;
+        }
+        lastRow = it.key();
+    }
+
+    if (!query->exec(QString("SELECT row_index FROM %1").arg(*current_table)))
     {
         emit queryError("Please check your database connection");
-        return;
+        return false;
     }
+    QSet<int> existing;
     while (query->next())
+        existing.insert(query->value(0).toInt());
+
+    QString fields = (current_format == RowStorage)?QString("row_data"):QString();
+    QString values = (current_format == RowStorage)?QString(":f0"):QString();
+    QString updates = (current_format == RowStorage)?
+                      QString("row_data = :f0"):QString();
+    for (int c=0; current_format != RowStorage && c<columns; c++)
+    {
+        fields.append(QString("%1field%2").arg(c?", ":"").arg(c));
+        values.append(QString("%1:f%2").arg(c?", ":"").arg(c));
+        updates.append(QString("%1field%2 = :f%2").arg(c?", ":"").arg(c));
+    }
+    TimedQuery inserter(db, stats);
+    inserter.prepare(QString("INSERT INTO %1 "
+                             "(row_index, row_timestamp, row_height, %2) "
+                             "VALUES (:row, :timestamp, :height, %3)").
+                     arg(*current_table).arg(fields).arg(values));
+    TimedQuery updater(db, stats);
+    updater.prepare(QString("UPDATE %1 "
+                            "SET row_timestamp = :timestamp, %2 "
+                            "WHERE row_index = :row").
+                    arg(*current_table).arg(updates));
+
+    int height = cfg->getCellsSize().height();
+    int written = 0;
+    it.toFront();
+    while (it.hasNext())
     {
-        columns_width.insert(query->value(0).toInt(),
-                             query->value(1).toInt());
-        headers_text.insert(query->value(0).toInt(),
-                            query->value(2).toString());
-    }
-    emit columnsWidthLoaded(columns_width);
-    emit rowsHeightLoaded(rows_height);
-    emit columnsHeaderTextLoaded(headers_text);
-    emit rightsLoaded(writable_columns);
-    emit dataLoaded(current_data);
-}
-
+        it.next();
+        //every batch holds the key state, rows below rotation_row take the
+        //new key while the table key rotates
+        if (written % rowsPerImportBatch == 0)
+        {
+            if (written > 0)
+                db.commit();
+            db.transaction();
+            if (!checkTableKey(true))
+            {
+                db.rollback();
+                emit queryError("The table is being converted or its key "
+                                "rotated, try again later");
+                return false;
+            }
+        }
+        QString key = rowKey(it.key());
+        bool exists = existing.contains(it.key());
+        TimedQuery &writer = exists?updater:inserter;
+        writer.bindValue(":row", it.key());
+        writer.bindValue(":timestamp", rowTimestamp());
+        if (!exists)
+            writer.bindValue(":height", height);
+
+        QElapsedTimer encrypt;
+        encrypt.start();
+        if (current_format == RowStorage)
+        {
+            RowEnvelope envelope;
+            for (int c=0; c<it.value().size(); c++)
+                envelope.setCell(c, it.value().at(c));
+            writer.bindValue(":f0", Security::AESEncryptBytes(envelope.toBytes(),
+                                 key, current_profile,
+                                 Security::cellContext(current_table_id, it.key())));
+        }
+        else
+            for (int c=0; c<columns; c++)
+                writer.bindValue(QString(":f%1").arg(c),
+                                 encryptCell(it.value().value(c), current_format,
+                                             current_profile, key,
+                                             Security::cellContext(current_table_id,
+                                                                   it.key(), c)));
+        stats->addPhase("writeRows", "encrypt", encrypt.nsecsElapsed() / 1000);
+
+        if (!writer.exec())
+        {
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
+        }
+        written++;
+    }
+    if (written > 0)
+        db.commit();
+
+    query->prepare("SELECT row_count FROM files WHERE file_id=:fid");
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int rowCount = 0;
+    while (query->next())
+        rowCount = query->value(0).toInt();
+    if (lastRow >= rowCount)
+        addRows(lastRow + 1 - rowCount);
+    return true;
+}
+
+//loads the SQL driver plugins on the thread pool, off the startup path
+void DBManager::preloadDrivers()
+{
+    //a default constructed QFuture already counts as started, so track it here
+    if (drivers_started)
+        return;
+    drivers_started = true;
+    drivers = QtConcurrent::run(QSqlDatabase::drivers);
+}
+
+//the connection is only set up when the first login needs it
+bool DBManager::prepareDatabase()
+{
+    if (db_prepared)
+        return true;
+    TraceSpan span("prepare database", "startup");
+    preloadDrivers();
+    drivers.waitForFinished();
+    QStringList available = (drivers.resultCount() > 0)?drivers.result():
+                                                          QSqlDatabase::drivers();
+    if (!available.contains(cfg->getDBType()))
+    {
+        emit queryError("Database driver not found. Copy "
+                        "the driver into sqldrivers directory "
+                        "and restart the application");
+        return false;
+    }
+    //several managers can share a process when each has its own connection
+    if (connection_name.isEmpty())
+        db = QSqlDatabase::addDatabase(this->cfg->getDBType());
+    else
+        db = QSqlDatabase::addDatabase(this->cfg->getDBType(), connection_name);
+    db.setHostName(this->cfg->getDBServer());
+    db.setPort(this->cfg->getDBPort());
+    db.setDatabaseName(this->cfg->getDBName());
+    db_prepared = true;
+    return true;
+}
+
+void DBManager::connectDB(const QString &uname, const QString &pass)
+{
+    if (!prepareDatabase())
+        return;
+    db.setUserName(uname);
+    db.setPassword(pass);
+    if (!db.open())
+    {
+        QString error = db.lastError().text();
+        emit queryError(QString("Unable to connect to database\nError: ").
+                        append(error));
+        /*
+        emit initializeDatabaseRequest(uname, pass,
+                                       QString("Unable to connect to database\nError: ").
+                                       append(error));*/
+    }
+    else
+    {
+        query = new TimedQuery(db, stats);
+        upgradeSchema();
+        login(uname, pass);
+    }
+}
+
+//OK, TESTED, WORKING
+void DBManager::getData()
+{
+    if (decoder->isRunning())
+        return;
+    TraceSpan span("getData", "refresh");
+    QElapsedTimer frame;
+    frame.start();
+    refresh_clock.start();
+    //sessions without the new key of a rotation keep the last loaded data
+    if (!checkTableKey())
+    {
+        emit refreshPaused("The table is being converted or its key rotated, "
+                           "refreshing is paused");
+        return;
+    }
+
+    QString aux = selectRows(*current_table, current_table_id);
+    int timestampCount = spreadsheet->timestampCount();
+    QString aux2 = "";
+    if (timestampCount > 0)
+    {
+        aux2.append(" AND t.row_timestamp NOT IN (");
+        for (int i=0; i<timestampCount; i++)
+        {
+            aux2.append("'");
+            aux2.append(spreadsheet->getTimestamp(i));
+            aux2.append("', ");
+        }
+        aux2.remove(aux2.length()-2, 2);
+        aux2.append(")");
+    }
+    aux.append(aux2);
+    aux.append(" ORDER BY t.row_index");
+
+    qint64 sqlStart = Trace::now();
+    if (!query->exec(aux))
+    {
+        emit queryError("Please check your database connection");
+        return;
+    }
+
+    int fields = query->record().count() - 2;
+    if (fields <= 0)
+        return;
+    int columns = (current_format == RowStorage)?current_columns + 3:fields;
+
+    spreadsheet->setColumnCount(columns-3);
+    
+    bool add = false;
+    if (timestampCount == 0)
+        add = true;
+    QString key = security->getAESkey();
+    RowBatch batch(current_table_id);
+    QList<QFuture<RowData> > batches;
+    QMap<int,int> rows_height = QMap<int,int>();
+    qint64 bytes = 0;
+    while (query->next())
+    {
+        QString fetchedKey = fetchedRowKey(query->value(0).toInt(),
+                                       query->value(fields).toInt(),
+                                       query->value(fields+1).toInt(),
+                                       current_key_version, key,
+                                       current_rotation_key);
+        //every record carries the same key state, so this stops at the
+        //first one and the next refresh loads the key that changed
+        if (fetchedKey.isEmpty())
+        {
+            QTimer::singleShot(0, this, SLOT(getData()));
+            return;
+        }
+        bytes += queueRow(query, fields, batch, batches, current_format,
+                          current_profile, columns-3, fetchedKey);
+        rows_height.insert(query->value(0).toInt(),
+                           query->value(2).toInt());
+        if (add)
+            spreadsheet->addTimestamp(query->value(0).toInt(), query->value(1).toString());
+    }
+    Trace::complete("select rows", "sql", sqlStart, Trace::now() - sqlStart,
+                    QString("\"rows\": %1").arg(rows_height.size()));
+
+    sqlStart = Trace::now();
+    QList<int> writable_columns = QList<int>();
+    query->prepare("SELECT column_id "
+                   "FROM rights "
+                   "WHERE table_id=:tid "
+                   "AND user_id=:uid");
+    query->bindValue(":tid", current_table_id);
+    query->bindValue(":uid", current_user_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return;
+    }
+    while (query->next())
+        writable_columns.append(query->value(0).toInt());
+
+    QMap<int,int> columns_width = QMap<int,int>();
+    QMap<int,QString> headers_text = QMap<int,QString>();
+    query->prepare("SELECT column_id, width, header_text "
+                   "FROM tables_settings "
+                   "WHERE table_id=:tid");
+    query->bindValue(":tid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return;
+    }
+    while (query->next())
+    {
+        columns_width.insert(query->value(0).toInt(),
+                             query->value(1).toInt());
+        headers_text.insert(query->value(0).toInt(),
+                            query->value(2).toString());
+    }
+    Trace::complete("select rights and settings", "sql", sqlStart,
+                    Trace::now() - sqlStart);
+
+    qint64 applyStart = Trace::now();
+    spreadsheet->beginUpdate();
+    emit columnsWidthLoaded(columns_width);
+    emit rowsHeightLoaded(rows_height);
+    emit columnsHeaderTextLoaded(headers_text);
+    emit rightsLoaded(writable_columns);
+    spreadsheet->endUpdate();
+    Trace::complete("apply settings", "ui", applyStart, Trace::now() - applyStart);
+
+    flushRows(batch, batches, current_format, current_profile, columns-3);
+    pulled_rows = rows_height.size();
+    pulled_bytes = bytes;
+    decode_clock.start();
+    decoder->setFuture(QtConcurrent::run(decodeRows,
+                                         batches, current_table_id));
+    spreadsheet->recordFrame(frame.nsecsElapsed() / 1000);
+    stats->addPhase("getData", "fetch", frame.nsecsElapsed() / 1000);
+}
+
 //OK, TESTED, WORKING
 QHash<QString,QString> DBManager::getLinkData(const QHash<QString, QString> &matches) const
 {
+    PhaseTimer timer(stats, "getLinkData", "total");
     QHash<QString,QString> result = QHash<QString,QString>();
     QString aux = "";
     QHashIterator<QString,QString> it(matches);
@@ -430,7 +1217,8 @@ QHash<QString,QString> DBManager::getLinkData(const QHash<QString, QString> &mat
         it.next();
         QString link = QString("%1:%2").arg(it.key()).arg(it.value());
         QPair<int,int> id = SpreadSheet::getLocation(it.value());
-        aux = QString("SELECT file_id, table_name "
+        aux = QString("SELECT file_id, table_name, storage_format, "
+                      "cipher_profile, owner, key_version "
                       "FROM files "
                       "WHERE file_name='%1'").arg(it.key());
         if (!query->exec(aux))
@@ -439,44 +1227,65 @@ QHash<QString,QString> DBManager::getLinkData(const QHash<QString, QString> &mat
             return QHash<QString,QString>();
         }
         int file_id = -1;
+        int format = HexStorage;
+        int profile = Security::CBCProfile;
+        int owner = -1;
+        int version = 0;
         QString table_name = "";
         while (query->next())
         {
             file_id = query->value(0).toInt();
             table_name = query->value(1).toString();
+            format = query->value(2).toInt();
+            profile = query->value(3).toInt();
+            owner = query->value(4).toInt();
+            version = query->value(5).toInt();
         }
         
-        query->prepare("SELECT access_key "
-                       "FROM access_keys "
-                       "WHERE table_id=:tid "
-                       "AND user_id=:uid");
-        query->bindValue(":tid", file_id);
-        query->bindValue(":uid", current_user_id);
-        if (!query->exec())
-        {
-            emit queryError("Please check your database connection");
-            return QHash<QString,QString>();
-        }
-        if (query->size() == 0)
+        QString error = "";
+        QString key = "";
+        QString newKey = "";
+        if (!tableKeys(file_id, owner, &key, &newKey, &error))
         {
             result.insertMulti(link, "#####");
             continue;
         }
-        QString key = "";
-        while (query->next())
-            key = security->RSADecrypt(query->value(0).toString());
         
-        aux = QString("SELECT field%1 FROM %2 "
-                      "WHERE row_index=%3").
-              arg(id.second).arg(table_name).arg(id.first);
+        aux = selectRows(table_name, file_id,
+                         (format == RowStorage)?QString("t.row_data"):
+                                                QString("t.field%1").arg(id.second));
+        aux.append(QString(" AND t.row_index=%1").arg(id.first));
         if (!query->exec(aux))
         {
             emit queryError("Please check your database connection");
             return QHash<QString,QString>();
         }
         aux = "";
+        QElapsedTimer decrypt;
+        decrypt.start();
         while (query->next())
-            aux = security->AESDecrypt(query->value(0).toString(), key);
+        {
+            QString fetchedKey = fetchedRowKey(id.first, query->value(1).toInt(),
+                                           query->value(2).toInt(), version,
+                                           key, newKey);
+            //a key that changed after it was loaded leaves the link unreadable
+            QByteArray cell;
+            if (fetchedKey.isEmpty())
+                cell = QByteArray();
+            else if (format == RowStorage)
+                cell = rowCell(query->value(0), profile, fetchedKey,
+                               Security::cellContext(file_id, id.first),
+                               id.second);
+            else
+                cell = decryptCell(query->value(0), format, profile, fetchedKey,
+                                   Security::cellContext(file_id, id.first,
+                                                         id.second));
+            if (cell.isNull())
+                aux = "#####";
+            else
+                CellCodec::decode(cell, 0, &aux);
+        }
+        stats->addPhase("getLinkData", "decrypt", decrypt.nsecsElapsed() / 1000);
         result.insertMulti(link, aux);
     }
     return result;
@@ -489,7 +1298,9 @@ void DBManager::getData(const QString &table)
         return;
 
     int rows = 0;
-    QString aux = QString("SELECT file_id, table_name, row_count "
+    QString aux = QString("SELECT file_id, table_name, row_count, "
+                          "storage_format, column_count, cipher_profile, "
+                          "owner, key_version "
                           "FROM files "
                           "WHERE file_name='%1'").arg(table);
     if (!query->exec(aux))
@@ -498,57 +1309,60 @@ void DBManager::getData(const QString &table)
         return;
     }
     int file_id = -1;
+    int format = HexStorage;
+    int columns = 0;
+    int profile = Security::CBCProfile;
+    int owner = -1;
+    int version = 0;
     while (query->next())
     {
         file_id = query->value(0).toInt();
         aux = query->value(1).toString();
         rows = query->value(2).toInt();
+        format = query->value(3).toInt();
+        columns = query->value(4).toInt();
+        profile = query->value(5).toInt();
+        owner = query->value(6).toInt();
+        version = query->value(7).toInt();
     }
     
-    query->prepare("SELECT access_key "
-                   "FROM access_keys "
-                   "WHERE table_id=:tid "
-                   "AND user_id=:uid");
-    query->bindValue(":tid", file_id);
-    query->bindValue(":uid", current_user_id);
-    if (!query->exec())
-    {
-        emit queryError("Please check your database connection");
-        return;
-    }
-    if (query->size() == 0)
+    QString error = "";
+    QString key = "";
+    QString newKey = "";
+    if (!tableKeys(file_id, owner, &key, &newKey, &error))
     {
-        emit queryError("You don't have rights for reading this table");
+        emit queryError(error);
         return;
     }
-    QString key = "";
-    while (query->next())
-        key = security->RSADecrypt(query->value(0).toString());
     
-    if (!query->exec(QString("SELECT * FROM %1").arg(aux)))
+    if (!query->exec(selectRows(aux, file_id)))
     {
         emit queryError("Please check your database connection");
         return;
     }
     
-    int cols = query->record().count();
+    int fields = query->record().count() - 2;
+    int cols = (format == RowStorage)?columns + 3:fields;
     emit setSpreadsheetSize(rows, cols-3); 
-    QMap<int, QString> current_data = QMap<int, QString>();
+    RowBatch batch(file_id);
+    QList<QFuture<RowData> > batches;
     while (query->next())
     {
-          aux.clear();
-          for (int c=3; c<cols; c++)
-          {
-              QString data = query->value(c).toString();
-              QString decryptedData;
-              (data == "")?(decryptedData = ""):
-                      (decryptedData = security->AESDecrypt(data, key));
-              aux.append(decryptedData+"\n");
-          }
-          aux.remove(aux.length()-1, 1);
-          current_data.insert(query->value(0).toInt(), aux);
-    }
-    emit givenDataLoaded(current_data);
+        QString fetchedKey = fetchedRowKey(query->value(0).toInt(),
+                                       query->value(fields).toInt(),
+                                       query->value(fields+1).toInt(),
+                                       version, key, newKey);
+        if (fetchedKey.isEmpty())
+        {
+            emit queryError("The table key changed while the table was read, "
+                            "try again");
+            return;
+        }
+        queueRow(query, fields, batch, batches, format, profile, cols-3,
+                 fetchedKey);
+    }
+    flushRows(batch, batches, format, profile, cols-3);
+    emit givenDataLoaded(collectRows(batches));
     //emit rightsLoaded(QList<int>());
 }
 
@@ -568,14 +1382,17 @@ void DBManager::createTable(const QString &name, int columns,
         current_index = query->value(0).toInt();
 
     QString tableName = QString("table%1").arg(current_index);
-    current_table = new QString(tableName);
+    *current_table = tableName;
     current_table_id = current_index;
+    current_format = storageFormat(cfg->getStorageFormat());
+    current_profile = (current_format == HexStorage)?Security::CBCProfile:
+                      cipherProfile(cfg->getCipherProfile());
+    current_columns = columns;
     
     QString aux = QString("CREATE TABLE %1 (row_index INT NOT NULL, "
                           "row_timestamp VARCHAR(25) NOT NULL, "
                           "row_height INT NOT NULL, ").arg(tableName);
-    for (int i=0; i<columns; i++)
-        aux.append(QString("field%1 VARCHAR(2048), ").arg(i));
+    aux.append(fieldsDefinition(current_format, columns));
     aux.append("CONSTRAINT row_index_pk "
                "PRIMARY KEY (row_index) )");
     if (!query->exec(aux))
@@ -585,14 +1402,20 @@ void DBManager::createTable(const QString &name, int columns,
     }
     
     query->prepare("INSERT INTO files "
+                   "(file_id, table_name, file_name, owner, row_count, "
+                   "folder, storage_format, column_count, cipher_profile) "
                    "VALUES (:id, :tableName, :fileName, :owner, :rows, "
-                   "(SELECT folder_id FROM folders WHERE folder_name = :folder) )");
+                   "(SELECT folder_id FROM folders WHERE folder_name = :folder), "
+                   ":format, :columns, :profile)");
     query->bindValue(":id", current_index);
     query->bindValue(":tableName", tableName);
     query->bindValue(":fileName", name);
     query->bindValue(":owner", current_user_id);
     query->bindValue(":rows", rows);
     query->bindValue(":folder", folder);
+    query->bindValue(":format", current_format);
+    query->bindValue(":columns", columns);
+    query->bindValue(":profile", current_profile);
     if (!query->exec())
     {
         query->exec(QString("DROP TABLE %1").arg(tableName));
@@ -601,6 +1424,7 @@ void DBManager::createTable(const QString &name, int columns,
     }    
 
     query->prepare("INSERT INTO access_keys "
+                   "(table_id, user_id, access_key, signed_key) "
                    "VALUES (:tid, :uid, :key, :signature)");
     query->bindValue(":tid", current_table_id);
     query->bindValue(":uid", current_user_id);
@@ -622,195 +1446,1375 @@ void DBManager::createTable(const QString &name, int columns,
     QString accKeySigned = security->RSASign(aesKey);
     if (accKeySigned == "")
     {
-        deleteTable(current_table_id);
-        emit queryError("Unable to sign the access key");
+        deleteTable(current_table_id);
+        emit queryError("Unable to sign the access key");
+        return;
+    }
+    query->bindValue(":signature", accKeySigned);
+    security->setAESkey(aesKey);
+    
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return;
+    }
+
+    for (int i=0; i<columns; i++)
+        if (!query->exec(QString("INSERT INTO rights "
+                                 "VALUES (%1, %2, %3)").arg(current_index).
+                                            arg(current_user_id).arg(i)))
+        {
+            deleteTable(current_table_id);
+            emit queryError("Please check your database connection");
+            return;
+        }
+    
+    query->prepare("UPDATE current_ids "
+                   "SET val=val+1 "
+                   "WHERE type='file'");
+    if (!query->exec())
+    {
+        query->exec(QString("DROP TABLE %1").arg(tableName));
+        query->prepare("DELETE FROM files WHERE file_id=:fileID");
+        query->bindValue(":fileID", current_index);
+        emit queryError("Please check your database connection");
+        return;
+    }
+
+    emit tableCreated(tableName, columns, rows);
+}
+
+//OK, TESTED, WORKING
+void DBManager::openTable(const QString &name, int columns,
+              int rows, const QString &folder)
+{   
+    query->prepare("SELECT table_name, row_count, file_id, owner, "
+                   "storage_format, column_count, cipher_profile, "
+                   "key_version, rotation_key, rotation_row "
+                   "FROM files "
+                   "WHERE file_name = :name");
+    query->bindValue(":name", name);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return;
+    }
+    if (query->rowCount() == 0)
+    {
+        emit queryError(QString("Table %1 does not exist").arg(name));
+        return;
+    }
+    int row_count = 0;
+    int owner = -1;
+    while (query->next())
+    {
+        *current_table = query->value(0).toString();
+        current_table_id = query->value(2).toInt();
+        row_count = query->value(1).toInt();
+        owner = query->value(3).toInt();
+        current_format = query->value(4).toInt();
+        current_columns = query->value(5).toInt();
+        current_profile = query->value(6).toInt();
+        current_key_version = query->value(7).toInt();
+        current_rotation_wrapped = query->value(8).toString();
+        current_rotation_row = query->value(9).toInt();
+    }
+
+    if (!loadTableKey(owner))
+        return;
+    //an interrupted rotation resumes as soon as its owner opens the table
+    if (!current_rotation_wrapped.isEmpty() && owner == current_user_id &&
+            rotation.table_id != current_table_id)
+        rotateTableKey();
+
+    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
+        return;
+    QSqlRecord record = query->record();
+    int colCount = (current_format == RowStorage)?current_columns:
+                                                  record.count() - 3;
+    emit tableOpened(name, colCount, row_count);
+}
+
+bool DBManager::loadTableKey(int owner)
+{
+    QString key = "";
+    QString newKey = "";
+    QString error = "";
+    if (!tableKeys(current_table_id, owner, &key, &newKey, &error))
+    {
+        emit queryError(error);
+        return false;
+    }
+    if (!security->setAESkey(key))
+    {
+        emit queryError("Unable to load the encryption key");
+        return false;
+    }
+    current_rotation_key = newKey;
+    return true;
+}
+
+//the table key of the current user and, while the table key rotates, the
+//new key the rotation wrapped for the user when it started
+bool DBManager::tableKeys(int table_id, int owner, QString *key,
+                          QString *newKey, QString *error) const
+{
+    query->prepare("SELECT access_key, signed_key, "
+                   "rotation_key, rotation_signed_key "
+                   "FROM access_keys "
+                   "WHERE table_id=:tid "
+                   "AND user_id=:uid");
+    query->bindValue(":tid", table_id);
+    query->bindValue(":uid", current_user_id);
+    if (!query->exec())
+    {
+        *error = "Please check your database connection";
+        return false;
+    }
+    if (query->rowCount() == 0)
+    {
+        *error = "You don't have rights for reading this table";
+        return false;
+    }
+    QString accessKey = "";
+    QString signedKey = "";
+    QString rotationKey = "";
+    QString rotationSigned = "";
+    while (query->next())
+    {
+        accessKey = query->value(0).toString();
+        signedKey = query->value(1).toString();
+        rotationKey = query->value(2).toString();
+        rotationSigned = query->value(3).toString();
+    }
+
+    *key = verifiedKey(table_id, owner, accessKey, signedKey, error);
+    if (*key == "")
+        return false;
+    *newKey = "";
+    if (rotationKey.isEmpty())
+        return true;
+    *newKey = verifiedKey(table_id, owner, rotationKey, rotationSigned, error);
+    return *newKey != "";
+}
+
+//access keys are decrypted and verified once per session and signature
+QString DBManager::verifiedKey(int table_id, int owner,
+                               const QString &accessKey,
+                               const QString &signedKey,
+                               QString *error) const
+{
+    QString id = QString("%1|%2").arg(table_id).
+                 arg(Security::getHash(signedKey));
+    if (!force_key_verification && verified_keys.contains(id))
+        return verified_keys.value(id);
+
+    query->prepare("SELECT public_key "
+                   "FROM users "
+                   "WHERE user_id=:uid");
+    query->bindValue(":uid", owner);
+    if (!query->exec())
+    {
+        *error = "Please check your database connection";
+        return "";
+    }
+    QString ownerPubKey = "";
+    while (query->next())
+        ownerPubKey = query->value(0).toString();
+
+    QString aesKey = security->RSADecrypt(accessKey);
+    if (aesKey == "")
+    {
+        *error = "Unable to extract the file's key";
+        return "";
+    }
+    if (!Security::RSAVerifySignature(aesKey, signedKey, ownerPubKey))
+    {
+        *error = "Invalid access key - it's not given by the table's owner";
+        return "";
+    }
+    verified_keys.insert(id, aesKey);
+    return aesKey;
+}
+
+void DBManager::setForceKeyVerification(bool force)
+{
+    force_key_verification = force;
+}
+
+//OK, TESTED, WORKING
+int DBManager::columnCount()
+{
+    if (current_format == RowStorage)
+        return current_columns;
+    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
+        return 0;
+    QSqlRecord record = query->record();
+    return record.count()-3;
+}
+
+int DBManager::loadUsers()
+{
+    query->prepare("SELECT user_name "
+                   "FROM users "
+                   "WHERE user_id <> :id");
+    query->bindValue(":id", current_user_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return -1;
+    }
+    
+    QList<QString> users = QList<QString>();
+    while (query->next())
+        users.append(query->value(0).toString());
+    
+    emit usersLoaded(users);
+    return users.size();
+}
+
+//OK, TESTED, WORKING
+QHash<QString, QString> DBManager::getTables()
+{
+    QHash<QString, QString> tables = QHash<QString, QString>();
+    if (!query->exec("SELECT fi.file_name, fo.folder_name "
+                     "FROM files fi, folders fo "
+                     "WHERE fi.folder = fo.folder_id"))
+        return tables;
+    while (query->next())
+        tables.insert(query->value(0).toString(), query->value(1).toString());
+    return tables;
+}
+
+//OK, TESTED, WORKING
+QHash<QString, QString> DBManager::getFolders()
+{
+    QHash<QString, QString> folders = QHash<QString, QString>();
+    if (!query->exec("SELECT folder_name, folder_parent "
+                     "FROM folders WHERE folder_id>0 "
+                     "ORDER BY folder_id ASC"))
+        return folders;
+    while (query->next())
+        folders.insert(query->value(0).toString(), query->value(1).toString());
+    return folders;
+}
+
+DBManager::~DBManager()
+{
+    keygen->waitForFinished();
+    rekeyer->waitForFinished();
+    rotator->waitForFinished();
+    drivers.waitForFinished();
+    if (db.isOpen())
+        delete query;
+    db.close();
+    db.removeDatabase("mng_users");
+    delete security;
+    delete current_table;
+    //lets headless and load runs collect statistics without the dialog
+    QString statsFile = QString::fromLocal8Bit(qgetenv("SEM_QUERY_STATS"));
+    if (!statsFile.isEmpty())
+        stats->dump(statsFile);
+    delete stats;
+}
+
+void DBManager::decodeFinished()
+{
+    if (decoder->future().resultCount() == 0)
+        return;
+    RefreshPayload data = decoder->result();
+    //the watcher would keep the last decoded table alive until the next refresh
+    decoder->setFuture(QFuture<RefreshPayload>());
+    qint64 decodeUsecs = decode_clock.nsecsElapsed() / 1000;
+    stats->addPhase("getData", "decrypt", decodeUsecs);
+    if (spreadsheet == 0 || data.table_id != current_table_id)
+        return;
+    {
+        TraceSpan span("dataDecoded", "refresh");
+        PhaseTimer timer(stats, "getData", "emit");
+        emit dataDecoded(data);
+    }
+    last_refresh.usecs = refresh_clock.nsecsElapsed() / 1000;
+    last_refresh.rows = pulled_rows;
+    last_refresh.bytes = pulled_bytes;
+    last_refresh.cells = data.cells.size();
+    last_refresh.decodeUsecs = decodeUsecs;
+    Trace::flush();
+}
+
+const RefreshInfo &DBManager::lastRefresh() const
+{
+    return last_refresh;
+}
+
+const QueryStats *DBManager::queryStats() const
+{
+    return stats;
+}
+
+bool DBManager::dumpQueryStats(const QString &fileName) const
+{
+    return stats->dump(fileName);
+}
+
+void DBManager::clearQueryStats()
+{
+    stats->clear();
+}
+
+//verified access keys and a decoded refresh that was not yet applied
+void DBManager::memoryUsage(SheetMemory *usage) const
+{
+    QHashIterator<QString, QString> it(verified_keys);
+    while (it.hasNext())
+    {
+        it.next();
+        usage->keyCacheBytes += SheetMemory::stringBytes(it.key()) +
+                                SheetMemory::stringBytes(it.value());
+    }
+
+    if (decoder->isRunning() || decoder->future().resultCount() == 0)
+        return;
+    RefreshPayload data = decoder->future().result();
+    for (int i=0; i<data.cells.size(); i++)
+        usage->decodedBytes += sizeof(CellRecord) +
+                SheetMemory::stringBytes(data.cells.at(i).formula);
+    usage->decodedBytes += data.styles.size() * sizeof(CellStyle);
+}
+
+bool DBManager::upgradeStorage(int format, int profile)
+{
+    if (current_table_id == -1)
+        return false;
+    if (!checkTableKey())
+    {
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return false;
+    }
+    if (format == HexStorage)
+        profile = Security::CBCProfile;
+    if (format == current_format && profile == current_profile)
+    {
+        emit queryError("The table already uses this storage format");
+        return false;
+    }
+
+    //other sessions refuse to write while conversion_user is set, an
+    //interrupted conversion can be started again by the same user
+    query->prepare("UPDATE files "
+                   "SET conversion_user=:uid "
+                   "WHERE file_id=:fid AND conversion_user=0 "
+                   "AND rotation_key IS NULL");
+    query->bindValue(":uid", current_user_id);
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    query->prepare("SELECT conversion_user, rotation_key "
+                   "FROM files "
+                   "WHERE file_id=:fid");
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    bool claimed = false;
+    while (query->next())
+        claimed = query->value(0).toInt() == current_user_id &&
+                  query->value(1).toString().isEmpty();
+    if (!claimed)
+    {
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return false;
+    }
+
+    bool converted = convertTable(format, profile);
+    query->prepare("UPDATE files "
+                   "SET conversion_user=0 "
+                   "WHERE file_id=:fid");
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    return converted;
+}
+
+bool DBManager::convertTable(int format, int profile)
+{
+    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int columns = (current_format == RowStorage)?current_columns:
+                                                 query->record().count() - 3;
+    QString key = security->getAESkey();
+    QString tableName = QString("%1_conv").arg(*current_table);
+
+    TimedQuery writer(db, stats);
+    //left over by an interrupted conversion
+    if (db.tables().contains(tableName))
+        writer.exec(QString("DROP TABLE %1").arg(tableName));
+    QString q = QString("CREATE TABLE %1 (row_index INT NOT NULL, "
+                        "row_timestamp VARCHAR(25) NOT NULL, "
+                        "row_height INT NOT NULL, ").arg(tableName);
+    q.append(fieldsDefinition(format, columns));
+    q.append(QString("CONSTRAINT %1_pk PRIMARY KEY (row_index) )").arg(tableName));
+    if (!writer.exec(q))
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+
+    q = QString("INSERT INTO %1 VALUES (?, ?, ?").arg(tableName);
+    int fields = (format == RowStorage)?1:columns;
+    for (int i=0; i<fields; i++)
+        q.append(", ?");
+    q.append(")");
+
+    db.transaction();
+    writer.prepare(q);
+    QMap<int, QString> copied;
+    while (query->next())
+    {
+        int line = query->value(0).toInt();
+        copied.insert(line, query->value(1).toString());
+        writer.addBindValue(query->value(0));
+        writer.addBindValue(query->value(1));
+        writer.addBindValue(query->value(2));
+        QList<QByteArray> cells = rowCells(query, current_format,
+                                           current_profile, columns, key,
+                                           current_table_id);
+        if (!readable(cells))
+        {
+            db.rollback();
+            writer.exec(QString("DROP TABLE %1").arg(tableName));
+            emit queryError("Some rows could not be decrypted, "
+                            "the table was not converted");
+            return false;
+        }
+        if (format == RowStorage)
+        {
+            RowEnvelope envelope;
+            for (int i=0; i<columns; i++)
+                envelope.setCell(i, CellCodec::fromLegacy(cells.at(i)));
+            writer.addBindValue(Security::AESEncryptBytes(envelope.toBytes(),
+                                key, profile,
+                                Security::cellContext(current_table_id, line)));
+        }
+        else
+            for (int i=0; i<columns; i++)
+                writer.addBindValue(encryptCell(CellCodec::fromLegacy(cells.at(i)),
+                                                format, profile, key,
+                                                Security::cellContext(current_table_id,
+                                                                      line, i)));
+        if (!writer.exec())
+        {
+            db.rollback();
+            writer.exec(QString("DROP TABLE %1").arg(tableName));
+            emit queryError("Unable to convert the table data");
+            return false;
+        }
+    }
+    db.commit();
+
+    //a write that was already under way when the conversion started
+    if (!query->exec(QString("SELECT row_index, row_timestamp FROM %1").
+                     arg(*current_table)))
+    {
+        writer.exec(QString("DROP TABLE %1").arg(tableName));
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    QMap<int, QString> current;
+    while (query->next())
+        current.insert(query->value(0).toInt(), query->value(1).toString());
+    if (current != copied)
+    {
+        writer.exec(QString("DROP TABLE %1").arg(tableName));
+        emit queryError("The table was changed during the conversion, "
+                        "please try again");
+        return false;
+    }
+
+    if (!query->exec(QString("ALTER TABLE %1 RENAME TO %1_old").
+                     arg(*current_table)))
+    {
+        writer.exec(QString("DROP TABLE %1").arg(tableName));
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    if (!query->exec(QString("ALTER TABLE %1 RENAME TO %2").
+                     arg(tableName).arg(*current_table)))
+    {
+        query->exec(QString("ALTER TABLE %1_old RENAME TO %1").
+                    arg(*current_table));
+        writer.exec(QString("DROP TABLE %1").arg(tableName));
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    query->prepare("UPDATE files "
+                   "SET storage_format=:format, column_count=:columns, "
+                   "cipher_profile=:profile "
+                   "WHERE file_id=:fid");
+    query->bindValue(":format", format);
+    query->bindValue(":profile", profile);
+    query->bindValue(":columns", columns);
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    query->exec(QString("DROP TABLE %1_old").arg(*current_table));
+    current_format = format;
+    current_profile = profile;
+    current_columns = columns;
+    return true;
+}
+
+//a write passes lock to hold the key state until it commits, the rotation
+//moves rotation_row first in its transactions and so waits for the write
+bool DBManager::checkTableKey(bool lock)
+{
+    if (current_table_id == -1)
+        return true;
+
+    query->prepare(QString("SELECT owner, key_version, rotation_key, "
+                           "column_count, conversion_user, storage_format, "
+                           "cipher_profile, rotation_row "
+                           "FROM files "
+                           "WHERE file_id=:fid%1").
+                   arg(lock?shareLock():QString()));
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int owner = -1;
+    int version = current_key_version;
+    QString wrapped = current_rotation_wrapped;
+    int watermark = 0;
+    bool converting = false;
+    while (query->next())
+    {
+        owner = query->value(0).toInt();
+        version = query->value(1).toInt();
+        wrapped = query->value(2).toString();
+        converting = query->value(4).toInt() != 0 &&
+                     query->value(4).toInt() != current_user_id;
+        //another session converted the table or changed its columns
+        current_format = query->value(5).toInt();
+        current_profile = query->value(6).toInt();
+        if (current_format == RowStorage)
+            current_columns = query->value(3).toInt();
+        watermark = query->value(7).toInt();
+    }
+    if (converting)
+        return false;
+    //the owner rotated the key from another session or a rotation started
+    if (version != current_key_version || wrapped != current_rotation_wrapped ||
+            (!wrapped.isEmpty() && current_rotation_key.isEmpty()))
+    {
+        if (!loadTableKey(owner))
+            return false;
+        current_key_version = version;
+        current_rotation_wrapped = wrapped;
+    }
+    current_rotation_row = watermark;
+    //users granted before the upgrade only get the new key when it is published
+    return wrapped.isEmpty() || !current_rotation_key.isEmpty();
+}
+
+//locks the files row of the table until the transaction ends, SQLite
+//transactions already exclude each other's writes
+QString DBManager::shareLock() const
+{
+    if (db.driverName() == "QPSQL")
+        return " FOR SHARE";
+    if (db.driverName() == "QMYSQL")
+        return " LOCK IN SHARE MODE";
+    if (db.driverName() == "QOCI")
+        return " FOR UPDATE";
+    return "";
+}
+
+//rows below rotation_row are already encrypted with the new key
+QString DBManager::rowKey(int row) const
+{
+    if (row < current_rotation_row)
+        return current_rotation_key;
+    return security->getAESkey();
+}
+
+//wraps the new key for every user that can read the table and does not
+//have it yet, signed like the access key the owner gives out
+bool DBManager::wrapRotationKey(int table_id, const QString &newKey)
+{
+    TimedQuery writer(db, stats);
+    writer.prepare("SELECT a.user_id, u.public_key "
+                   "FROM access_keys a, users u "
+                   "WHERE a.user_id=u.user_id "
+                   "AND a.table_id=:tid "
+                   "AND a.rotation_key IS NULL");
+    writer.bindValue(":tid", table_id);
+    if (!writer.exec())
+        return false;
+    QHash<int,QString> grantees;
+    while (writer.next())
+        grantees.insert(writer.value(0).toInt(), writer.value(1).toString());
+    if (grantees.isEmpty())
+        return true;
+
+    QString signature = security->RSASign(newKey);
+    if (signature == "")
+        return false;
+    writer.prepare("UPDATE access_keys "
+                   "SET rotation_key=:key, rotation_signed_key=:sign "
+                   "WHERE table_id=:tid "
+                   "AND user_id=:uid");
+    QHashIterator<int,QString> it(grantees);
+    while (it.hasNext())
+    {
+        it.next();
+        QString accessKey = Security::RSAEncrypt(newKey, it.value());
+        if (accessKey == "")
+            return false;
+        writer.bindValue(":key", accessKey);
+        writer.bindValue(":sign", signature);
+        writer.bindValue(":tid", table_id);
+        writer.bindValue(":uid", it.key());
+        if (!writer.exec())
+            return false;
+    }
+    return true;
+}
+
+bool DBManager::rotateTableKey()
+{
+    if (current_table_id == -1)
+        return false;
+    if (rotation.table_id != -1)
+    {
+        emit queryError("A table key is already being rotated");
+        return false;
+    }
+    if (rekeyer->isRunning())
+    {
+        emit queryError("Your keys are being changed, try again later");
+        return false;
+    }
+
+    query->prepare("SELECT owner, rotation_key, rotation_row, conversion_user "
+                   "FROM files "
+                   "WHERE file_id=:fid");
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int owner = -1;
+    QString wrappedKey = "";
+    int next_row = 0;
+    bool converting = false;
+    while (query->next())
+    {
+        owner = query->value(0).toInt();
+        wrappedKey = query->value(1).toString();
+        next_row = query->value(2).toInt();
+        converting = query->value(3).toInt() != 0;
+    }
+    if (owner != current_user_id)
+    {
+        emit queryError("Only the table's owner can rotate its key");
+        return false;
+    }
+    if (converting)
+    {
+        emit queryError("The table is being converted, try again later");
+        return false;
+    }
+
+    //the new key is kept wrapped in files until every row uses it, and in
+    //access_keys for every reader so they choose the key per row meanwhile
+    QString newKey = "";
+    if (wrappedKey.isEmpty())
+    {
+        newKey = Security::generateAESKey();
+        wrappedKey = security->RSAEncrypt(newKey);
+        if (newKey == "" || wrappedKey == "")
+        {
+            emit queryError("Unable to generate private encryption key");
+            return false;
+        }
+        next_row = 0;
+        db.transaction();
+        query->prepare("UPDATE files "
+                       "SET rotation_key=:key, rotation_row=0 "
+                       "WHERE file_id=:fid");
+        query->bindValue(":key", wrappedKey);
+        query->bindValue(":fid", current_table_id);
+        if (!query->exec())
+        {
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
+        }
+        if (!wrapRotationKey(current_table_id, newKey) || !db.commit())
+        {
+            db.rollback();
+            emit queryError("Unable to encrypt the access key");
+            return false;
+        }
+    }
+    else
+    {
+        newKey = security->RSADecrypt(wrappedKey);
+        if (newKey == "")
+        {
+            emit queryError("Unable to extract the file's key");
+            return false;
+        }
+        //users granted while no session of the owner ran the rotation
+        if (!wrapRotationKey(current_table_id, newKey))
+        {
+            emit queryError("Unable to encrypt the access key");
+            return false;
+        }
+    }
+    current_rotation_key = newKey;
+    current_rotation_wrapped = wrappedKey;
+    current_rotation_row = next_row;
+
+    if (!query->exec(QString("SELECT MAX(row_index) FROM %1").
+                     arg(*current_table)))
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int end_row = 0;
+    while (query->next())
+        if (!query->value(0).isNull())
+            end_row = query->value(0).toInt() + 1;
+
+    startRotation(newKey, next_row, end_row, false);
+    emit keyRotationProgress(next_row, end_row, 0);
+    return true;
+}
+
+void DBManager::startRotation(const QString &newKey, int next_row,
+                              int end_row, bool aborting)
+{
+    QSqlRecord record = db.record(*current_table);
+    rotation.fields.clear();
+    for (int i=3; i<record.count(); i++)
+        rotation.fields.append(record.fieldName(i));
+    rotation.table_id = current_table_id;
+    rotation.table = *current_table;
+    rotation.format = current_format;
+    rotation.profile = current_profile;
+    rotation.old_key = security->getAESkey();
+    rotation.new_key = newKey;
+    rotation.next_row = next_row;
+    rotation.end_row = end_row;
+    rotation.retries = 0;
+    rotation.bytes = 0;
+    rotation.rows = 0;
+    rotation.aborting = aborting;
+    rotation.abort_requested = false;
+    rotation.clock.start();
+    QTimer::singleShot(0, this, SLOT(rotateNextChunk()));
+}
+
+//rows below rotation_row use the new key, so an abort re-encrypts them
+//with the old key from the top down and lowers rotation_row as it goes
+bool DBManager::abortKeyRotation()
+{
+    if (current_table_id == -1)
+        return false;
+    //a running rotation turns around after its current chunk
+    if (rotation.table_id == current_table_id)
+    {
+        rotation.abort_requested = true;
+        return true;
+    }
+    if (rotation.table_id != -1)
+    {
+        emit queryError("A table key is already being rotated");
+        return false;
+    }
+
+    query->prepare("SELECT owner, rotation_key, rotation_row "
+                   "FROM files "
+                   "WHERE file_id=:fid");
+    query->bindValue(":fid", current_table_id);
+    if (!query->exec())
+    {
+        emit queryError("Please check your database connection");
+        return false;
+    }
+    int owner = -1;
+    QString wrappedKey = "";
+    int next_row = 0;
+    while (query->next())
+    {
+        owner = query->value(0).toInt();
+        wrappedKey = query->value(1).toString();
+        next_row = query->value(2).toInt();
+    }
+    if (owner != current_user_id)
+    {
+        emit queryError("Only the table's owner can abort a key rotation");
+        return false;
+    }
+    if (wrappedKey.isEmpty())
+    {
+        emit queryError("The table key is not being rotated");
+        return false;
+    }
+    QString newKey = security->RSADecrypt(wrappedKey);
+    if (newKey == "")
+    {
+        emit queryError("Unable to extract the file's key");
+        return false;
+    }
+    current_rotation_key = newKey;
+    current_rotation_wrapped = wrappedKey;
+    current_rotation_row = next_row;
+
+    startRotation(newKey, next_row, next_row, true);
+    return true;
+}
+
+void DBManager::rotateNextChunk()
+{
+    if (rotation.table_id == -1)
+        return;
+    if (rotation.abort_requested && !rotation.aborting)
+    {
+        rotation.aborting = true;
+        rotation.end_row = rotation.next_row;
+        rotation.retries = 0;
+    }
+    if (rotation.aborting && rotation.next_row <= 0)
+    {
+        finishAbort();
+        return;
+    }
+    if (!rotation.aborting && rotation.next_row >= rotation.end_row)
+    {
+        finishRotation();
+        return;
+    }
+
+    TimedQuery reader(db, stats);
+    reader.prepare(QString("SELECT * FROM %1 "
+                           "WHERE row_index >= :first "
+                           "AND row_index < :last").arg(rotation.table));
+    reader.bindValue(":first", chunkStart());
+    reader.bindValue(":last", chunkStart() + rowsPerRotationChunk);
+    if (!reader.exec())
+    {
+        stopRotation("Please check your database connection");
+        return;
+    }
+
+    //rows without data are written back as well, their timestamp shows
+    //whether a session filled them while the chunk was re-encrypted
+    QList<RotatedRow> rows;
+    int fields = reader.record().count();
+    while (reader.next())
+    {
+        RotatedRow row;
+        row.row = reader.value(0).toInt();
+        row.timestamp = reader.value(1).toString();
+        row.ok = false;
+        for (int i=3; i<fields; i++)
+            row.values.append(reader.value(i));
+        rows.append(row);
+    }
+    rotator->setFuture(QtConcurrent::mapped(rows,
+                       ReencryptRow(rotation.table_id, rotation.format,
+                                    rotation.profile,
+                                    rotation.aborting?rotation.new_key:
+                                                      rotation.old_key,
+                                    rotation.aborting?rotation.old_key:
+                                                      rotation.new_key)));
+}
+
+//first row of the next chunk, an abort walks down from rotation_row
+int DBManager::chunkStart() const
+{
+    if (rotation.aborting)
+        return qMax(0, rotation.next_row - rowsPerRotationChunk);
+    return rotation.next_row;
+}
+
+void DBManager::rotationChunkDone()
+{
+    if (rotation.table_id == -1)
+        return;
+    QList<RotatedRow> rows = rotator->future().results();
+    //rows that do not decrypt would stop the rotation forever, so it is
+    //turned around, an abort leaves such cells as they are
+    for (int i=0; i<rows.size() && !rotation.aborting; i++)
+        if (!rows.at(i).ok)
+        {
+            emit queryError(QString("Row %1 does not decrypt with the table's "
+                                    "key, the key rotation is aborted").
+                            arg(rows.at(i).row+1));
+            rotation.abort_requested = true;
+            QTimer::singleShot(0, this, SLOT(rotateNextChunk()));
+            return;
+        }
+
+    QElapsedTimer write;
+    write.start();
+    bool conflict = false;
+    if (!writeRotatedRows(rows, &conflict))
+    {
+        if (!conflict || ++rotation.retries > rotationRetries)
+        {
+            stopRotation("Unable to rotate the table key");
+            return;
+        }
+        //a row changed while it was re-encrypted, so redo the chunk
+        QTimer::singleShot(rotationPause, this, SLOT(rotateNextChunk()));
+        return;
+    }
+
+    rotation.retries = 0;
+    rotation.next_row = rotation.aborting?chunkStart():
+                                          rotation.next_row + rowsPerRotationChunk;
+    rotation.rows += rows.size();
+    for (int r=0; r<rows.size(); r++)
+        for (int i=0; i<rows.at(r).values.size(); i++)
+            rotation.bytes += rows.at(r).values.at(i).toByteArray().size();
+    qint64 elapsed = rotation.clock.elapsed();
+    int rate = (elapsed > 0)?(int)(rotation.bytes * 1000 / 1024 / elapsed):0;
+    int done = rotation.aborting?rotation.end_row - rotation.next_row:
+                                 qMin(rotation.next_row, rotation.end_row);
+    emit keyRotationProgress(done, rotation.end_row, rate);
+
+    //leave the database idle at least as long as the chunk kept it busy
+    QTimer::singleShot(qMax(rotationPause, (int)write.elapsed()),
+                       this, SLOT(rotateNextChunk()));
+}
+
+bool DBManager::writeRotatedRows(const QList<RotatedRow> &rows,
+                                 bool *conflict)
+{
+    *conflict = false;
+    QString q = QString("UPDATE %1 SET ").arg(rotation.table);
+    for (int i=0; i<rotation.fields.size(); i++)
+    {
+        if (i > 0)
+            q.append(", ");
+        q.append(QString("%1 = ?").arg(rotation.fields.at(i)));
+    }
+    q.append(" WHERE row_index = ? AND row_timestamp = ?");
+
+    //the resume point moves first, so writers holding the key state have
+    //committed and their rows show up in the checks below
+    TimedQuery writer(db, stats);
+    db.transaction();
+    writer.prepare("UPDATE files "
+                   "SET rotation_row=:row "
+                   "WHERE file_id=:fid");
+    writer.bindValue(":row", rotation.aborting?chunkStart():
+                                               rotation.next_row + rowsPerRotationChunk);
+    writer.bindValue(":fid", rotation.table_id);
+    if (!writer.exec())
+    {
+        db.rollback();
+        return false;
+    }
+
+    //a row inserted into the chunk was written with the key it had before
+    writer.prepare(QString("SELECT COUNT(*) FROM %1 "
+                           "WHERE row_index >= :first "
+                           "AND row_index < :last").arg(rotation.table));
+    writer.bindValue(":first", chunkStart());
+    writer.bindValue(":last", chunkStart() + rowsPerRotationChunk);
+    if (!writer.exec())
+    {
+        db.rollback();
+        return false;
+    }
+    int count = rows.size();
+    while (writer.next())
+        count = writer.value(0).toInt();
+    if (count != rows.size())
+    {
+        db.rollback();
+        *conflict = true;
+        return false;
+    }
+
+    writer.prepare(q);
+    for (int r=0; r<rows.size(); r++)
+    {
+        const RotatedRow &row = rows.at(r);
+        for (int i=0; i<row.values.size(); i++)
+            writer.addBindValue(row.values.at(i));
+        writer.addBindValue(row.row);
+        writer.addBindValue(row.timestamp);
+        if (!writer.exec())
+        {
+            db.rollback();
+            return false;
+        }
+        if (writer.numRowsAffected() != 1)
+        {
+            db.rollback();
+            *conflict = true;
+            return false;
+        }
+    }
+
+    if (!db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+void DBManager::finishRotation()
+{
+    //grants made while the rotation ran get the new key as well
+    if (!wrapRotationKey(rotation.table_id, rotation.new_key))
+    {
+        stopRotation("Unable to encrypt the access key");
+        return;
+    }
+
+    //publishing locks the key state first, so rows written meanwhile are seen
+    TimedQuery writer(db, stats);
+    db.transaction();
+    writer.prepare("UPDATE files "
+                   "SET rotation_key=NULL, rotation_row=0, "
+                   "key_version=key_version+1 "
+                   "WHERE file_id=:fid");
+    writer.bindValue(":fid", rotation.table_id);
+    if (!writer.exec() ||
+        !writer.exec(QString("SELECT MAX(row_index) FROM %1").
+                     arg(rotation.table)))
+    {
+        db.rollback();
+        stopRotation("Please check your database connection");
         return;
     }
-    query->bindValue(":signature", accKeySigned);
-    security->setAESkey(aesKey);
-    
-    if (!query->exec())
+    int end_row = rotation.end_row;
+    while (writer.next())
+        if (!writer.value(0).isNull())
+            end_row = qMax(end_row, writer.value(0).toInt() + 1);
+    //rows added meanwhile are rotated before the key is published
+    if (end_row > rotation.end_row)
     {
-        emit queryError("Please check your database connection");
+        db.rollback();
+        rotation.end_row = end_row;
+        QTimer::singleShot(rotationPause, this, SLOT(rotateNextChunk()));
         return;
     }
 
-    for (int i=0; i<columns; i++)
-        if (!query->exec(QString("INSERT INTO rights "
-                                 "VALUES (%1, %2, %3)").arg(current_index).
-                                            arg(current_user_id).arg(i)))
-        {
-            deleteTable(current_table_id);
-            emit queryError("Please check your database connection");
-            return;
-        }
-    
-    query->prepare("UPDATE current_ids "
-                   "SET val=val+1 "
-                   "WHERE type='file'");
-    if (!query->exec())
+    writer.prepare("UPDATE access_keys "
+                   "SET access_key=rotation_key, "
+                   "signed_key=rotation_signed_key, "
+                   "rotation_key=NULL, rotation_signed_key=NULL "
+                   "WHERE table_id=:tid "
+                   "AND rotation_key IS NOT NULL");
+    writer.bindValue(":tid", rotation.table_id);
+    if (!writer.exec() || !db.commit())
     {
-        query->exec(QString("DROP TABLE %1").arg(tableName));
-        query->prepare("DELETE FROM files WHERE file_id=:fileID");
-        query->bindValue(":fileID", current_index);
-        emit queryError("Please check your database connection");
+        db.rollback();
+        stopRotation("Please check your database connection");
         return;
     }
 
-    emit tableCreated(tableName, columns, rows);
+    if (rotation.table_id == current_table_id)
+    {
+        security->setAESkey(rotation.new_key);
+        current_key_version++;
+        current_rotation_key = "";
+        current_rotation_wrapped = "";
+        current_rotation_row = 0;
+    }
+    qint64 elapsed = rotation.clock.elapsed();
+    int rate = (elapsed > 0)?(int)(rotation.bytes * 1000 / 1024 / elapsed):0;
+    emit keyRotationProgress(rotation.end_row, rotation.end_row, rate);
+    emit message(QString("Table key rotated: %1 rows in %2 ms").
+                 arg(rotation.rows).arg(elapsed));
+    rotation.table_id = -1;
 }
 
-//OK, TESTED, WORKING
-void DBManager::openTable(const QString &name, int columns,
-              int rows, const QString &folder)
-{   
-    query->prepare("SELECT table_name, row_count, file_id, owner "
-                   "FROM files "
-                   "WHERE file_name = :name");
-    query->bindValue(":name", name);
-    if (!query->exec())
+void DBManager::finishAbort()
+{
+    TimedQuery writer(db, stats);
+    db.transaction();
+    writer.prepare("UPDATE files "
+                   "SET rotation_key=NULL, rotation_row=0 "
+                   "WHERE file_id=:fid");
+    writer.bindValue(":fid", rotation.table_id);
+    if (!writer.exec())
     {
-        emit queryError("Please check your database connection");
+        db.rollback();
+        stopRotation("Please check your database connection");
         return;
     }
-    int row_count = 0;
-    int owner = -1;
-    while (query->next())
+    writer.prepare("UPDATE access_keys "
+                   "SET rotation_key=NULL, rotation_signed_key=NULL "
+                   "WHERE table_id=:tid");
+    writer.bindValue(":tid", rotation.table_id);
+    if (!writer.exec() || !db.commit())
     {
-        current_table = new QString(query->value(0).toString());
-        current_table_id = query->value(2).toInt();
-        row_count = query->value(1).toInt();
-        owner = query->value(3).toInt();
+        db.rollback();
+        stopRotation("Please check your database connection");
+        return;
     }
+    if (rotation.table_id == current_table_id)
+    {
+        current_rotation_key = "";
+        current_rotation_wrapped = "";
+        current_rotation_row = 0;
+    }
+    emit keyRotationProgress(rotation.end_row, rotation.end_row, 0);
+    emit message(QString("Table key rotation aborted: %1 rows restored").
+                 arg(rotation.rows));
+    rotation.table_id = -1;
+}
 
-    QString ownerPubKey = "";
-    query->prepare("SELECT public_key "
-                   "FROM users "
-                   "WHERE user_id=:uid");
-    query->bindValue(":uid", owner);
-    if (!query->exec())
+void DBManager::stopRotation(const QString &error)
+{
+    //the rotation state stays in files, reopening the table resumes it
+    bool current = (rotation.table_id == current_table_id);
+    rotation.table_id = -1;
+    emit queryError(error);
+    if (current)
+        emit closeCurrentTable();
+}
+
+bool DBManager::removeEnvelopeCells(const QList<int> &column_ids)
+{
+    if (!query->exec(QString("SELECT row_index, row_data FROM %1").
+                     arg(*current_table)))
     {
         emit queryError("Please check your database connection");
-        return;
+        return false;
     }
+    QString key = security->getAESkey();
+
+    TimedQuery writer(db, stats);
+    db.transaction();
+    writer.prepare(QString("UPDATE %1 "
+                           "SET row_data = :data "
+                           "WHERE row_index = :row").arg(*current_table));
     while (query->next())
-        ownerPubKey = query->value(0).toString();
-    
-    query->prepare("SELECT access_key, signed_key "
-                   "FROM access_keys "
-                   "WHERE table_id=:tid "
-                   "AND user_id=:uid");
-    query->bindValue(":tid", current_table_id);
-    query->bindValue(":uid", current_user_id);
-    if (!query->exec())
+    {
+        bool ok;
+        QByteArray context = Security::cellContext(current_table_id,
+                                                   query->value(0).toInt());
+        RowEnvelope envelope = decryptEnvelope(query->value(1), current_profile,
+                                               key, context, &ok);
+        if (!ok)
+        {
+            db.rollback();
+            emit queryError("Some rows could not be decrypted, "
+                            "the columns were not removed");
+            return false;
+        }
+        for (int i=column_ids.length()-1; i>=0; i--)
+            envelope.removeCell(column_ids.at(i));
+        writer.bindValue(":data", Security::AESEncryptBytes(envelope.toBytes(), key,
+                                                            current_profile,
+                                                            context));
+        writer.bindValue(":row", query->value(0));
+        if (!writer.exec())
+        {
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
+        }
+    }
+    db.commit();
+    return true;
+}
+
+//ctr-hmac cells authenticate their column, so the cells that moved left
+//when columns were removed are encrypted again for their new column
+bool DBManager::rebindShiftedColumns(const QList<int> &column_ids)
+{
+    if (current_profile != Security::CTRProfile)
+        return true;
+    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
     {
         emit queryError("Please check your database connection");
-        return;
+        return false;
     }
-    if (query->size() == 0)
+    int fields = query->record().count() - 3;
+    QList<int> sources;
+    for (int c=0, old=0; c<fields; c++, old++)
     {
-        emit queryError("You don't have rights for reading this table");
-        return;
+        while (column_ids.contains(old))
+            old++;
+        sources.append(old);
     }
+    int first = 0;
+    while (first < fields && sources.at(first) == first)
+        first++;
+    if (first == fields)
+        return true;
+
+    QString q = QString("UPDATE %1 SET ").arg(*current_table);
+    for (int c=first; c<fields; c++)
+        q.append(QString("%1field%2 = ?").arg((c > first)?", ":"").arg(c));
+    q.append(" WHERE row_index = ?");
+
+    QString key = security->getAESkey();
+    TimedQuery writer(db, stats);
+    db.transaction();
+    writer.prepare(q);
     while (query->next())
     {
-        QString aesKey = security->RSADecrypt(query->value(0).toString());
-        if (aesKey == "")
-        {
-            emit queryError("Unable to extract the file's key");
-            return;
-        }
-        if (Security::RSAVerifySignature(aesKey, query->value(1).toString(),
-                                         ownerPubKey))
+        int line = query->value(0).toInt();
+        for (int c=first; c<fields; c++)
         {
-            if (!security->setAESkey(aesKey))
-            {
-                emit queryError("Unable to load the encryption key");
-                return;
-            }
+            QVariant value = query->value(c+3);
+            QByteArray plain = Security::AESDecryptBytes(value.toByteArray(), key,
+                                   current_profile,
+                                   Security::cellContext(current_table_id, line,
+                                                         sources.at(c)));
+            //empty cells and cells that were already unreadable stay as they are
+            if (value.toByteArray().isEmpty() || plain.isNull())
+                writer.addBindValue(value);
+            else
+                writer.addBindValue(Security::AESEncryptBytes(plain, key,
+                                        current_profile,
+                                        Security::cellContext(current_table_id,
+                                                              line, c)));
         }
-        else
+        writer.addBindValue(line);
+        if (!writer.exec())
         {
-            emit queryError("Invalid access key - it's not given by the table's owner");
-            return;
+            db.rollback();
+            emit queryError("Please check your database connection");
+            return false;
         }
     }
-
-    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
-        return;
-    QSqlRecord record = query->record();
-    int colCount = record.count() - 3;
-    emit tableOpened(name, colCount, row_count);
-}
-
-//OK, TESTED, WORKING
-int DBManager::columnCount()
-{
-    if (!query->exec(QString("SELECT * FROM %1").arg(*current_table)))
-        return 0;
-    QSqlRecord record = query->record();
-    return record.count()-3;
+    db.commit();
+    return true;
 }
 
-int DBManager::loadUsers()
+bool DBManager::setFileColumnCount(int columns)
 {
-    query->prepare("SELECT user_name "
-                   "FROM users "
-                   "WHERE user_id <> :id");
-    query->bindValue(":id", current_user_id);
+    query->prepare("UPDATE files "
+                   "SET column_count=:columns "
+                   "WHERE file_id=:fid");
+    query->bindValue(":columns", columns);
+    query->bindValue(":fid", current_table_id);
     if (!query->exec())
     {
         emit queryError("Please check your database connection");
-        return -1;
+        return false;
     }
-    
-    QList<QString> users = QList<QString>();
-    while (query->next())
-        users.append(query->value(0).toString());
-    
-    emit usersLoaded(users);
-    return users.size();
+    current_columns = columns;
+    return true;
 }
 
-//OK, TESTED, WORKING
-QHash<QString, QString> DBManager::getTables()
+int DBManager::cipherProfile(const QString &name)
 {
-    QHash<QString, QString> tables = QHash<QString, QString>();
-    if (!query->exec("SELECT fi.file_name, fo.folder_name "
-                     "FROM files fi, folders fo "
-                     "WHERE fi.folder = fo.folder_id"))
-        return tables;
-    while (query->next())
-        tables.insert(query->value(0).toString(), query->value(1).toString());
-    return tables;
+    if (name == "cbc")
+        return Security::CBCProfile;
+    return Security::CTRProfile;
 }
 
-//OK, TESTED, WORKING
-QHash<QString, QString> DBManager::getFolders()
+int DBManager::storageFormat(const QString &name)
 {
-    QHash<QString, QString> folders = QHash<QString, QString>();
-    if (!query->exec("SELECT folder_name, folder_parent "
-                     "FROM folders WHERE folder_id>0 "
-                     "ORDER BY folder_id ASC"))
-        return folders;
-    while (query->next())
-        folders.insert(query->value(0).toString(), query->value(1).toString());
-    return folders;
+    if (name == "hex")
+        return HexStorage;
+    if (name == "row")
+        return RowStorage;
+    return BinaryStorage;
 }
 
-DBManager::~DBManager()
+void DBManager::upgradeSchema()
 {
-    if (db.isOpen())
-        delete query;
-    db.close();
-    db.removeDatabase("mng_users");
-    delete security;
-    delete current_table;
+    QSqlRecord files = db.record("files");
+    if (!files.contains("storage_format") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN storage_format INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("column_count") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN column_count INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("cipher_profile") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN cipher_profile INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("key_version") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN key_version INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("rotation_key") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN rotation_key VARCHAR(256)"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("rotation_row") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN rotation_row INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!files.contains("conversion_user") &&
+        !query->exec("ALTER TABLE files "
+                     "ADD COLUMN conversion_user INT DEFAULT 0 NOT NULL"))
+        emit queryError("Unable to upgrade the database schema");
+    QSqlRecord accessKeys = db.record("access_keys");
+    if (!accessKeys.contains("rotation_key") &&
+        !query->exec("ALTER TABLE access_keys "
+                     "ADD COLUMN rotation_key VARCHAR(256)"))
+        emit queryError("Unable to upgrade the database schema");
+    if (!accessKeys.contains("rotation_signed_key") &&
+        !query->exec("ALTER TABLE access_keys "
+                     "ADD COLUMN rotation_signed_key VARCHAR(256)"))
+        emit queryError("Unable to upgrade the database schema");
+}
+
+QString DBManager::fieldsDefinition(int format, int columns) const
+{
+    if (format == RowStorage)
+        return QString("row_data %1, ").arg(fieldType(format));
+
+    QString result;
+    for (int i=0; i<columns; i++)
+        result.append(QString("field%1 %2, ").arg(i).arg(fieldType(format)));
+    return result;
+}
+
+QString DBManager::fieldType(int format) const
+{
+    if (format == HexStorage)
+        return "VARCHAR(2048)";
+    if (db.driverName() == "QPSQL")
+        return "BYTEA";
+    if (db.driverName() == "QMYSQL")
+        return "MEDIUMBLOB";
+    return "BLOB";
 }
 
 void DBManager::disconnectDB()
 {
     db.close();
+    verified_keys.clear();
+    Security::clearKeyCache();
 }
 
 void DBManager::deleteTable(int id)
@@ -841,7 +2845,7 @@ void DBManager::login(const QString& uname, const QString& pass)
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         createUser(uname, pass);
         return;
@@ -849,10 +2853,29 @@ void DBManager::login(const QString& uname, const QString& pass)
 
     cfg->setCurrentUser(uname);
     QString passphrase = Security::getHash(uname+pass);
+    verified_keys.clear();
+    bool resumeKeyChange = false;
     while (query->next())
     {
-        security->setRSAkeys(query->value(3).toString(),
-                             cfg->getKey(), passphrase);
+        QString publicKey = query->value(3).toString();
+        if (!cfg->getPendingPublicKey().isEmpty())
+        {
+            //a key change was interrupted; keep the committed side
+            if (cfg->getPendingPublicKey() == publicKey)
+            {
+                cfg->setKey(cfg->getPendingKey());
+                cfg->setPendingKey("", "");
+            }
+            else
+                resumeKeyChange = true;
+        }
+        QString source = Security::keySource(publicKey, cfg->getKey());
+        if (cfg->getPreparedKeySource() != source ||
+                !security->setPreparedKey(cfg->getPreparedKey(), passphrase))
+        {
+            security->setRSAkeys(publicKey, cfg->getKey(), passphrase);
+            cfg->setPreparedKey(security->preparedKey(passphrase), source);
+        }
         current_user_id = query->value(0).toInt();
     }
 
@@ -885,6 +2908,9 @@ void DBManager::login(const QString& uname, const QString& pass)
     }
     
     emit loggedIn(current_user_id);
+    if (resumeKeyChange)
+        changeKey(cfg->getKey(), cfg->getPendingPublicKey(),
+                  cfg->getPendingKey(), passphrase);
 }
 
 //OK, TESTED, WORKING
@@ -900,12 +2926,39 @@ void DBManager::createUser(const QString &uname, const QString &pass)
         return;
     }
    
-    if (query->size() > 0)
+    if (query->rowCount() > 0)
     {
         emit queryError("User already exists");
         return;
     }
-    
+
+    if (keygen->isRunning())
+    {
+        emit queryError("A user is already being created");
+        return;
+    }
+
+    pending_user = uname;
+    pending_pass = pass;
+    emit userCreationProgress("Generating key pair", 0, 3);
+    keygen->setFuture(QtConcurrent::run(generateUserKeys,
+                                        Security::getHash(uname+pass)));
+}
+
+void DBManager::keyPairGenerated()
+{
+    QStringList keys = keygen->result();
+    QString uname = pending_user;
+    QString pass = pending_pass;
+    pending_user.clear();
+    pending_pass.clear();
+    if (keys.length() != 3 || keys.at(0).isEmpty())
+    {
+        emit queryError("Could not generate the user keys");
+        return;
+    }
+    emit userCreationProgress("Registering user", 1, 3);
+
     if (!query->exec("SELECT val FROM current_ids WHERE type='user'"))
     {
         emit queryError("Please check your database connection");
@@ -916,17 +2969,17 @@ void DBManager::createUser(const QString &uname, const QString &pass)
     while (query->next())
         uid = query->value(0).toInt();
 
-    QString passphr = Security::getHash(uname+pass);
-    QPair<QString, QString> keys = Security::generateKeyPair(passphr);
     cfg->setCurrentUser(uname);
-    cfg->setKey(keys.second);
+    cfg->setKey(keys.at(1));
+    cfg->setPreparedKey(keys.at(2), Security::keySource(keys.at(0),
+                                                        keys.at(1)));
 
     query->prepare("INSERT INTO users "
                    "VALUES (:uid, :usr, :pass, :pubkey)");
     query->bindValue(":uid", uid);
     query->bindValue(":usr", uname);
     query->bindValue(":pass", Security::getHash(pass));
-    query->bindValue(":pubkey", keys.first);
+    query->bindValue(":pubkey", keys.at(0));
     if (!query->exec())
     {
         emit queryError("Please check your database connection");
@@ -940,18 +2993,36 @@ void DBManager::createUser(const QString &uname, const QString &pass)
         emit queryError("Please check your database connection");
         return;
     }
+    emit userCreationProgress("Signing in", 2, 3);
     login(uname, pass);
+    emit userCreationProgress("User created", 3, 3);
+    emit userCreated();
 }
 
 //OK, TESTED, WORKING
 void DBManager::addColumns(int columns)
 {
+    if (!checkTableKey())
+    {
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return;
+    }
+    //the rotation re-encrypts the columns it found when it started
+    if (!current_rotation_wrapped.isEmpty())
+    {
+        emit queryError("The table key is being rotated, try again later");
+        return;
+    }
     int fieldCount = columnCount();
+    if (!setFileColumnCount(fieldCount + columns))
+        return;
     for (int i=0; i<columns; i++)
     {
-        QString q = QString("ALTER TABLE %1 ADD COLUMN field%2 VARCHAR(2048)").
-                    arg(*current_table).arg(fieldCount+i);
-        if (!query->exec(q))
+        QString q = QString("ALTER TABLE %1 ADD COLUMN field%2 %3").
+                    arg(*current_table).arg(fieldCount+i).
+                    arg(fieldType(current_format));
+        if (current_format != RowStorage && !query->exec(q))
         {
             emit queryError("Please check your database connection");
             return;
@@ -971,12 +3042,24 @@ void DBManager::addColumns(int columns)
 //OK, TESTED, WORKING
 void DBManager::removeColumns(const QList <int> column_ids)
 {
+    if (!checkTableKey())
+    {
+        emit queryError("The table is being converted or its key rotated, "
+                        "try again later");
+        return;
+    }
+    //the rotation re-encrypts the columns it found when it started
+    if (!current_rotation_wrapped.isEmpty())
+    {
+        emit queryError("The table key is being rotated, try again later");
+        return;
+    }
     QString q;
     for (int i=column_ids.length()-1; i>=0; i--)
     {
         q = QString("ALTER TABLE %1 DROP COLUMN field%2").
                     arg(*current_table).arg(column_ids.at(i));
-        if (!query->exec(q))
+        if (current_format != RowStorage && !query->exec(q))
         {
             emit queryError("Please check your database connection1");
             return;
@@ -1033,6 +3116,14 @@ void DBManager::removeColumns(const QList <int> column_ids)
         }
     }
 
+    if (current_format == RowStorage)
+    {
+        if (removeEnvelopeCells(column_ids) &&
+            setFileColumnCount(current_columns - column_ids.length()))
+            emit columnsRemoved(column_ids);
+        return;
+    }
+
     q = QString("ALTER TABLE %1 RENAME TO %1_aux").arg(*current_table);
     if (!query->exec(q))
     {
@@ -1044,8 +3135,7 @@ void DBManager::removeColumns(const QList <int> column_ids)
     q = QString("CREATE TABLE %1 (row_index INT NOT NULL, "
                 "row_timestamp VARCHAR(25) NOT NULL, "
                 "row_height INT NOT NULL, ").arg(*current_table);
-    for (int i=0; i<newFieldCount; i++)
-        q.append(QString("field%1 VARCHAR(2048), ").arg(i));
+    q.append(fieldsDefinition(current_format, newFieldCount));
     q.append("CONSTRAINT row_index_pk PRIMARY KEY (row_index) )");
     if (!query->exec(q))
     {
@@ -1065,6 +3155,10 @@ void DBManager::removeColumns(const QList <int> column_ids)
         emit queryError("Please check your database connection5");
         return;
     }
+    if (current_format == BinaryStorage && !rebindShiftedColumns(column_ids))
+        return;
+    if (!setFileColumnCount(newFieldCount))
+        return;
 
     emit columnsRemoved(column_ids);
 }
@@ -1099,7 +3193,7 @@ void DBManager::setColumnWidth(int column, int oldSize, int newSize)
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         query->prepare("INSERT INTO tables_settings "
                        "VALUES (:tid, :col, :width, :text)");
@@ -1146,7 +3240,7 @@ void DBManager::setColumnHeaderText(int column, const QString &text)
         emit queryError("Please check your database connection");
         return;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
     {
         query->prepare("INSERT INTO tables_settings "
                        "VALUES (:tid, :col, :width, :text)");
@@ -1193,7 +3287,7 @@ void DBManager::setRowHeight(int row, int oldSize, int newSize)
     timestamp.append("&");
     timestamp.append(QTime::currentTime().toString("hh:mm:ss:zzz"));
 
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
         query->prepare(QString("INSERT INTO %1 (row_index, row_timestamp, row_height) "
                                "VALUES (:row, :ts, :ns)").arg(*current_table));
     else
@@ -1271,7 +3365,7 @@ bool DBManager::removeFolder(const QString &name)
         emit queryError("Please check your database connection");
         return false;
     }
-    if (query->size() > 0)
+    if (query->rowCount() > 0)
     {
         emit queryError("Unable to delete - the folder contains tables you don't own");
         return false;
@@ -1376,7 +3470,7 @@ bool DBManager::removeTable(const QString& name)
         emit queryError("Please check your database connection");
         return false;
     }
-    if (query->size() == 0)
+    if (query->rowCount() == 0)
         return false;
 
     QSqlRecord record = query->record();
@@ -1487,31 +3581,46 @@ bool DBManager::removeTable(const QString& name)
     return true;
 }
 
-//OK, TESTED, WORKING
 void DBManager::changeKey(const QString &oldPrivateKey, 
                           const QString &publicKey, 
                           const QString &privateKey, 
                           const QString &passphrase)
 {
-    if (!security->setRSAkeys(publicKey, privateKey, passphrase))
+    if (rekeyer->isRunning())
+    {
+        emit queryError("A key change is already running");
+        return;
+    }
+    if (Security::prepareKey(privateKey, passphrase).isEmpty())
     {
         emit queryError("Invalid keys");
         return;
     }
-    cfg->setKey(privateKey);
 
-    query->prepare("UPDATE users "
-                   "SET public_key=:key "
-                   "WHERE user_id=:uid");
-    query->bindValue(":key", publicKey);
+    //pending rotation keys are wrapped with the current key pair
+    query->prepare("SELECT file_name "
+                   "FROM files "
+                   "WHERE owner=:uid "
+                   "AND rotation_key IS NOT NULL");
     query->bindValue(":uid", current_user_id);
     if (!query->exec())
     {
         emit queryError("Please check your database connection");
         return;
     }
+    QStringList rotating;
+    while (query->next())
+        rotating << query->value(0).toString();
+    if (rotation.table_id != -1 || !rotating.isEmpty())
+    {
+        emit queryError(QString("Finish or abort the key rotation of %1 "
+                                "before changing keys").
+                        arg(rotating.isEmpty()?QString("the open table"):
+                                               rotating.join(", ")));
+        return;
+    }
 
-    query->prepare("SELECT table_id, access_key "
+    query->prepare("SELECT table_id, access_key, rotation_key "
                    "FROM access_keys "
                    "WHERE user_id=:uid");
     query->bindValue(":uid", current_user_id);
@@ -1521,30 +3630,93 @@ void DBManager::changeKey(const QString &oldPrivateKey,
         return;
     }
     
-    QHash<int,QString> accessKeys = QHash<int,QString>();
+    QList<AccessKeyUpdate> accessKeys;
     while (query->next())
-        accessKeys.insert(query->value(0).toInt(),
-                          query->value(1).toString());
-    QHashIterator<int,QString> it(accessKeys);
-    while (it.hasNext())
     {
-        it.next();
-        QString accKey = Security::RSADecrypt(it.value(),
-                                              oldPrivateKey,
-                                              passphrase);
-        query->prepare("UPDATE access_keys "
-                       "SET access_key=:newKey, "
-                       "signed_key=:newSign "
-                       "WHERE user_id=:uid "
-                       "AND table_id=:tid");
-        query->bindValue(":newKey", security->RSAEncrypt(accKey));
-        query->bindValue(":newSign", security->RSASign(accKey));
+        AccessKeyUpdate item;
+        item.table_id = query->value(0).toInt();
+        item.access_key = query->value(1).toString();
+        item.rotation_key = query->value(2).toString();
+        item.ok = false;
+        accessKeys.append(item);
+    }
+
+    //remembered until the transaction commits so login can resume it
+    cfg->setPendingKey(publicKey, privateKey);
+    rekey_public = publicKey;
+    rekey_private = privateKey;
+    rekey_passphrase = passphrase;
+    emit keyChangeProgress(0, accessKeys.size());
+    rekeyer->setFuture(QtConcurrent::mapped(accessKeys,
+                       RekeyAccessKey(oldPrivateKey, publicKey,
+                                      privateKey, passphrase)));
+}
+
+void DBManager::rekeyProgress(int done)
+{
+    emit keyChangeProgress(done, rekeyer->progressMaximum());
+}
+
+void DBManager::rekeyFinished()
+{
+    QList<AccessKeyUpdate> updates = rekeyer->future().results();
+    //the pool threads parsed the old private key
+    Security::clearKeyCache();
+    for (int i=0; i<updates.size(); i++)
+        if (!updates.at(i).ok)
+        {
+            cfg->setPendingKey("", "");
+            emit queryError("Could not decrypt the access keys");
+            return;
+        }
+
+    db.transaction();
+    query->prepare("UPDATE users "
+                   "SET public_key=:key "
+                   "WHERE user_id=:uid");
+    query->bindValue(":key", rekey_public);
+    query->bindValue(":uid", current_user_id);
+    if (!query->exec())
+    {
+        db.rollback();
+        emit queryError("Please check your database connection");
+        return;
+    }
+
+    query->prepare("UPDATE access_keys "
+                   "SET access_key=:newKey, "
+                   "signed_key=:newSign, "
+                   "rotation_key=:rotationKey "
+                   "WHERE user_id=:uid "
+                   "AND table_id=:tid");
+    for (int i=0; i<updates.size(); i++)
+    {
+        query->bindValue(":newKey", updates.at(i).access_key);
+        query->bindValue(":newSign", updates.at(i).signed_key);
+        query->bindValue(":rotationKey", updates.at(i).rotation_key.isEmpty()?
+                         QVariant(QVariant::String):
+                         QVariant(updates.at(i).rotation_key));
         query->bindValue(":uid", current_user_id);
-        query->bindValue(":tid", it.key());
+        query->bindValue(":tid", updates.at(i).table_id);
         if (!query->exec())
         {
+            db.rollback();
             emit queryError("Please check your database connection");
-            continue;
+            return;
         }
     }
+    if (!db.commit())
+    {
+        db.rollback();
+        emit queryError("Please check your database connection");
+        return;
+    }
+
+    security->setRSAkeys(rekey_public, rekey_private, rekey_passphrase);
+    cfg->setKey(rekey_private);
+    cfg->setPreparedKey(security->preparedKey(rekey_passphrase),
+                        Security::keySource(rekey_public, rekey_private));
+    cfg->setPendingKey("", "");
+    emit keyChangeProgress(updates.size(), updates.size());
+    emit message(QString("Keys changed for %1 tables").arg(updates.size()));
 }
@@ -5,24 +5,87 @@
 #include <QtSql>
 #include "Security.h"
 #include "CFGManager.h"
+#include "CellRecord.h"
+#include "QueryStats.h"
+#include "LinkProvider.h"
 
 class SpreadSheet;
+struct SheetMemory;
 
-class DBManager : public QObject
+struct AccessKeyUpdate
+{
+    int table_id;
+    QString access_key;
+    QString signed_key;
+    QString rotation_key;
+    bool ok;
+};
+
+struct RotatedRow
+{
+    int row;
+    QString timestamp;
+    QVariantList values;
+    bool ok;
+};
+
+//what the last refresh pulled and the cell writes, for the performance readout
+struct RefreshInfo
+{
+    qint64 usecs;
+    int rows;
+    qint64 bytes;
+    int cells;
+    qint64 decodeUsecs;
+    int writes;
+    qint64 writeUsecs;
+
+    RefreshInfo();
+};
+
+struct KeyRotation
+{
+    int table_id;
+    QString table;
+    int format;
+    int profile;
+    QStringList fields;
+    QString old_key;
+    QString new_key;
+    int next_row;
+    int end_row;
+    int retries;
+    bool aborting;
+    bool abort_requested;
+    qint64 bytes;
+    int rows;
+    QElapsedTimer clock;
+};
+
+class DBManager : public QObject, public LinkProvider
 {
     Q_OBJECT
 public:
-    DBManager(const CFGManager *cfg);
+    enum StorageFormat { HexStorage = 0, BinaryStorage = 1, RowStorage = 2 };
+
+    DBManager(const CFGManager *cfg,
+              const QString &connection = QString());
     void setCurrentSpreadSheet(SpreadSheet *spreadsheet);
     void removeCurrentData();
+    void preloadDrivers();
 
     void initializeDatabase(const QString &username, 
                             const QString &password);
-    bool writeData(int line, int column, const QString& cell_data);
+    bool writeData(int line, int column, const QByteArray& cell_data);
+    bool writeRows(const QMap<int, QList<QByteArray> > &rows);
     int columnCount();
     int loadUsers();
     QHash<QString, QString> getTables();
     QHash<QString, QString> getFolders();
+    static int storageFormat(const QString &name);
+    static int cipherProfile(const QString &name);
+    const QueryStats *queryStats() const;
+    const RefreshInfo &lastRefresh() const;
     ~DBManager();
     void disconnectDB();
     
@@ -32,19 +95,23 @@ signals:
     void rowsHeightLoaded(const QMap<int,int> size);
     void columnsWidthLoaded(const QMap<int,int> size);
     void columnsHeaderTextLoaded(const QMap<int, QString> data);
-    void dataLoaded(const QMap<int, QString> &data);
+    void dataDecoded(const RefreshPayload &data);
     void dataLoaded(int row, int column, const QString &data);
-    void givenDataLoaded(const QMap<int, QString> &data);
+    void givenDataLoaded(const QMap<int, QList<QByteArray> > &data);
     void tableCreated(const QString &data, int columns, int rows);
     void tableOpened(const QString &name, int columns, int rows);
     void loggedIn(int uid);
     void userCreated();
+    void userCreationProgress(const QString &step, int done, int total);
+    void keyChangeProgress(int done, int total);
+    void keyRotationProgress(int done, int total, int kbPerSecond);
     void rowsAdded(int rows);
     void columnsAdded(int columns);
     void columnsRemoved(const QList<int> columns);
     void dataModified(const QHash<QString, QString> &tables,
                       const QHash<QString, QString> &folders);
     void message(const QString &msg);
+    void refreshPaused(const QString &reason);
     void initializeDatabaseRequest(const QString &username, 
                                    const QString &password,
                                    const QString &error);
@@ -56,14 +123,68 @@ signals:
 private:
     int current_user_id;
     int current_table_id;
+    int current_format;
+    int current_columns;
+    int current_profile;
     QSqlDatabase db;
-    QSqlQuery *query;
+    QString connection_name;
+    QFuture<QStringList> drivers;
+    bool drivers_started;
+    bool db_prepared;
+    TimedQuery *query;
+    QueryStats *stats;
+    QElapsedTimer decode_clock;
+    QElapsedTimer refresh_clock;
+    int pulled_rows;
+    qint64 pulled_bytes;
+    RefreshInfo last_refresh;
     QString *current_table;
     SpreadSheet *spreadsheet;
     Security *security;
     const CFGManager *cfg;
+    QFutureWatcher<RefreshPayload> *decoder;
+    QFutureWatcher<QStringList> *keygen;
+    QString pending_user;
+    QString pending_pass;
+    QFutureWatcher<AccessKeyUpdate> *rekeyer;
+    QString rekey_public;
+    QString rekey_private;
+    QString rekey_passphrase;
+    QFutureWatcher<RotatedRow> *rotator;
+    KeyRotation rotation;
+    int current_key_version;
+    QString current_rotation_key;
+    QString current_rotation_wrapped;
+    int current_rotation_row;
+    mutable QHash<QString, QString> verified_keys;
+    bool force_key_verification;
     
+    bool prepareDatabase();
     void deleteTable(int id);
+    void upgradeSchema();
+    QString fieldType(int format) const;
+    QString fieldsDefinition(int format, int columns) const;
+    bool convertTable(int format, int profile);
+    bool writeRowData(int line, int column, const QByteArray &cell_data);
+    bool removeEnvelopeCells(const QList<int> &column_ids);
+    bool rebindShiftedColumns(const QList<int> &column_ids);
+    bool setFileColumnCount(int columns);
+    bool loadTableKey(int owner);
+    bool tableKeys(int table_id, int owner, QString *key, QString *newKey,
+                   QString *error) const;
+    QString verifiedKey(int table_id, int owner, const QString &accessKey,
+                        const QString &signedKey, QString *error) const;
+    bool checkTableKey(bool lock = false);
+    QString shareLock() const;
+    QString rowKey(int row) const;
+    bool wrapRotationKey(int table_id, const QString &newKey);
+    bool writeRotatedRows(const QList<RotatedRow> &rows, bool *conflict);
+    void startRotation(const QString &newKey, int next_row, int end_row,
+                       bool aborting);
+    int chunkStart() const;
+    void finishRotation();
+    void finishAbort();
+    void stopRotation(const QString &error);
     
     void login(const QString& uname, const QString& pass);
     void createUser(const QString &uname, const QString &pass);
@@ -92,11 +213,26 @@ public slots:
     void createFolder(const QString &name, const QString &parent);
     bool removeFolder(const QString &name);
     bool removeTable(const QString& name);
+    bool upgradeStorage(int format, int profile);
+    bool rotateTableKey();
+    bool abortKeyRotation();
+    bool dumpQueryStats(const QString &fileName) const;
+    void memoryUsage(SheetMemory *usage) const;
+    void clearQueryStats();
+    void setForceKeyVerification(bool force);
 
     void changeKey(const QString &oldPrivateKey,
                    const QString &publicKey,
                    const QString &privateKey,
                    const QString &passphrase);
+
+private slots:
+    void decodeFinished();
+    void keyPairGenerated();
+    void rekeyProgress(int done);
+    void rekeyFinished();
+    void rotateNextChunk();
+    void rotationChunkDone();
 };
 
 #endif // DBMANAGER_H
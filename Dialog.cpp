@@ -266,7 +266,7 @@ ErrorDialog::ErrorDialog(const QString& text, QWidget* parent) :
     connect(ok, SIGNAL(clicked()), this, SLOT(close()));
 }
 
-FormulaDialog::FormulaDialog(const QMultiMap<int, int> &selection, 
+FormulaDialog::FormulaDialog(const QList<QTableWidgetSelectionRange> &selection, 
                              const SpreadSheet *spreadsheet, QWidget *parent) :
         Dialog("Formula", "Select a function", parent)
 {
@@ -324,10 +324,10 @@ FormulaDialog::FormulaDialog(const QMultiMap<int, int> &selection,
             this, SLOT(showFormulaInfo(QString)));
     connect(this->spreadsheet, SIGNAL(itemSelectionChanged()),
             this, SLOT(addRangeItems()));
-    connect(this, SIGNAL(setSelectedItems(QMultiMap<int,int>)),
-            this->spreadsheet, SLOT(setSelectedItemIndexes(QMultiMap<int,int>)));
+    connect(this, SIGNAL(setSelectedItems(QList<QTableWidgetSelectionRange>)),
+            this->spreadsheet, SLOT(setSelectedItemRanges(QList<QTableWidgetSelectionRange>)));
     connect(this, SIGNAL(okPressed()), this, SLOT(generateFormula()));
-    connect(this, SIGNAL(setFormula(QString,QMultiMap<int,int>)),
+    connect(this, SIGNAL(setFormula(QString,QList<QTableWidgetSelectionRange>)),
             this, SLOT(close()));
 }
 
@@ -421,17 +421,17 @@ void FormulaDialog::addRangeItems()
         return;
     }
 
-    range->setText("");
-    QMultiMap<int,int> selected = spreadsheet->selectedItemIndexes();
-    QMapIterator<int,int> it(selected);
+    QStringList cells = QStringList();
+    QList<QTableWidgetSelectionRange> selected = spreadsheet->selectedItemRanges();
+    QListIterator<QTableWidgetSelectionRange> it(selected);
     while (it.hasNext())
     {
-        it.next();
-        range->setText(range->text().
-                       append(spreadsheet->getLocation(it.key(), it.value())).
-                       append(";"));
+        const QTableWidgetSelectionRange &r = it.next();
+        for (int row=r.topRow(); row<=r.bottomRow(); row++)
+            for (int col=r.leftColumn(); col<=r.rightColumn(); col++)
+                cells.append(spreadsheet->getLocation(row, col));
     }
-    range->setText(range->text().remove(range->text().length()-1, 1));
+    range->setText(cells.join(";"));
 }
 
 void FormulaDialog::generateFormula()
@@ -481,3 +481,29 @@ void FormulaDialog::generateFormula()
     emit setSelectedItems(selection);
     emit setFormula(finalFormula, selection);
 }
+
+QueryStatsDialog::QueryStatsDialog(const QString &report, QWidget *parent,
+                                   const QString &title,
+                                   const QString &fileName) :
+        Dialog(title, "", parent)
+{
+    file_name = fileName;
+    resize(600, 500);
+    text->hide();
+    view = new QPlainTextEdit(report, this);
+    view->setReadOnly(true);
+    view->setLineWrapMode(QPlainTextEdit::NoWrap);
+    view->setFont(QFont("Monospace"));
+    mainLayout->addWidget(view, 0, 0, 1, 4);
+    ok->setText("Save");
+    cancel->setText("Close");
+    connect(ok, SIGNAL(clicked()), this, SLOT(save()));
+}
+
+void QueryStatsDialog::save()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Save statistics",
+                                                    file_name);
+    if (!fileName.isEmpty())
+        emit saveRequested(fileName);
+}
@@ -150,7 +150,7 @@ class FormulaDialog : public Dialog
 {
     Q_OBJECT
 public:
-    FormulaDialog(const QMultiMap<int,int> &selection, 
+    FormulaDialog(const QList<QTableWidgetSelectionRange> &selection, 
                   const SpreadSheet *spreadsheet,
                   QWidget *parent = 0);
     ~FormulaDialog();
@@ -168,7 +168,7 @@ private:
     QLabel *elseText;
     QLineEdit *elseValue;
     const SpreadSheet *spreadsheet;
-    QMultiMap<int,int> selection;
+    QList<QTableWidgetSelectionRange> selection;
     void hideThenElse();
     void showThenElse();
 
@@ -178,9 +178,28 @@ private slots:
     void generateFormula();
 
 signals:
-    void setSelectedItems(const QMultiMap<int,int> &items);
+    void setSelectedItems(const QList<QTableWidgetSelectionRange> &items);
     void setFormula(const QString &formula, 
-                    const QMultiMap<int,int> &selection);
+                    const QList<QTableWidgetSelectionRange> &selection);
+};
+
+class QueryStatsDialog : public Dialog
+{
+    Q_OBJECT
+public:
+    QueryStatsDialog(const QString &report, QWidget *parent = 0,
+                     const QString &title = "Query statistics",
+                     const QString &fileName = "query_stats.txt");
+
+private:
+    QPlainTextEdit *view;
+    QString file_name;
+
+private slots:
+    void save();
+
+signals:
+    void saveRequested(const QString &fileName);
 };
 
 #endif // DIALOG_H
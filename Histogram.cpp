@@ -0,0 +1,129 @@
+#include "Histogram.h"
+
+Histogram::Histogram()
+{
+    clear();
+}
+
+void Histogram::add(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+    buckets[bucketIndex(value)]++;
+    if (total == 0 || value < minimum)
+        minimum = value;
+    if (total == 0 || value > maximum)
+        maximum = value;
+    values_sum += value;
+    total++;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    if (other.total == 0)
+        return;
+    for (int i=0; i<buckets.size(); i++)
+        buckets[i] += other.buckets.at(i);
+    if (total == 0 || other.minimum < minimum)
+        minimum = other.minimum;
+    if (total == 0 || other.maximum > maximum)
+        maximum = other.maximum;
+    values_sum += other.values_sum;
+    total += other.total;
+}
+
+void Histogram::clear()
+{
+    buckets = QVector<int>(64, 0);
+    total = 0;
+    minimum = 0;
+    maximum = 0;
+    values_sum = 0;
+}
+
+int Histogram::count() const
+{
+    return total;
+}
+
+qint64 Histogram::min() const
+{
+    return minimum;
+}
+
+qint64 Histogram::max() const
+{
+    return maximum;
+}
+
+qint64 Histogram::sum() const
+{
+    return values_sum;
+}
+
+double Histogram::mean() const
+{
+    if (total == 0)
+        return 0;
+    return (double)values_sum / total;
+}
+
+qint64 Histogram::percentile(double p) const
+{
+    if (total == 0)
+        return 0;
+
+    int rank = qCeil(p / 100.0 * total);
+    if (rank < 1)
+        rank = 1;
+    int seen = 0;
+    for (int i=0; i<buckets.size(); i++)
+    {
+        seen += buckets.at(i);
+        if (seen >= rank)
+            return qMin(bucketLimit(i), maximum);
+    }
+    return maximum;
+}
+
+QString Histogram::toString(const QString &unit) const
+{
+    QString result = QString("count=%1 min=%2%5 mean=%3%5 max=%4%5\n").
+            arg(total).arg(minimum).arg(mean(), 0, 'f', 1).arg(maximum).arg(unit);
+    result.append(QString("p50=%1%4 p90=%2%4 p99=%3%4\n").
+                  arg(percentile(50)).arg(percentile(90)).
+                  arg(percentile(99)).arg(unit));
+
+    int largest = 0;
+    for (int i=0; i<buckets.size(); i++)
+        largest = qMax(largest, buckets.at(i));
+    for (int i=0; i<buckets.size(); i++)
+    {
+        if (buckets.at(i) == 0)
+            continue;
+        int bar = (largest == 0)?0:(buckets.at(i) * 40 / largest);
+        result.append(QString("<= %1%2 %3 %4\n").
+                      arg(bucketLimit(i), 12).arg(unit).
+                      arg(buckets.at(i), 8).
+                      arg(QString(qMax(bar, 1), '#')));
+    }
+    return result;
+}
+
+int Histogram::bucketIndex(qint64 value)
+{
+    int index = 0;
+    while (value > 0 && index < 63)
+    {
+        value >>= 1;
+        index++;
+    }
+    return index;
+}
+
+qint64 Histogram::bucketLimit(int index)
+{
+    if (index == 0)
+        return 0;
+    return (Q_INT64_C(1) << index) - 1;
+}
@@ -0,0 +1,33 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtCore>
+
+class Histogram
+{
+public:
+    Histogram();
+
+    void add(qint64 value);
+    void merge(const Histogram &other);
+    void clear();
+    int count() const;
+    qint64 min() const;
+    qint64 max() const;
+    qint64 sum() const;
+    double mean() const;
+    qint64 percentile(double p) const;
+    QString toString(const QString &unit = "us") const;
+
+private:
+    QVector<int> buckets;
+    int total;
+    qint64 minimum;
+    qint64 maximum;
+    qint64 values_sum;
+
+    static int bucketIndex(qint64 value);
+    static qint64 bucketLimit(int index);
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,15 @@
+#ifndef LINKPROVIDER_H
+#define LINKPROVIDER_H
+
+#include <QtCore>
+
+//resolves table:cell references of formulas, keyed by "table:cell"
+class LinkProvider
+{
+public:
+    virtual ~LinkProvider() {}
+    virtual QHash<QString,QString> getLinkData(
+            const QHash<QString,QString> &matches) const = 0;
+};
+
+#endif // LINKPROVIDER_H
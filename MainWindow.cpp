@@ -1,4 +1,6 @@
 #include "MainWindow.h"
+#include "Trace.h"
+#include "Startup.h"
 
 MainWindow::MainWindow(const QString& title) : QMainWindow()
 {
@@ -9,11 +11,15 @@ MainWindow::MainWindow(const QString& title) : QMainWindow()
     CreateMenus();
     CreateToolbars();
     show();
+    Startup::mark("main window");
 
     dialog = 0;
     Spreadsheet = 0;
     connected = false;
     config = new CFGManager();
+    Trace::start(config->getTraceFile());
+    Startup::mark("configuration");
+    //drivers and QCA are loaded later, see startupFinished and connectDB
     DBcon = new DBManager(config);
     connect(DBcon, SIGNAL(queryError(QString)),
             this, SLOT(CreateErrorDialog(QString)));
@@ -21,7 +27,26 @@ MainWindow::MainWindow(const QString& title) : QMainWindow()
             this, SLOT(initializeDatabase(QString,QString,QString)));
     connect(DBcon, SIGNAL(closeCurrentTable()),
             this, SLOT(closeOpenedTable()));
+    connect(DBcon, SIGNAL(userCreationProgress(QString,int,int)),
+            this, SLOT(showUserCreationProgress(QString,int,int)));
+    connect(DBcon, SIGNAL(keyChangeProgress(int,int)),
+            this, SLOT(showKeyChangeProgress(int,int)));
+    connect(DBcon, SIGNAL(keyRotationProgress(int,int,int)),
+            this, SLOT(showKeyRotationProgress(int,int,int)));
+    connect(DBcon, SIGNAL(refreshPaused(QString)),
+            this, SLOT(showRefreshPaused(QString)));
+    perfAction->setChecked(config->getPerformanceReadout());
+    Startup::mark("database manager");
     createDBLoginDialog();
+    Startup::mark("login dialog");
+    QTimer::singleShot(0, this, SLOT(startupFinished()));
+}
+
+//the window takes input from here on, the remaining work runs in background
+void MainWindow::startupFinished()
+{
+    Startup::finish();
+    DBcon->preloadDrivers();
 }
 
 void MainWindow::resetSize()
@@ -37,9 +62,12 @@ MainWindow::~MainWindow()
     delete dialog;
     delete DBcon;
     delete config;
+    Trace::stop();
     delete menuBar;
     delete timer;
+    delete perfTimer;
     delete statusMsg;
+    delete perfReadout;
     delete status;
     delete tableToolBar;
     delete editToolBar;
@@ -101,6 +129,21 @@ void MainWindow::CreateActions()
     connect(exportTableAction,SIGNAL(triggered()),this,SLOT(exportTable()));
     tableActions << exportTableAction;
 
+    upgradeStorageAction = new QAction(QIcon("images/save.png"),
+                                       "&Upgrade storage",this);
+    connect(upgradeStorageAction,SIGNAL(triggered()),this,SLOT(upgradeStorage()));
+    tableActions << upgradeStorageAction;
+
+    rotateKeyAction = new QAction(QIcon("images/save.png"),
+                                  "&Rotate table key",this);
+    connect(rotateKeyAction,SIGNAL(triggered()),this,SLOT(rotateTableKey()));
+    tableActions << rotateKeyAction;
+
+    abortRotationAction = new QAction(QIcon("images/save.png"),
+                                      "&Abort key rotation",this);
+    connect(abortRotationAction,SIGNAL(triggered()),this,SLOT(abortKeyRotation()));
+    tableActions << abortRotationAction;
+
     copyAction = new QAction(QIcon("images/copy.png"),
                              "&Copy",this);
     copyAction->setShortcut(QKeySequence::Copy);
@@ -187,6 +230,22 @@ void MainWindow::CreateActions()
                                   "&Configuration",this);
     connect(configureAction,SIGNAL(triggered()),this,SLOT(createConfigureAppDialog()));
     appActions << configureAction;
+
+    queryStatsAction = new QAction(QIcon("images/settings.png"),
+                                   "Query &statistics",this);
+    connect(queryStatsAction,SIGNAL(triggered()),this,SLOT(createQueryStatsDialog()));
+    appActions << queryStatsAction;
+
+    memoryAction = new QAction(QIcon("images/settings.png"),
+                               "&Memory usage",this);
+    connect(memoryAction,SIGNAL(triggered()),this,SLOT(createMemoryUsageDialog()));
+    appActions << memoryAction;
+
+    perfAction = new QAction(QIcon("images/settings.png"),
+                             "&Performance readout",this);
+    perfAction->setCheckable(true);
+    connect(perfAction,SIGNAL(toggled(bool)),this,SLOT(togglePerformanceReadout(bool)));
+    appActions << perfAction;
 }
 
 void MainWindow::CreateToolbars()
@@ -261,6 +320,14 @@ void MainWindow::CreateToolbars()
     timer = new QTimer(this);
     timer->start(5000);
     connect(timer, SIGNAL(timeout()), this, SLOT(clearErrorMessage()));
+
+    perfReadout = new QLabel(status);
+    status->addPermanentWidget(perfReadout);
+    perfReadout->hide();
+    perf_writes = 0;
+    perfTimer = new QTimer(this);
+    perfTimer->setInterval(1000);
+    connect(perfTimer, SIGNAL(timeout()), this, SLOT(updatePerformanceReadout()));
 }
 
 void MainWindow::CreateErrorDialog(const QString &message)
@@ -308,8 +375,8 @@ void MainWindow::createNewTable(const QString &name, int columns, int rows)
     Spreadsheet->addActions(editActions);
     DBcon->setCurrentSpreadSheet(Spreadsheet);
 
-    connect(Spreadsheet, SIGNAL(modified(QString)),
-            this, SLOT(writeToDB(QString)));
+    connect(Spreadsheet, SIGNAL(modified(int,int,QByteArray)),
+            this, SLOT(writeToDB(int,int,QByteArray)));
     connect(Spreadsheet, SIGNAL(invalidFormula(QString)),
             this, SLOT(displayError(QString)));
     connect(Spreadsheet, SIGNAL(currentSelectionChanged(QFont,QBrush,QBrush)),
@@ -373,8 +440,8 @@ void MainWindow::openNewTable(const QString &name, int columns, int rows)
     Spreadsheet->addActions(editActions);
     DBcon->setCurrentSpreadSheet(Spreadsheet);
 
-    connect(Spreadsheet, SIGNAL(modified(QString)),
-            this, SLOT(writeToDB(QString)));
+    connect(Spreadsheet, SIGNAL(modified(int,int,QByteArray)),
+            this, SLOT(writeToDB(int,int,QByteArray)));
     connect(Spreadsheet, SIGNAL(invalidFormula(QString)),
             this, SLOT(displayError(QString)));
     connect(Spreadsheet, SIGNAL(currentSelectionChanged(QFont,QBrush,QBrush)),
@@ -449,10 +516,89 @@ void MainWindow::exportTable()
         CreateErrorDialog("No file name entered");
         return;
     }
+    connect(Spreadsheet, SIGNAL(printProgress(int,int)),
+            this, SLOT(showExportProgress(int,int)), Qt::UniqueConnection);
     if (!Spreadsheet->printSpreadSheet(table))
         CreateErrorDialog("No file name entered");
 }
 
+void MainWindow::upgradeStorage()
+{
+    if (!connected || Spreadsheet == 0)
+    {
+        if (!connected)
+            CreateErrorDialog("Please login first");
+        else if (Spreadsheet == 0)
+            CreateErrorDialog("No table opened");
+        return;
+    }
+
+    int format = DBManager::storageFormat(config->getStorageFormat());
+    int profile = DBManager::cipherProfile(config->getCipherProfile());
+    if (DBcon->upgradeStorage(format, profile))
+        status->showMessage("Table storage converted", 5000);
+}
+
+void MainWindow::rotateTableKey()
+{
+    if (!connected || Spreadsheet == 0)
+    {
+        if (!connected)
+            CreateErrorDialog("Please login first");
+        else if (Spreadsheet == 0)
+            CreateErrorDialog("No table opened");
+        return;
+    }
+
+    if (DBcon->rotateTableKey())
+        status->showMessage("Rotating table key", 5000);
+}
+
+void MainWindow::abortKeyRotation()
+{
+    if (!connected || Spreadsheet == 0)
+    {
+        if (!connected)
+            CreateErrorDialog("Please login first");
+        else if (Spreadsheet == 0)
+            CreateErrorDialog("No table opened");
+        return;
+    }
+
+    if (DBcon->abortKeyRotation())
+        status->showMessage("Aborting table key rotation", 5000);
+}
+
+void MainWindow::showKeyRotationProgress(int done, int total, int kbPerSecond)
+{
+    status->showMessage(QString("Rotated %1 of %2 rows (%3 KB/s)").
+                        arg(done).arg(total).arg(kbPerSecond), 5000);
+}
+
+void MainWindow::showRefreshPaused(const QString &reason)
+{
+    status->showMessage(reason, 5000);
+}
+
+void MainWindow::showExportProgress(int page, int pages)
+{
+    status->showMessage(QString("Exported page %1 of %2").
+                        arg(page).arg(pages), 5000);
+}
+
+void MainWindow::showUserCreationProgress(const QString &step,
+                                          int done, int total)
+{
+    status->showMessage(QString("%1 (%2/%3)").
+                        arg(step).arg(done).arg(total), 5000);
+}
+
+void MainWindow::showKeyChangeProgress(int done, int total)
+{
+    status->showMessage(QString("Re-encrypted %1 of %2 access keys").
+                        arg(done).arg(total), 5000);
+}
+
 void MainWindow::cut()
 {
     if (!connected || Spreadsheet == 0)
@@ -507,13 +653,9 @@ void MainWindow::del()
     cellFormula->setText("");
 }
 
-void MainWindow::writeToDB(const QString &cellData)
+void MainWindow::writeToDB(int row, int column, const QByteArray &cellData)
 {
-    QStringList aux = cellData.split('\n');
-    int line = aux.at(0).toInt();
-    int col = aux.at(1).toInt();
-    QString data = aux.at(2);
-    DBcon->writeData(line, col, data);
+    DBcon->writeData(row, column, cellData);
 }
 
 void MainWindow::showFormula(int row, int column)
@@ -525,7 +667,7 @@ void MainWindow::setFormula()
 {
     if (cellFormula->text().length() > 0)
         Spreadsheet->setFormula(cellFormula->text(),
-                                Spreadsheet->selectedItemIndexes());
+                                Spreadsheet->selectedItemRanges());
 }
 
 void MainWindow::logIn(int uid)
@@ -788,6 +930,61 @@ void MainWindow::createConfigureAppDialog()
     dialog->show();
 }
 
+void MainWindow::createQueryStatsDialog()
+{
+    delete dialog;
+    dialog = new QueryStatsDialog(Startup::report() + "\n" +
+                                  DBcon->queryStats()->report(), this);
+    connect((QueryStatsDialog*)dialog, SIGNAL(saveRequested(QString)),
+            this, SLOT(saveQueryStats(QString)));
+    dialog->show();
+}
+
+void MainWindow::saveQueryStats(const QString &fileName)
+{
+    if (!DBcon->dumpQueryStats(fileName))
+        CreateErrorDialog("Unable to write the statistics file");
+}
+
+void MainWindow::createMemoryUsageDialog()
+{
+    if (!connected)
+    {
+        CreateErrorDialog("Please login first");
+        return;
+    }
+    else if (Spreadsheet == 0)
+    {
+        CreateErrorDialog("No table opened");
+        return;
+    }
+
+    SheetMemory usage = Spreadsheet->memoryUsage();
+    DBcon->memoryUsage(&usage);
+    delete dialog;
+    dialog = new QueryStatsDialog(usage.toString(), this, "Memory usage",
+                                  "memory_usage.txt");
+    connect((QueryStatsDialog*)dialog, SIGNAL(saveRequested(QString)),
+            this, SLOT(saveMemoryUsage(QString)));
+    dialog->show();
+}
+
+void MainWindow::saveMemoryUsage(const QString &fileName)
+{
+    if (Spreadsheet == 0)
+        return;
+    SheetMemory usage = Spreadsheet->memoryUsage();
+    DBcon->memoryUsage(&usage);
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        CreateErrorDialog("Unable to write the memory usage file");
+        return;
+    }
+    QTextStream out(&file);
+    out << usage.toString();
+}
+
 void MainWindow::createImportDataDialog()
 {
     if (!connected || Spreadsheet == 0)
@@ -799,26 +996,26 @@ void MainWindow::createImportDataDialog()
         return;
     }
     delete dialog;
-    dialog = new ImportDataDialog(Spreadsheet->selectedItemIndexes(), this);
+    dialog = new ImportDataDialog(Spreadsheet->selectedItemRanges(), this);
     connect(Spreadsheet, SIGNAL(itemSelectionChanged()),
             Spreadsheet, SLOT(emitSelectionChanged()));
-    connect(Spreadsheet, SIGNAL(itemSelectionChanged(QMultiMap<int,int>)),
-            ((ImportDataDialog*)dialog), SLOT(setSelectedItems(QMultiMap<int,int>)));
+    connect(Spreadsheet, SIGNAL(itemSelectionChanged(QList<QTableWidgetSelectionRange>)),
+            ((ImportDataDialog*)dialog), SLOT(setSelectedItems(QList<QTableWidgetSelectionRange>)));
     connect((ImportDataDialog*)dialog,
             SIGNAL(getDataSignal(QString)),
             DBcon, SLOT(getData(QString)));
     connect(DBcon, SIGNAL(setSpreadsheetSize(int,int)),
             ((ImportDataDialog*)dialog)->getSpreadsheet(), 
             SLOT(setSize(int,int)));
-    connect(DBcon, SIGNAL(givenDataLoaded(QMap<int,QString>)),
+    connect(DBcon, SIGNAL(givenDataLoaded(QMap<int,QList<QByteArray> >)),
             ((ImportDataDialog*)dialog)->getSpreadsheet(),
-            SLOT(loadData(QMap<int,QString>)));
-    connect(DBcon, SIGNAL(givenDataLoaded(QMap<int,QString>)),
+            SLOT(loadData(QMap<int,QList<QByteArray> >)));
+    connect(DBcon, SIGNAL(givenDataLoaded(QMap<int,QList<QByteArray> >)),
             ((ImportDataDialog*)dialog), SLOT(setRights()));
     connect(((ImportDataDialog*)dialog), 
-            SIGNAL(link(QString,QMultiMap<int,int>,QMultiMap<int,int>)),
+            SIGNAL(link(QString,QList<QTableWidgetSelectionRange>,QList<QTableWidgetSelectionRange>)),
             Spreadsheet, 
-            SLOT(setFormula(QString,QMultiMap<int,int>,QMultiMap<int,int>)));
+            SLOT(setFormula(QString,QList<QTableWidgetSelectionRange>,QList<QTableWidgetSelectionRange>)));
     ((TableDialog*)dialog)->loadTreeData(DBcon->getTables(), DBcon->getFolders());
     dialog->show();
 }
@@ -834,10 +1031,10 @@ void MainWindow::createFormulaDialog()
         return;
     }
     delete dialog;
-    dialog = new FormulaDialog(Spreadsheet->selectedItemIndexes(),
+    dialog = new FormulaDialog(Spreadsheet->selectedItemRanges(),
                                Spreadsheet, this);
-    connect(((FormulaDialog*)dialog), SIGNAL(setFormula(QString,QMultiMap<int,int>)),
-            Spreadsheet, SLOT(setFormula(QString,QMultiMap<int,int>)));
+    connect(((FormulaDialog*)dialog), SIGNAL(setFormula(QString,QList<QTableWidgetSelectionRange>)),
+            Spreadsheet, SLOT(setFormula(QString,QList<QTableWidgetSelectionRange>)));
     dialog->show();
 }
 /*
@@ -908,6 +1105,55 @@ void MainWindow::displayError(const QString &message)
     statusMsg->setText("Error: "+message);
 }
 
+void MainWindow::togglePerformanceReadout(bool show)
+{
+    perfReadout->setVisible(show);
+    if (show)
+    {
+        perf_writes = DBcon->lastRefresh().writes;
+        updatePerformanceReadout();
+        perfTimer->start();
+    }
+    else
+        perfTimer->stop();
+    if (config->getPerformanceReadout() != show)
+    {
+        config->setPerformanceReadout(show);
+        config->saveDoc();
+    }
+}
+
+//last refresh, cells decrypted per second, writes in the last second
+//and the time the last paint spent evaluating visible formulas
+void MainWindow::updatePerformanceReadout()
+{
+    if (!connected || Spreadsheet == 0)
+    {
+        perfReadout->setText("No table opened");
+        return;
+    }
+    const RefreshInfo &info = DBcon->lastRefresh();
+    QStringList parts;
+    if (info.usecs == -1)
+        parts << "refresh -";
+    else
+        parts << QString("refresh %1 ms").arg(info.usecs / 1000.0, 0, 'f', 1)
+              << QString("%1 rows, %2 KB").arg(info.rows).
+                 arg(info.bytes / 1024.0, 0, 'f', 1)
+              << QString("%1 cells/s").
+                 arg((qint64)info.cells * 1000000 / qMax(Q_INT64_C(1), info.decodeUsecs));
+    QString writes = QString("writes %1/s").arg(info.writes - perf_writes);
+    if (info.writeUsecs != -1)
+        writes.append(QString(", last %1 ms").
+                      arg(info.writeUsecs / 1000.0, 0, 'f', 1));
+    parts << writes;
+    perf_writes = info.writes;
+    if (Spreadsheet->lastPaintTime() != -1)
+        parts << QString("recalc %1 ms").
+                 arg(Spreadsheet->lastPaintTime() / 1000.0, 0, 'f', 1);
+    perfReadout->setText(parts.join(" | "));
+}
+
 void MainWindow::clearErrorMessage()
 {
     statusMsg->setText("");
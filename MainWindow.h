@@ -34,6 +34,9 @@ private:
     QStatusBar *status;
     QLabel *statusMsg;
     QTimer *timer;
+    QLabel *perfReadout;
+    QTimer *perfTimer;
+    int perf_writes;
     //Menus
     QMenuBar *menuBar;
     QMenu *table;
@@ -52,6 +55,9 @@ private:
     QAction *closeTableAction;
     QAction *importTableAction;
     QAction *exportTableAction;
+    QAction *upgradeStorageAction;
+    QAction *rotateKeyAction;
+    QAction *abortRotationAction;
     //Edit actions
     QList <QAction*> editActions;
     QAction *cutAction;
@@ -76,6 +82,9 @@ private:
     //Application actions
     QList <QAction*> appActions;
     QAction *configureAction;
+    QAction *queryStatsAction;
+    QAction *memoryAction;
+    QAction *perfAction;
     QAction *loginAction;
     QAction *logoutAction;
     QAction *signinAction;
@@ -91,11 +100,19 @@ private slots:
     void closeTable();
     void closeOpenedTable();
     void exportTable();
+    void showExportProgress(int page, int pages);
+    void showUserCreationProgress(const QString &step, int done, int total);
+    void showKeyChangeProgress(int done, int total);
+    void upgradeStorage();
+    void rotateTableKey();
+    void abortKeyRotation();
+    void showKeyRotationProgress(int done, int total, int kbPerSecond);
+    void showRefreshPaused(const QString &reason);
     void cut();
     void copy();
     void paste();
     void del();
-    void writeToDB(const QString &cellData);
+    void writeToDB(int row, int column, const QByteArray &cellData);
     void showFormula(int row, int column);
     void setFormula();
     void logIn(int uid);
@@ -113,6 +130,13 @@ private slots:
     void createGrantWriteAccessDialog();
     void grantWriteAccess(const QString &username);
     void createConfigureAppDialog();
+    void createQueryStatsDialog();
+    void saveQueryStats(const QString &fileName);
+    void createMemoryUsageDialog();
+    void saveMemoryUsage(const QString &fileName);
+    void startupFinished();
+    void togglePerformanceReadout(bool show);
+    void updatePerformanceReadout();
     void createImportDataDialog();
     void createFormulaDialog();
     //void createLoginDialog();
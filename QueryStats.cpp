@@ -0,0 +1,266 @@
+#include "QueryStats.h"
+
+QueryStats::QueryStats()
+{
+    slow_log = 0;
+    count_bytes = false;
+}
+
+QueryStats::~QueryStats()
+{
+    delete slow_log;
+}
+
+//takes ownership, every TimedQuery reporting here checks its threshold
+void QueryStats::setSlowLog(SlowQueryLog *log)
+{
+    delete slow_log;
+    slow_log = log;
+}
+
+SlowQueryLog *QueryStats::slowLog() const
+{
+    return slow_log;
+}
+
+//sizing every fetched value costs a pass over all cell text, so it is opt-in
+void QueryStats::setCountBytes(bool count)
+{
+    count_bytes = count;
+}
+
+bool QueryStats::countsBytes() const
+{
+    return count_bytes;
+}
+
+void QueryStats::addStatement(const QString &kind, qint64 execUsec,
+                              qint64 fetchUsec, int rows, qint64 bytes)
+{
+    statements[kind].add(execUsec + fetchUsec);
+    fetches[kind].add(fetchUsec);
+    this->rows[kind] += rows;
+    this->bytes[kind] += bytes;
+}
+
+void QueryStats::addError(const QString &kind, const QString &error)
+{
+    errors[kind]++;
+    last_errors.insert(kind, error);
+}
+
+void QueryStats::addPhase(const QString &operation, const QString &phase,
+                          qint64 usec)
+{
+    phases[QString("%1 %2").arg(operation).arg(phase)].add(usec);
+}
+
+void QueryStats::clear()
+{
+    statements.clear();
+    fetches.clear();
+    rows.clear();
+    bytes.clear();
+    errors.clear();
+    last_errors.clear();
+    phases.clear();
+}
+
+QString QueryStats::report() const
+{
+    QString result;
+    QMapIterator<QString, Histogram> it(phases);
+    while (it.hasNext())
+    {
+        it.next();
+        result.append(QString("== %1\n").arg(it.key()));
+        result.append(it.value().toString());
+        result.append("\n");
+    }
+
+    it = QMapIterator<QString, Histogram>(statements);
+    while (it.hasNext())
+    {
+        it.next();
+        result.append(QString("== %1\n").arg(it.key()));
+        result.append(QString("rows=%1 bytes=%2 fetch_mean=%3us errors=%4\n").
+                      arg(rows.value(it.key())).
+                      arg(count_bytes?QString::number(bytes.value(it.key())):
+                                      QString("-")).
+                      arg(fetches.value(it.key()).mean(), 0, 'f', 1).
+                      arg(errors.value(it.key())));
+        if (last_errors.contains(it.key()))
+            result.append(QString("last error: %1\n").
+                          arg(last_errors.value(it.key())));
+        result.append(it.value().toString());
+        result.append("\n");
+    }
+    return result;
+}
+
+bool QueryStats::dump(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+    QTextStream out(&file);
+    out << report();
+    return true;
+}
+
+//"SELECT files", "UPDATE table#" - user table numbers are folded together
+QString QueryStats::statementKind(const QString &sql)
+{
+    static QHash<QString, QString> kinds;
+    QString kind = kinds.value(sql);
+    if (!kind.isEmpty())
+        return kind;
+
+    QRegExp verb("^\\s*(\\w+)");
+    QRegExp table("\\b(?:FROM|INTO|UPDATE|TABLE)\\s+(\\w+)", Qt::CaseInsensitive);
+    kind = (verb.indexIn(sql) != -1)?verb.cap(1).toUpper():QString("?");
+    if (table.indexIn(sql) != -1)
+        kind.append(" ").append(table.cap(1).replace(QRegExp("\\d+"), "#"));
+    if (kinds.size() < 1024)
+        kinds.insert(sql, kind);
+    return kind;
+}
+
+PhaseTimer::PhaseTimer(QueryStats *stats, const char *operation,
+                       const char *phase)
+{
+    this->stats = stats;
+    this->operation = operation;
+    this->phase = phase;
+    timer.start();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    stats->addPhase(operation, phase, timer.nsecsElapsed() / 1000);
+}
+
+//text is counted as the UTF-8 the server sends, without converting it
+static qint64 valueBytes(const QVariant &value)
+{
+    if (value.isNull())
+        return 0;
+    if (value.type() == QVariant::ByteArray)
+        return value.toByteArray().size();
+    if (value.type() != QVariant::String)
+        return sizeof(qint64);
+    const QString text = value.toString();
+    qint64 bytes = 0;
+    for (int i=0; i<text.size(); i++)
+    {
+        ushort c = text.at(i).unicode();
+        //a surrogate pair is four bytes, two per half
+        bytes += (c < 0x80)?1:(c < 0x800 || (c >= 0xd800 && c < 0xe000))?2:3;
+    }
+    return bytes;
+}
+
+TimedQuery::TimedQuery(QSqlDatabase db, QueryStats *stats) :
+        QSqlQuery(db)
+{
+    database = db;
+    this->stats = stats;
+    exec_nsecs = 0;
+    fetch_nsecs = 0;
+    fetched_rows = 0;
+    fetched_bytes = 0;
+    fetched_columns = 0;
+    pending = false;
+}
+
+TimedQuery::~TimedQuery()
+{
+    finish();
+}
+
+bool TimedQuery::prepare(const QString &query)
+{
+    finish();
+    kind = QueryStats::statementKind(query);
+    return QSqlQuery::prepare(query);
+}
+
+bool TimedQuery::exec()
+{
+    finish();
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = QSqlQuery::exec();
+    return finishExec(ok, timer.nsecsElapsed());
+}
+
+bool TimedQuery::exec(const QString &query)
+{
+    finish();
+    kind = QueryStats::statementKind(query);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = QSqlQuery::exec(query);
+    return finishExec(ok, timer.nsecsElapsed());
+}
+
+bool TimedQuery::next()
+{
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = QSqlQuery::next();
+    fetch_nsecs += timer.nsecsElapsed();
+    if (ok && pending)
+    {
+        fetched_rows++;
+        //each column once per row, only when the stats are written out
+        for (int i=0; i<fetched_columns; i++)
+            fetched_bytes += valueBytes(value(i));
+    }
+    return ok;
+}
+
+//size() is -1 on drivers without QuerySize (SQLite), so count and rewind
+int TimedQuery::rowCount()
+{
+    if (driver()->hasFeature(QSqlDriver::QuerySize))
+        return size();
+    if (!isActive() || !isSelect())
+        return -1;
+    int rows = 0;
+    if (last())
+        rows = at() + 1;
+    seek(QSql::BeforeFirstRow);
+    return rows;
+}
+
+bool TimedQuery::finishExec(bool ok, qint64 nsecs)
+{
+    SlowQueryLog *log = stats->slowLog();
+    if (log != 0 && log->isSlow(nsecs / 1000))
+        log->record(database, *this, kind, nsecs / 1000, ok);
+    if (!ok)
+    {
+        stats->addError(kind, lastError().text());
+        stats->addStatement(kind, nsecs / 1000, 0, 0, 0);
+        return false;
+    }
+    pending = true;
+    exec_nsecs = nsecs;
+    fetch_nsecs = 0;
+    fetched_rows = 0;
+    fetched_bytes = 0;
+    fetched_columns = (stats->countsBytes() && isSelect())?
+                record().count():0;
+    return true;
+}
+
+//a statement is complete once the next one starts or the query goes away
+void TimedQuery::finish()
+{
+    if (!pending)
+        return;
+    pending = false;
+    stats->addStatement(kind, exec_nsecs / 1000, fetch_nsecs / 1000,
+                        fetched_rows, fetched_bytes);
+}
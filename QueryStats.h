@@ -0,0 +1,84 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <QtCore>
+#include <QtSql>
+#include "Histogram.h"
+#include "SlowQueryLog.h"
+
+class QueryStats
+{
+public:
+    QueryStats();
+    ~QueryStats();
+
+    void addStatement(const QString &kind, qint64 execUsec, qint64 fetchUsec,
+                      int rows, qint64 bytes);
+    void addError(const QString &kind, const QString &error);
+    void addPhase(const QString &operation, const QString &phase,
+                  qint64 usec);
+    void clear();
+    QString report() const;
+    bool dump(const QString &fileName) const;
+    void setSlowLog(SlowQueryLog *log);
+    SlowQueryLog *slowLog() const;
+    void setCountBytes(bool count);
+    bool countsBytes() const;
+
+    static QString statementKind(const QString &sql);
+
+private:
+    QMap<QString, Histogram> statements;
+    QMap<QString, Histogram> fetches;
+    QMap<QString, qint64> rows;
+    QMap<QString, qint64> bytes;
+    QMap<QString, int> errors;
+    QMap<QString, QString> last_errors;
+    QMap<QString, Histogram> phases;
+    SlowQueryLog *slow_log;
+    bool count_bytes;
+};
+
+//records the time until the end of the enclosing scope as a phase
+class PhaseTimer
+{
+public:
+    PhaseTimer(QueryStats *stats, const char *operation, const char *phase);
+    ~PhaseTimer();
+
+private:
+    QueryStats *stats;
+    const char *operation;
+    const char *phase;
+    QElapsedTimer timer;
+};
+
+//QSqlQuery that reports every statement it runs to a QueryStats
+class TimedQuery : public QSqlQuery
+{
+public:
+    TimedQuery(QSqlDatabase db, QueryStats *stats);
+    ~TimedQuery();
+
+    bool prepare(const QString &query);
+    bool exec();
+    bool exec(const QString &query);
+    bool next();
+    int rowCount();
+
+private:
+    void finish();
+    bool finishExec(bool ok, qint64 nsecs);
+
+    QSqlDatabase database;
+    QueryStats *stats;
+    QString kind;
+    qint64 exec_nsecs;
+    qint64 fetch_nsecs;
+    int fetched_rows;
+    qint64 fetched_bytes;
+    int fetched_columns;
+    bool pending;
+};
+
+#endif // QUERYSTATS_H
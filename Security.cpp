@@ -1,10 +1,275 @@
 #include "Security.h"
 
+static const int maxCachedContexts = 32;
+static const int nonceSize = 12;
+static const int tagSize = 16;
+static const int blockSize = 16;
+
+static void initialize()
+{
+    //never released, thread caches may be destroyed after static objects
+    static QCA::Initializer *init = new QCA::Initializer();
+    Q_UNUSED(init);
+}
+
+static bool AESSupported()
+{
+    initialize();
+    static bool supported = QCA::isSupported("aes256-cbc-pkcs7");
+    return supported;
+}
+
+static bool CTRSupported()
+{
+    initialize();
+    static bool supported = QCA::isSupported("aes256-ecb") &&
+                            QCA::isSupported("hmac(sha256)");
+    return supported;
+}
+
+static bool PKeySupported()
+{
+    initialize();
+    static bool supported = QCA::isSupported("pkey");
+    return supported;
+}
+
+static bool hashSupported()
+{
+    initialize();
+    static bool supported = QCA::isSupported("sha256");
+    return supported;
+}
+
+//prepared AES context for one table key
+class CipherContext
+{
+public:
+    CipherContext(const QString &key) :
+        key(QCA::hexToArray(key)),
+        iv(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9")),
+        cipher(QString("aes256"), QCA::Cipher::CBC,
+               QCA::Cipher::DefaultPadding, QCA::Encode, this->key, iv)
+    {
+        ecb = 0;
+        mac = 0;
+    }
+
+    ~CipherContext()
+    {
+        delete ecb;
+        delete mac;
+    }
+
+    QCA::SecureArray process(QCA::Direction direction,
+                             const QCA::SecureArray &data, bool *ok)
+    {
+        cipher.setup(direction, key, iv);
+        QCA::SecureArray result = cipher.process(data);
+        *ok = cipher.ok();
+        return result;
+    }
+
+    //CTR keystream for several messages with a single ECB pass
+    QByteArray keystream(const QList<QByteArray> &nonces,
+                         const QList<int> &lengths)
+    {
+        prepareCTR();
+        QByteArray counters;
+        for (int i=0; i<nonces.size(); i++)
+        {
+            int blocks = (lengths.at(i) + blockSize - 1) / blockSize;
+            for (int b=0; b<blocks; b++)
+            {
+                uchar counter[4];
+                qToBigEndian<quint32>(b, counter);
+                counters.append(nonces.at(i));
+                counters.append((const char*)counter, 4);
+            }
+        }
+        if (counters.isEmpty())
+            return counters;
+        ecb->setup(QCA::Encode, ctrKey);
+        return ecb->process(counters).toByteArray();
+    }
+
+    //the context is length prefixed, so it can't run into the nonce
+    QByteArray tag(const QByteArray &context, const QByteArray &nonce,
+                   const char *data, int size)
+    {
+        prepareCTR();
+        uchar length[4];
+        qToBigEndian<quint32>(context.size(), length);
+        mac->clear();
+        mac->update(QByteArray((const char*)length, 4));
+        mac->update(context);
+        mac->update(nonce);
+        mac->update(QByteArray::fromRawData(data, size));
+        return mac->final().toByteArray().left(tagSize);
+    }
+
+private:
+    QCA::SymmetricKey key;
+    QCA::InitializationVector iv;
+    QCA::Cipher cipher;
+    QCA::SymmetricKey ctrKey;
+    QCA::Cipher *ecb;
+    QCA::MessageAuthenticationCode *mac;
+
+    void prepareCTR()
+    {
+        if (ecb != 0)
+            return;
+        //separate keys for encryption and authentication
+        QCA::MessageAuthenticationCode derive(QString("hmac(sha256)"), key);
+        derive.update(QByteArray("cell encryption"));
+        ctrKey = QCA::SymmetricKey(derive.final().toByteArray());
+        derive.clear();
+        derive.update(QByteArray("cell authentication"));
+        QCA::SymmetricKey macKey(derive.final().toByteArray());
+
+        ecb = new QCA::Cipher(QString("aes256"), QCA::Cipher::ECB,
+                              QCA::Cipher::NoPadding, QCA::Encode, ctrKey);
+        mac = new QCA::MessageAuthenticationCode(QString("hmac(sha256)"), macKey);
+    }
+};
+
+static bool sameTag(const QByteArray &first, const char *second)
+{
+    char diff = 0;
+    for (int i=0; i<tagSize; i++)
+        diff |= first.at(i) ^ second[i];
+    return diff == 0;
+}
+
+//bumped by clearKeyCache, every thread drops its keys on its next use
+static QAtomicInt keyGeneration(0);
+
+//per thread cache of cipher contexts and parsed RSA keys
+class CipherCache
+{
+public:
+    CipherCache() : hash(QString("sha256")), generation(keyGeneration) {}
+    ~CipherCache()
+    {
+        qDeleteAll(contexts);
+        qDeleteAll(publicKeys);
+        qDeleteAll(privateKeys);
+    }
+
+    void clearKeys()
+    {
+        qDeleteAll(contexts);
+        contexts.clear();
+        qDeleteAll(privateKeys);
+        privateKeys.clear();
+        generation = keyGeneration;
+    }
+
+    CipherContext *context(const QString &key)
+    {
+        CipherContext *c = contexts.value(key);
+        if (c == 0)
+        {
+            if (contexts.size() >= maxCachedContexts)
+            {
+                qDeleteAll(contexts);
+                contexts.clear();
+            }
+            c = new CipherContext(key);
+            contexts.insert(key, c);
+        }
+        return c;
+    }
+
+    QCA::RSAPublicKey *publicKey(const QString &pubKeyData)
+    {
+        QCA::RSAPublicKey *k = publicKeys.value(pubKeyData);
+        if (k == 0)
+        {
+            QStringList pubKeyParam = pubKeyData.split('|');
+            if (pubKeyParam.length() != 2)
+                return 0;
+            if (publicKeys.size() >= maxCachedContexts)
+            {
+                qDeleteAll(publicKeys);
+                publicKeys.clear();
+            }
+            k = new QCA::RSAPublicKey(QCA::BigInteger(pubKeyParam.at(0)),
+                                      QCA::BigInteger(pubKeyParam.at(1)));
+            publicKeys.insert(pubKeyData, k);
+        }
+        return k;
+    }
+
+    QCA::RSAPrivateKey *privateKey(const QString &prvKeyData,
+                                   const QString &passphrase)
+    {
+        //the passphrase is not kept in the cache
+        hash.clear();
+        hash.update(prvKeyData.toUtf8());
+        hash.update(QByteArray(1, '|'));
+        hash.update(passphrase.toUtf8());
+        QByteArray id = hash.final().toByteArray();
+        hash.clear();
+        QCA::RSAPrivateKey *k = privateKeys.value(id);
+        if (k == 0)
+        {
+            QStringList prvKeyParam =
+                    Security::AESDecrypt(prvKeyData, passphrase).split('|');
+            if (prvKeyParam.length() != 5)
+                return 0;
+            if (privateKeys.size() >= maxCachedContexts)
+            {
+                qDeleteAll(privateKeys);
+                privateKeys.clear();
+            }
+            k = new QCA::RSAPrivateKey(QCA::BigInteger(prvKeyParam.at(0)),
+                                       QCA::BigInteger(prvKeyParam.at(1)),
+                                       QCA::BigInteger(prvKeyParam.at(2)),
+                                       QCA::BigInteger(prvKeyParam.at(3)),
+                                       QCA::BigInteger(prvKeyParam.at(4)));
+            privateKeys.insert(id, k);
+        }
+        return k;
+    }
+
+    QCA::Hash hash;
+    int generation;
+
+private:
+    QHash<QString, CipherContext*> contexts;
+    QHash<QString, QCA::RSAPublicKey*> publicKeys;
+    QHash<QByteArray, QCA::RSAPrivateKey*> privateKeys;
+};
+
+static QThreadStorage<CipherCache*> caches;
+
+static CipherCache *cache()
+{
+    initialize();
+    if (!caches.hasLocalData())
+        caches.setLocalData(new CipherCache());
+    CipherCache *c = caches.localData();
+    if (c->generation != keyGeneration)
+        c->clearKeys();
+    return c;
+}
+
+//the calling thread drops its keys now, pool threads before their next
+//job or when they expire
+void Security::clearKeyCache()
+{
+    keyGeneration.ref();
+    if (caches.hasLocalData())
+        caches.localData()->clearKeys();
+}
+
+//QCA and its provider plugins are only loaded once a key is set
 Security::Security()
 {
-    init = new QCA::Initializer();
     AESkey = 0;
-    AESiv = new QCA::InitializationVector(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9"));
+    AESiv = 0;
     AEScipher = 0;
     RSApublic = 0;
     RSAprivate = 0;
@@ -17,15 +282,17 @@ Security::~Security()
     delete AEScipher;
     delete RSApublic;
     delete RSAprivate;
-    delete init;
 }
 
 bool Security::setAESkey(const QString &key)
 {
-    if (key.length() != 64 || !QCA::isSupported("aes256-cbc-pkcs7"))
+    if (key.length() != 64 || !AESSupported())
         return false;
 
+    delete AESkey;
     delete AEScipher;
+    if (AESiv == 0)
+        AESiv = new QCA::InitializationVector(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9"));
     AESkey = new QCA::SymmetricKey(QCA::hexToArray(key));
     AEScipher = new QCA::Cipher(QString("aes256"), QCA::Cipher::CBC,
                                 QCA::Cipher::DefaultPadding, QCA::Encode,
@@ -44,8 +311,6 @@ QString Security::getAESkey()
 
 QString Security::AESEncrypt(const QString &data) const
 {
-    if (!QCA::isSupported("aes256-cbc-pkcs7"))
-        return "";
     if (AESkey == 0 || AEScipher == 0)
         return "";
 
@@ -61,8 +326,6 @@ QString Security::AESEncrypt(const QString &data) const
 
 QString Security::AESDecrypt(const QString &data) const
 {
-    if (!QCA::isSupported("aes256-cbc-pkcs7"))
-        return "";
     if (AESkey == 0 || AEScipher == 0)
         return "";
 
@@ -80,11 +343,13 @@ bool Security::setRSAkeys(const QString &pubKeyData,
                           const QString &prvKeyData, 
                           const QString &passphrase)
 {
-    if (passphrase.length() != 64 || !QCA::isSupported("pkey"))
+    if (passphrase.length() != 64 || !PKeySupported())
         return false;
 
     delete this->RSApublic;
     delete this->RSAprivate;
+    RSApublic = 0;
+    RSAprivate = 0;
     
     QStringList pubKeyParam = pubKeyData.split('|');
     QStringList prvKeyParam = AESDecrypt(prvKeyData, passphrase).split('|');
@@ -102,9 +367,39 @@ bool Security::setRSAkeys(const QString &pubKeyData,
     return true;
 }
 
+QString Security::preparedKey(const QString &passphrase) const
+{
+    if (passphrase.length() != 64 || RSAprivate == 0)
+        return "";
+
+    QCA::SecureArray der = RSAprivate->toDER(passphrase.toAscii());
+    return QString(qPrintable(QCA::arrayToHex(der.toByteArray())));
+}
+
+bool Security::setPreparedKey(const QString &preparedKey,
+                              const QString &passphrase)
+{
+    if (preparedKey.isEmpty() || passphrase.length() != 64 ||
+            !PKeySupported())
+        return false;
+
+    //DER decoding skips the decimal big integer parsing of setRSAkeys
+    QCA::ConvertResult result;
+    QCA::PrivateKey key = QCA::PrivateKey::fromDER(
+                QCA::hexToArray(preparedKey), passphrase.toAscii(), &result);
+    if (result != QCA::ConvertGood || !key.isRSA())
+        return false;
+
+    delete RSApublic;
+    delete RSAprivate;
+    RSAprivate = new QCA::RSAPrivateKey(key.toRSA());
+    RSApublic = new QCA::RSAPublicKey(key.toPublicKey().toRSA());
+    return true;
+}
+
 QString Security::RSAEncrypt(const QString &data) const
 {
-    if (!QCA::isSupported("pkey"))
+    if (!PKeySupported())
         return "";
     if (RSApublic == 0)
         return "";
@@ -119,7 +414,7 @@ QString Security::RSAEncrypt(const QString &data) const
 
 QString Security::RSADecrypt(const QString &data) const
 {
-    if (!QCA::isSupported("pkey"))
+    if (!PKeySupported())
         return "";
     if (RSAprivate == 0)
         return "";
@@ -136,7 +431,7 @@ QString Security::RSADecrypt(const QString &data) const
 
 QString Security::RSASign(const QString &data) const
 {
-    if (!QCA::isSupported("pkey"))
+    if (!PKeySupported())
         return "";
     if (RSAprivate == 0)
         return "";
@@ -150,18 +445,13 @@ QString Security::RSASign(const QString &data) const
 
 QString Security::AESEncrypt(const QString &data, const QString &key)
 {
-    QCA::Initializer init;
-    if (!QCA::isSupported("aes256-cbc-pkcs7") || key.length() != 64)
+    if (key.length() != 64 || !AESSupported())
         return "";
 
-    QCA::InitializationVector iv(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9"));
-    QCA::SymmetricKey k(QCA::hexToArray(key));
-    QCA::SecureArray dataToEncrypt = data.toAscii();
-    QCA::Cipher cipher = QCA::Cipher(QString("aes256"), QCA::Cipher::CBC,
-            QCA::Cipher::DefaultPadding, QCA::Encode, k, iv);
-
-    QCA::SecureArray result = cipher.process(dataToEncrypt);
-    if (!cipher.ok())
+    bool ok;
+    QCA::SecureArray result = cache()->context(key)->
+            process(QCA::Encode, data.toAscii(), &ok);
+    if (!ok)
         return "";
 
     return QString(qPrintable(QCA::arrayToHex(result.toByteArray())));
@@ -169,107 +459,218 @@ QString Security::AESEncrypt(const QString &data, const QString &key)
 
 QString Security::AESDecrypt(const QString &data, const QString &key)
 {
-    QCA::Initializer init;
-    if (!QCA::isSupported("aes256-cbc-pkcs7") || key.length() != 64)
+    if (key.length() != 64 || !AESSupported())
         return "";
 
-    QCA::InitializationVector iv(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9"));
-    QCA::SymmetricKey k(QCA::hexToArray(key));
-    QCA::SecureArray dataToDecrypt = QCA::hexToArray(data);
-    QCA::Cipher cipher = QCA::Cipher(QString("aes256"), QCA::Cipher::CBC,
-            QCA::Cipher::DefaultPadding, QCA::Decode, k, iv);
-
-    QCA::SecureArray result = cipher.process(dataToDecrypt);
-    if (!cipher.ok())
+    bool ok;
+    QCA::SecureArray result = cache()->context(key)->
+            process(QCA::Decode, QCA::hexToArray(data), &ok);
+    if (!ok)
         return "";
 
     return QString(result.data());
 }
 
+QByteArray Security::AESEncryptBytes(const QByteArray &data,
+                                     const QString &key, int profile,
+                                     const QByteArray &context)
+{
+    if (key.length() != 64 || !AESSupported())
+        return QByteArray();
+
+    CipherContext *cipher = cache()->context(key);
+    if (profile == CTRProfile)
+    {
+        if (!CTRSupported())
+            return QByteArray();
+        //nonce, ciphertext, truncated HMAC of context, nonce and ciphertext
+        QByteArray nonce = QCA::Random::randomArray(nonceSize).toByteArray();
+        QByteArray stream = cipher->keystream(QList<QByteArray>() << nonce,
+                                              QList<int>() << data.size());
+        QByteArray result = nonce;
+        result.reserve(nonceSize + data.size() + tagSize);
+        for (int i=0; i<data.size(); i++)
+            result.append((char)(data.at(i) ^ stream.at(i)));
+        result.append(cipher->tag(context, nonce,
+                                  result.constData() + nonceSize, data.size()));
+        return result;
+    }
+
+    bool ok;
+    QCA::SecureArray result = cipher->process(QCA::Encode, data, &ok);
+    if (!ok)
+        return QByteArray();
+
+    return result.toByteArray();
+}
+
+//a null result means the data could not be decrypted, an empty one
+//that it decrypted to nothing
+QByteArray Security::AESDecryptBytes(const QByteArray &data,
+                                     const QString &key, int profile,
+                                     const QByteArray &context)
+{
+    if (profile == CTRProfile)
+        return AESDecryptBatch(QList<QByteArray>() << data, key, profile,
+                               QList<QByteArray>() << context).first();
+
+    if (data.isEmpty())
+        return QByteArray("");
+    if (key.length() != 64 || !AESSupported())
+        return QByteArray();
+
+    bool ok;
+    QCA::SecureArray result = cache()->context(key)->
+            process(QCA::Decode, data, &ok);
+    if (!ok)
+        return QByteArray();
+
+    QByteArray plain = result.toByteArray();
+    return plain.isNull()?QByteArray(""):plain;
+}
+
+//contexts are matched to data by position, missing ones are empty
+QList<QByteArray> Security::AESDecryptBatch(const QList<QByteArray> &data,
+                                            const QString &key, int profile,
+                                            const QList<QByteArray> &contexts)
+{
+    QList<QByteArray> result;
+    if (profile != CTRProfile)
+    {
+        for (int i=0; i<data.size(); i++)
+            result.append(AESDecryptBytes(data.at(i), key, profile));
+        return result;
+    }
+
+    for (int i=0; i<data.size(); i++)
+        result.append(data.at(i).isEmpty()?QByteArray(""):QByteArray());
+    if (key.length() != 64 || !AESSupported() || !CTRSupported())
+        return result;
+
+    QList<QByteArray> nonces;
+    QList<int> lengths;
+    for (int i=0; i<data.size(); i++)
+    {
+        int size = data.at(i).size() - nonceSize - tagSize;
+        nonces.append(data.at(i).left(nonceSize));
+        lengths.append(qMax(size, 0));
+    }
+
+    CipherContext *context = cache()->context(key);
+    QByteArray stream = context->keystream(nonces, lengths);
+    int offset = 0;
+    for (int i=0; i<data.size(); i++)
+    {
+        int size = lengths.at(i);
+        const char *cipherText = data.at(i).constData() + nonceSize;
+        if (data.at(i).size() >= nonceSize + tagSize &&
+            sameTag(context->tag(contexts.value(i), nonces.at(i),
+                                 cipherText, size),
+                    cipherText + size))
+        {
+            QByteArray plain("");
+            plain.resize(size);
+            char *p = plain.data();
+            const char *s = stream.constData() + offset;
+            for (int j=0; j<size; j++)
+                p[j] = cipherText[j] ^ s[j];
+            result[i] = plain;
+        }
+        offset += (size + blockSize - 1) / blockSize * blockSize;
+    }
+    return result;
+}
+
+//where a cell is stored; the ctr-hmac tag covers it, so a ciphertext
+//copied to another table, row or column no longer verifies
+QByteArray Security::cellContext(int table, int row, int column)
+{
+    QByteArray context(12, 0);
+    uchar *p = (uchar*)context.data();
+    qToBigEndian<qint32>(table, p);
+    qToBigEndian<qint32>(row, p + 4);
+    qToBigEndian<qint32>(column, p + 8);
+    return context;
+}
+
 QString Security::RSAEncrypt(const QString &data, const QString &pubkey)
 {
-    QCA::Initializer init;
-    if (!QCA::isSupported("pkey"))
+    if (!PKeySupported())
         return "";
 
-    QStringList pubKeyParam = pubkey.split('|');
-    if (pubKeyParam.length() != 2)
-        return "";
-    
-    QCA::RSAPublicKey key = QCA::RSAPublicKey(pubKeyParam.at(0), 
-                                              pubKeyParam.at(1));
-    if (!key.canEncrypt())
+    QCA::RSAPublicKey *key = cache()->publicKey(pubkey);
+    if (key == 0 || !key->canEncrypt())
         return "";
 
     QCA::SecureArray dataToEncrypt = data.toAscii();
-    QCA::SecureArray result = key.encrypt(dataToEncrypt, QCA::EME_PKCS1_OAEP);
+    QCA::SecureArray result = key->encrypt(dataToEncrypt, QCA::EME_PKCS1_OAEP);
 
     return QString(qPrintable(QCA::arrayToHex(result.toByteArray())));
 }
 
 QString Security::RSADecrypt(const QString &data, const QString &prvkey, const QString &passphrase)
 {
-    QCA::Initializer init;
-    if (passphrase.length() != 64 || !QCA::isSupported("pkey"))
-        return "";
-
-    QStringList prvKeyParam = AESDecrypt(prvkey, passphrase).split('|');
-    if (prvKeyParam.length() != 5)
+    if (passphrase.length() != 64 || !PKeySupported())
         return "";
 
-    QCA::RSAPrivateKey key = QCA::RSAPrivateKey(prvKeyParam.at(0), 
-                                                prvKeyParam.at(1),
-                                                prvKeyParam.at(2),
-                                                prvKeyParam.at(3),
-                                                prvKeyParam.at(4));
-    if (!key.canDecrypt())
+    QCA::RSAPrivateKey *key = cache()->privateKey(prvkey, passphrase);
+    if (key == 0 || !key->canDecrypt())
         return "";
 
     QCA::SecureArray dataToDecrypt = QCA::hexToArray(data);
     QCA::SecureArray result;
-    if (key.decrypt(dataToDecrypt, &result, QCA::EME_PKCS1_OAEP))
+    if (key->decrypt(dataToDecrypt, &result, QCA::EME_PKCS1_OAEP))
         return QString(result.data());
     else
         return "";
 }
 
+QString Security::RSASign(const QString &data,
+                          const QString &prvKeyData,
+                          const QString &passphrase)
+{
+    if (passphrase.length() != 64 || !PKeySupported())
+        return "";
+
+    QCA::RSAPrivateKey *key = cache()->privateKey(prvKeyData, passphrase);
+    if (key == 0 || !key->canSign())
+        return "";
+
+    key->startSign(QCA::EMSA3_SHA1);
+    key->update(QCA::SecureArray(QCA::hexToArray(data)));
+    return QString(qPrintable(QCA::arrayToHex(key->signature())));
+}
+
 bool Security::RSAVerifySignature(const QString &data, 
                                   const QString &signedData, 
                                   const QString &pubKeyData)
 {
-    QCA::Initializer init;
-    if (!QCA::isSupported("pkey"))
-        return "";
-    
-    QStringList pubKeyParam = pubKeyData.split('|');
-    if (pubKeyParam.length() != 2)
-        return "";
+    if (!PKeySupported())
+        return false;
     
-    QCA::RSAPublicKey key = QCA::RSAPublicKey(pubKeyParam.at(0), 
-                                              pubKeyParam.at(1));
-    if (!key.canEncrypt())
-        return "";
+    QCA::RSAPublicKey *key = cache()->publicKey(pubKeyData);
+    if (key == 0 || !key->canEncrypt())
+        return false;
     
-    key.startVerify(QCA::EMSA3_SHA1);
-    key.update(QCA::SecureArray(QCA::hexToArray(data)));
-    return key.validSignature(QCA::hexToArray(signedData));
+    key->startVerify(QCA::EMSA3_SHA1);
+    key->update(QCA::SecureArray(QCA::hexToArray(data)));
+    return key->validSignature(QCA::hexToArray(signedData));
 }
 
 QString Security::getHash(const QString &text)
 {
-    QCA::Initializer init;
-    if(!QCA::isSupported("sha256"))
+    if(!hashSupported())
         return "";
 
-    QCA::Hash hash = QCA::Hash("sha256");
+    QCA::Hash &hash = cache()->hash;
+    hash.clear();
     hash.update(text.toAscii());
     return hash.hashToString(hash.final());
 }
 
 QString Security::generateAESKey()
 {
-    QCA::Initializer init;
-    if (!QCA::isSupported("aes256-cbc-pkcs7"))
+    if (!AESSupported())
         return "";
 
     QCA::SymmetricKey rndkey(32);
@@ -278,8 +679,7 @@ QString Security::generateAESKey()
 
 QPair<QString,QString> Security::generateKeyPair(const QString &passphrase)
 {
-    QCA::Initializer init;
-    if(!QCA::isSupported("pkey") ||
+    if(!PKeySupported() ||
            !QCA::PKey::supportedIOTypes().contains(QCA::PKey::RSA))
         return QPair<QString,QString>();
 
@@ -297,3 +697,23 @@ QPair<QString,QString> Security::generateKeyPair(const QString &passphrase)
     
     return QPair<QString, QString>(pubkeyData, AESEncrypt(prvkeyData, passphrase));
 }
+
+QString Security::prepareKey(const QString &prvKeyData,
+                             const QString &passphrase)
+{
+    if (passphrase.length() != 64 || !PKeySupported())
+        return "";
+
+    QCA::RSAPrivateKey *key = cache()->privateKey(prvKeyData, passphrase);
+    if (key == 0)
+        return "";
+
+    QCA::SecureArray der = key->toDER(passphrase.toAscii());
+    return QString(qPrintable(QCA::arrayToHex(der.toByteArray())));
+}
+
+QString Security::keySource(const QString &pubKeyData,
+                            const QString &prvKeyData)
+{
+    return getHash(pubKeyData + '|' + prvKeyData);
+}
@@ -7,6 +7,8 @@
 class Security
 {
 public:
+    enum CipherProfile { CBCProfile = 0, CTRProfile = 1 };
+
     Security();
     ~Security();
 
@@ -21,16 +23,36 @@ public:
     QString RSAEncrypt(const QString &data) const;
     QString RSADecrypt(const QString &data) const;
     QString RSASign(const QString &data) const;
+    QString preparedKey(const QString &passphrase) const;
+    bool setPreparedKey(const QString &preparedKey,
+                        const QString &passphrase);
 
     static QString AESEncrypt(const QString &data,
                               const QString &key);
     static QString AESDecrypt(const QString &data,
                               const QString &key);
+    static QByteArray AESEncryptBytes(const QByteArray &data,
+                                      const QString &key,
+                                      int profile = CBCProfile,
+                                      const QByteArray &context = QByteArray());
+    static QByteArray AESDecryptBytes(const QByteArray &data,
+                                      const QString &key,
+                                      int profile = CBCProfile,
+                                      const QByteArray &context = QByteArray());
+    static QList<QByteArray> AESDecryptBatch(const QList<QByteArray> &data,
+                                             const QString &key,
+                                             int profile = CBCProfile,
+                                             const QList<QByteArray> &contexts =
+                                                 QList<QByteArray>());
+    static QByteArray cellContext(int table, int row, int column = -1);
     static QString RSAEncrypt(const QString &data,
                               const QString &pubkeyData);
     static QString RSADecrypt(const QString &data,
                               const QString &prvkeyData,
                               const QString &passphrase);
+    static QString RSASign(const QString &data,
+                           const QString &prvKeyData,
+                           const QString &passphrase);
     static bool RSAVerifySignature(const QString &data,
                             const QString &signedData,
                             const QString &pubKeyData);
@@ -38,9 +60,13 @@ public:
     static QString generateAESKey();
     static QPair<QString, QString>
         generateKeyPair(const QString &passphrase);
+    static QString prepareKey(const QString &prvKeyData,
+                              const QString &passphrase);
+    static QString keySource(const QString &pubKeyData,
+                             const QString &prvKeyData);
+    static void clearKeyCache();
 
 private:
-    QCA::Initializer *init;
     QCA::SymmetricKey *AESkey;
     QCA::InitializationVector *AESiv;
     QCA::Cipher *AEScipher;
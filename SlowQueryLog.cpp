@@ -0,0 +1,182 @@
+#include "SlowQueryLog.h"
+
+//longer strings are keys, hashes or hex encoded cells
+static const int maxPlainLength = 32;
+
+SlowQueryLog::SlowQueryLog(const QString &fileName, int thresholdMsecs,
+                           qint64 maxBytes, int maxFiles)
+{
+    file_name = fileName;
+    threshold_usecs = (qint64)thresholdMsecs * 1000;
+    max_bytes = maxBytes;
+    max_files = qMax(1, maxFiles);
+}
+
+SlowQueryLog::~SlowQueryLog()
+{
+    for (int i=0; i<explain_connections.size(); i++)
+    {
+        QSqlDatabase::database(explain_connections.at(i), false).close();
+        QSqlDatabase::removeDatabase(explain_connections.at(i));
+    }
+}
+
+bool SlowQueryLog::isSlow(qint64 usecs) const
+{
+    return threshold_usecs > 0 && usecs >= threshold_usecs;
+}
+
+//cell payloads never reach the log, only their size
+QString SlowQueryLog::redact(const QVariant &value)
+{
+    if (value.isNull())
+        return "NULL";
+    if (value.type() == QVariant::ByteArray)
+        return QString("<%1 bytes>").arg(value.toByteArray().size());
+    if (value.type() == QVariant::String)
+    {
+        QString text = value.toString();
+        if (text.size() > maxPlainLength)
+            return QString("<%1 chars>").arg(text.size());
+        return QString("'%1'").arg(text);
+    }
+    return value.toString();
+}
+
+//QPSQL runs prepared statements as PREPARE ... AS, which EXPLAIN can't
+//be part of, so the bound values are written into the text instead
+QString SlowQueryLog::inlineValues(QSqlDatabase db, const QSqlQuery &query)
+{
+    QString sql = query.lastQuery();
+    QStringList names = query.boundValues().keys();
+    //longest first, so :row is not replaced inside :rows
+    for (int i=0; i<names.size(); i++)
+        for (int j=i+1; j<names.size(); j++)
+            if (names.at(j).size() > names.at(i).size())
+                names.swap(i, j);
+    for (int i=0; i<names.size(); i++)
+    {
+        QVariant value = query.boundValue(names.at(i));
+        QSqlField field(QString(), value.type());
+        field.setValue(value);
+        sql.replace(names.at(i), db.driver()->formatValue(field));
+    }
+    return sql;
+}
+
+//the plan without running the statement, on a clone of the connection:
+//the slow one may be inside a transaction that a failed EXPLAIN or the
+//PLAN_TABLE insert of Oracle would otherwise become part of
+QStringList SlowQueryLog::explain(QSqlDatabase db, const QSqlQuery &query)
+{
+    QStringList plan;
+    QString sql = query.lastQuery().trimmed();
+    QString verb = sql.section(' ', 0, 0).toUpper();
+    if (verb != "SELECT" && verb != "INSERT" &&
+        verb != "UPDATE" && verb != "DELETE")
+        return plan;
+
+    QString driver = db.driverName();
+    QString prefix;
+    if (driver == "QSQLITE")
+        prefix = "EXPLAIN QUERY PLAN ";
+    else if (driver == "QMYSQL" || driver == "QPSQL")
+        prefix = "EXPLAIN ";
+    else if (driver == "QOCI")
+        prefix = "EXPLAIN PLAN SET STATEMENT_ID = 'slow_query_log' FOR ";
+    else
+        return plan;
+
+    QString name = QString("%1_explain").arg(db.connectionName());
+    QSqlDatabase clone = QSqlDatabase::database(name, false);
+    if (!clone.isValid())
+    {
+        clone = QSqlDatabase::cloneDatabase(db, name);
+        explain_connections << name;
+    }
+    if (!clone.isOpen() && !clone.open())
+    {
+        plan << QString("EXPLAIN failed: %1").arg(clone.lastError().text());
+        return plan;
+    }
+
+    QSqlQuery explain(clone);
+    bool ok;
+    if (driver == "QPSQL")
+        ok = explain.exec(prefix + inlineValues(db, query));
+    else
+    {
+        explain.prepare(prefix + sql);
+        QMapIterator<QString, QVariant> it(query.boundValues());
+        while (it.hasNext())
+        {
+            it.next();
+            explain.bindValue(it.key(), it.value());
+        }
+        ok = explain.exec();
+    }
+    if (ok && driver == "QOCI")
+        ok = explain.exec("SELECT plan_table_output FROM TABLE("
+                          "DBMS_XPLAN.DISPLAY('PLAN_TABLE', 'slow_query_log'))");
+    if (!ok)
+    {
+        plan << QString("EXPLAIN failed: %1").arg(explain.lastError().text());
+        return plan;
+    }
+    int fields = explain.record().count();
+    while (explain.next())
+    {
+        QStringList row;
+        for (int i=0; i<fields; i++)
+            row << explain.value(i).toString();
+        plan << row.join(" | ");
+    }
+    if (driver == "QOCI")
+        explain.exec("DELETE FROM plan_table "
+                     "WHERE statement_id = 'slow_query_log'");
+    return plan;
+}
+
+//a failed statement has no plan worth asking for
+void SlowQueryLog::record(QSqlDatabase db, const QSqlQuery &query,
+                          const QString &kind, qint64 usecs, bool ok)
+{
+    QString entry = QString("%1 %2 %3 ms\n").
+            arg(QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz")).
+            arg(kind).arg(usecs / 1000.0, 0, 'f', 1);
+    entry.append(query.lastQuery().simplified()).append("\n");
+    QMapIterator<QString, QVariant> it(query.boundValues());
+    while (it.hasNext())
+    {
+        it.next();
+        entry.append(QString("  %1 = %2\n").arg(it.key()).arg(redact(it.value())));
+    }
+    //the error text of a failed statement may quote the values it rejected
+    if (!ok)
+        entry.append("failed, no plan\n");
+    QStringList plan = ok?explain(db, query):QStringList();
+    if (!plan.isEmpty())
+        entry.append("plan:\n  ").append(plan.join("\n  ")).append("\n");
+    entry.append("\n");
+
+    rotate();
+    QFile file(file_name);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return;
+    file.write(entry.toUtf8());
+}
+
+//log, log.1 ... log.<max_files-1>, the oldest is dropped
+void SlowQueryLog::rotate()
+{
+    if (QFileInfo(file_name).size() < max_bytes)
+        return;
+    QFile::remove(QString("%1.%2").arg(file_name).arg(max_files - 1));
+    for (int i=max_files-2; i>0; i--)
+        QFile::rename(QString("%1.%2").arg(file_name).arg(i),
+                      QString("%1.%2").arg(file_name).arg(i+1));
+    if (max_files > 1)
+        QFile::rename(file_name, QString("%1.1").arg(file_name));
+    else
+        QFile::remove(file_name);
+}
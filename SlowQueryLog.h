@@ -0,0 +1,34 @@
+#ifndef SLOWQUERYLOG_H
+#define SLOWQUERYLOG_H
+
+#include <QtCore>
+#include <QtSql>
+
+//statements over a latency threshold, with redacted parameters and the
+//plan the server chose, appended to a log file rotated by size
+class SlowQueryLog
+{
+public:
+    SlowQueryLog(const QString &fileName, int thresholdMsecs,
+                 qint64 maxBytes = 1024 * 1024, int maxFiles = 3);
+    ~SlowQueryLog();
+
+    bool isSlow(qint64 usecs) const;
+    void record(QSqlDatabase db, const QSqlQuery &query,
+                const QString &kind, qint64 usecs, bool ok);
+
+    static QString redact(const QVariant &value);
+    QStringList explain(QSqlDatabase db, const QSqlQuery &query);
+
+private:
+    QString file_name;
+    qint64 threshold_usecs;
+    qint64 max_bytes;
+    int max_files;
+    QStringList explain_connections;
+
+    void rotate();
+    static QString inlineValues(QSqlDatabase db, const QSqlQuery &query);
+};
+
+#endif // SLOWQUERYLOG_H
@@ -1,5 +1,51 @@
 #include "SpreadSheet.h"
 #include "Cell.h"
+#include "SpreadSheetPrinter.h"
+#include "Trace.h"
+
+static const char *cellsMimeType = "application/x-studentevaluationmanager-cells";
+
+//Qt4 allocation overheads on 64-bit, the memory report is an estimate
+static const int stringHeaderBytes = 24;
+static const int itemDataBytes = 24;
+static const int mapNodeBytes = 48;
+static const int fontBytes = 128;
+static const int brushBytes = 64;
+
+qint64 SheetMemory::stringBytes(const QString &text)
+{
+    if (text.isNull())
+        return 0;
+    return stringHeaderBytes + text.capacity() * sizeof(QChar);
+}
+
+SheetMemory::SheetMemory() :
+    items(0), itemBytes(0), formulaBytes(0), styleBytes(0),
+    timestampBytes(0), headerBytes(0), decodedBytes(0), keyCacheBytes(0) {}
+
+qint64 SheetMemory::total() const
+{
+    return itemBytes + formulaBytes + styleBytes + timestampBytes +
+           headerBytes + decodedBytes + keyCacheBytes;
+}
+
+QString SheetMemory::toString() const
+{
+    QString result;
+    result.append(QString("items\t%1\t%2 KB\n").arg(items).
+                  arg(itemBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("formulas\t\t%1 KB\n").arg(formulaBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("styles\t\t%1 KB\n").arg(styleBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("timestamps\t\t%1 KB\n").
+                  arg(timestampBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("headers\t\t%1 KB\n").arg(headerBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("decoded rows\t\t%1 KB\n").
+                  arg(decodedBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("access keys\t\t%1 KB\n").
+                  arg(keyCacheBytes / 1024.0, 0, 'f', 1));
+    result.append(QString("total\t\t%1 KB\n").arg(total() / 1024.0, 0, 'f', 1));
+    return result;
+}
 
 SpreadSheet::SpreadSheet(int rows, int columns, QWidget *parent,
                          const DBManager *const mng) : 
@@ -11,13 +57,20 @@ SpreadSheet::SpreadSheet(int rows, int columns, QWidget *parent,
     setItemPrototype(new Cell());
     setSelectionMode(ExtendedSelection);
     setContextMenuPolicy(Qt::ActionsContextMenu);
-    this->mng = mng;
+    links = mng;
 
     refresh_timer = new QTimer(this);
     refresh_timer->start(5000);
 
     timestamps = new QMap<int,QString>();
 
+    update_depth = 0;
+    dirty = false;
+    repaints = 0;
+    refresh_start_repaints = 0;
+    last_refresh_repaints = 0;
+    last_paint_usecs = -1;
+
     connect(this, SIGNAL(itemChanged(QTableWidgetItem *)),
             this, SLOT(somethingChanged(QTableWidgetItem *)));
 
@@ -50,100 +103,10 @@ bool SpreadSheet::printSpreadSheet(const QString &fileName) const
     if (fname.right(4) != ".pdf")
         fname.append(".pdf");
     
-    QPrinter printer;
-    printer.setOutputFormat(QPrinter::PdfFormat);
-    printer.setOutputFileName(fname);
-    int width = printer.width();
-    int sWidth = 0;
-    for (int i=0; i<columnCount(); i++)
-        sWidth += columnWidth(i);
-    int diff = (width - sWidth) / columnCount();
-    
-    QPainter painter;
-    
-    if (!painter.begin(&printer))
-        return false;
-    
-    int x = 0;
-    int y = 0;
-    int incrY = 0;
-    int row_height = 20;
-    QBrush brush = painter.brush();
-    painter.setPen(QPen(QBrush(Qt::black), 0.5));
-    QPen pen = painter.pen();
-    
-    for (int i=-1; i<rowCount(); i++)
-    {
-        x = 0;
-        incrY = 0;
-        for (int j=0; j<columnCount(); j++)
-        {
-            QRect required = QRect();
-            QRect r = QRect(x, y, columnWidth(j)+diff, row_height);
-            painter.setBrush(cell(i,j)->background());
-            painter.drawRect(r);
-            r.setX(r.x()+2);
-            r.setWidth(r.width()-4);
-            painter.setBrush(brush);
-            QString text = (!cell(i,j))?"":cell(i,j)->text();
-            painter.setFont(!(cell(i,j))?font():cell(i,j)->font());
-            painter.setPen(cell(i,j)->foreground().color());
-            painter.drawText(r, cell(i,j)->textAlignment() | Qt::TextWrapAnywhere,
-                             text, &required);
-            painter.setPen(pen.color());
-            r.setX(r.x()-2);
-            r.setWidth(r.width()+4);
-            
-            if (required.height() > r.height())
-            {
-                painter.eraseRect(r.x(), r.y(), r.width(), r.height()+1);
-                incrY = required.height() - r.height();
-                int aux_height = row_height;
-                row_height = required.height();
-                r.setHeight(row_height);
-                painter.setBrush(cell(i,j)->background());
-                painter.drawRect(r);
-                r.setX(r.x()+2);
-                r.setWidth(r.width()-4);
-                painter.setBrush(brush);
-                painter.setPen(cell(i,j)->foreground().color());
-                painter.drawText(r, cell(i,j)->textAlignment() | Qt::TextWrapAnywhere, text);
-                painter.setPen(pen.color());
-                
-                int aux_x = x;
-                for (int k=j-1; k>=0; k--)
-                {
-                    aux_x -= columnWidth(k)+diff;
-                    r = QRect(aux_x, y, columnWidth(k)+diff, aux_height+1);
-                    painter.eraseRect(r);
-                    r.setHeight(row_height);
-                    painter.setBrush(cell(i,k)->background());
-                    painter.drawRect(r);
-                    r.setX(r.x()+2);
-                    r.setWidth(r.width()-4);
-                    painter.setBrush(brush);
-                    
-                    text = (!cell(i,k))?"":cell(i,k)->text();
-                    painter.setFont(!(cell(i,k))?font():cell(i,k)->font());
-                    painter.setPen(cell(i,k)->foreground().color());
-                    painter.drawText(r, cell(i,k)->textAlignment() | Qt::TextWrapAnywhere,
-                                     text);
-                    painter.setPen(pen.color());
-                }
-            }
-            x += columnWidth(j)+diff;
-        }
-        row_height = 20;
-        if (y >= printer.height()-row_height)
-        {
-            printer.newPage();
-            y = 0;
-        }
-        else
-            y += row_height + incrY;
-    }
-    painter.end();
-    return true;
+    SpreadSheetPrinter printer(this);
+    connect(&printer, SIGNAL(progress(int,int)),
+            this, SIGNAL(printProgress(int,int)));
+    return printer.print(fname);
 }
 
 QString SpreadSheet::currentLocation() const
@@ -158,26 +121,39 @@ QString SpreadSheet::getLocation(int row, int column) const
     return QChar('A' + column) + QString::number(row + 1);
 }
 
-bool SpreadSheet::selectionsEquals(const QMultiMap<int, int> &first, 
-                                   const QMultiMap<int, int> &second)
+static bool rangeLessThan(const QTableWidgetSelectionRange &first,
+                          const QTableWidgetSelectionRange &second)
+{
+    if (first.topRow() != second.topRow())
+        return first.topRow() < second.topRow();
+    return first.leftColumn() < second.leftColumn();
+}
+
+bool SpreadSheet::selectionsEquals(const QList<QTableWidgetSelectionRange> &first,
+                                   const QList<QTableWidgetSelectionRange> &second)
 {
-    QList<int> firstUniqueKeys = first.uniqueKeys();
-    QList<int> secondUniqueKeys = second.uniqueKeys();
-    if (firstUniqueKeys.size() != secondUniqueKeys.size())
+    if (first.size() != second.size())
         return false;
-    
-    QList<int> firstColumnsSize = QList<int>();
-    QListIterator<int> firstIt(firstUniqueKeys);
-    while (firstIt.hasNext())
-        firstColumnsSize.append(first.values(firstIt.next()).size());
-    
-    QList<int> secondColumnsSize = QList<int>();
-    QListIterator<int> secondIt(secondUniqueKeys);
-    while (secondIt.hasNext())
-        secondColumnsSize.append(second.values(secondIt.next()).size());
-    
-    return qEqual(firstColumnsSize.begin(), firstColumnsSize.end(),
-                  secondColumnsSize.begin());
+
+    for (int i=0; i<first.size(); i++)
+        if (first.at(i).rowCount() != second.at(i).rowCount() ||
+            first.at(i).columnCount() != second.at(i).columnCount())
+            return false;
+    return true;
+}
+
+bool SpreadSheet::selectionContains(const QList<QTableWidgetSelectionRange> &selection,
+                                    int row, int column)
+{
+    QListIterator<QTableWidgetSelectionRange> it(selection);
+    while (it.hasNext())
+    {
+        const QTableWidgetSelectionRange &range = it.next();
+        if (row >= range.topRow() && row <= range.bottomRow() &&
+            column >= range.leftColumn() && column <= range.rightColumn())
+            return true;
+    }
+    return false;
 }
 
 QString SpreadSheet::currentFormula() const
@@ -196,31 +172,10 @@ QPair<int,int> SpreadSheet::getLocation(const QString &cellId)
         return QPair<int,int>(-1,-1);
 }
 
-QMultiMap<int,int> SpreadSheet::selectedItemIndexes() const
+QList<QTableWidgetSelectionRange> SpreadSheet::selectedItemRanges() const
 {
-    QMultiMap<int,int> result = QMultiMap<int,int>();
-    QMultiMap<int,int> aux = QMultiMap<int,int>();
-    
-    QModelIndexList idxs = selectedIndexes();
-    QListIterator<QModelIndex> it(idxs);
-    while (it.hasNext())
-    {
-        QModelIndex idx = it.next();
-        aux.insert(idx.row(), idx.column());
-    }
-    
-    QList<int> rows = aux.uniqueKeys();
-    QListIterator<int> rowsIt(rows);
-    while (rowsIt.hasNext())
-    {
-        int row = rowsIt.next();
-        QList<int> columns = aux.values(row);
-        qSort(columns.begin(), columns.end(), qGreater<int>());
-        QListIterator<int> columnsIt(columns);
-        while (columnsIt.hasNext())
-            result.insert(row, columnsIt.next());
-    }
-    
+    QList<QTableWidgetSelectionRange> result = selectedRanges();
+    qSort(result.begin(), result.end(), rangeLessThan);
     return result;
 }
 
@@ -267,8 +222,11 @@ void SpreadSheet::setCellsSize(const QSize &size)
 }
 
 void SpreadSheet::setFormula(const QString &formula, 
-                             const QMultiMap<int, int> &selection)
+                             const QList<QTableWidgetSelectionRange> &selection)
 {
+    if (selection.isEmpty())
+        return;
+
     QRegExp pattern("[A-Z][1-9][0-9]*");
     int pos = 0;
     QStringList ids = QStringList();
@@ -283,59 +241,68 @@ void SpreadSheet::setFormula(const QString &formula,
         pos += pattern.matchedLength();
     }
 
-    QMapIterator<int,int> it(selection);
-    it.next();
-    int firstRow = it.key();
-    int firstColumn = it.value();
+    beginUpdate();
+    int firstRow = selection.first().topRow();
+    int firstColumn = selection.first().leftColumn();
     setFormula(firstRow, firstColumn, formula);
+    QListIterator<QTableWidgetSelectionRange> it(selection);
     while (it.hasNext())
     {
-        it.next();  
-        QString result = formula;
-        for (int i=0; i<ids.length(); i++)
-        {
-            QPair<int,int> position = positions.at(i);
-            QString new_id = getLocation(position.first+it.key()-firstRow, 
-                                         position.second+it.value()-firstColumn);
-            if (!new_id.isEmpty())
-                result.replace(ids_pos.at(i), ids.at(i).length(),
-                               new_id);
-        }
-        setFormula(it.key(), it.value(), result);
+        const QTableWidgetSelectionRange &range = it.next();
+        for (int row=range.topRow(); row<=range.bottomRow(); row++)
+            for (int col=range.leftColumn(); col<=range.rightColumn(); col++)
+            {
+                if (row == firstRow && col == firstColumn)
+                    continue;
+                QString result = formula;
+                for (int i=ids.length()-1; i>=0; i--)
+                {
+                    QPair<int,int> position = positions.at(i);
+                    QString new_id = getLocation(position.first+row-firstRow,
+                                                 position.second+col-firstColumn);
+                    if (!new_id.isEmpty())
+                        result.replace(ids_pos.at(i), ids.at(i).length(),
+                                       new_id);
+                }
+                setFormula(row, col, result);
+            }
     }
+    endUpdate();
 }
 
 void SpreadSheet::setFormula(const QString &table, 
-                             const QMultiMap<int, int> &from, 
-                             const QMultiMap<int, int> &to)
+                             const QList<QTableWidgetSelectionRange> &from,
+                             const QList<QTableWidgetSelectionRange> &to)
 {
     if (!selectionsEquals(from, to))
         return;
     
-    QMapIterator<int,int> fromIt(from), toIt(to);
-    while (fromIt.hasNext() && toIt.hasNext())
+    beginUpdate();
+    for (int i=0; i<from.size(); i++)
     {
-        fromIt.next();
-        toIt.next();
-        
-        QString link = QString("=%1:%2").arg(table).
-                arg(getLocation(fromIt.key(), fromIt.value()));
-        setFormula(toIt.key(), toIt.value(), link);
+        const QTableWidgetSelectionRange &fromRange = from.at(i);
+        const QTableWidgetSelectionRange &toRange = to.at(i);
+        for (int r=0; r<fromRange.rowCount(); r++)
+            for (int c=0; c<fromRange.columnCount(); c++)
+            {
+                QString link = QString("=%1:%2").arg(table).
+                        arg(getLocation(fromRange.topRow()+r,
+                                        fromRange.leftColumn()+c));
+                setFormula(toRange.topRow()+r, toRange.leftColumn()+c, link);
+            }
     }
+    endUpdate();
 }
 
 QList<int> SpreadSheet::selectedColumns()
 {
-    int current_col = -1;
     QList<int> aux = QList<int>();
 
-    QList<QTableWidgetItem*> columns = selectedItems();
-    for (int i=0; i<columns.length(); i++)
-    {
-        current_col = column(columns.at(i));
-        if (!aux.contains(current_col))
-            aux.append(current_col);
-    }
+    QList<QTableWidgetSelectionRange> ranges = selectedRanges();
+    for (int i=0; i<ranges.length(); i++)
+        for (int col=ranges.at(i).leftColumn(); col<=ranges.at(i).rightColumn(); col++)
+            if (!aux.contains(col))
+                aux.append(col);
     qSort(aux);
 
     return aux;
@@ -384,12 +351,22 @@ QFont SpreadSheet::currentFont() const
         return QApplication::font();
 }
 
+QVariant SpreadSheet::cellValue(int row, int column) const
+{
+    if (row < 0 || column < 0 || row >= rowCount() || column >= columnCount())
+        return "#####";
+    const QTableWidgetItem *value = item(row, column);
+    if (value == 0)
+        return "#####";
+    return value->data(Qt::DisplayRole);
+}
+
 QString SpreadSheet::getLinkData(const QString &formula,
                     const QHash<QString,QString> &matches) const
 {
-    if (mng)
+    if (links)
     {
-        QHash<QString,QString> values = mng->getLinkData(matches);
+        QHash<QString,QString> values = links->getLinkData(matches);
         QString result = formula;
         QHashIterator<QString,QString> it(values);
         while (it.hasNext())
@@ -397,18 +374,83 @@ QString SpreadSheet::getLinkData(const QString &formula,
             it.next();
             result.replace(it.key(), it.value());
         }
-        QString val;
-        QFont f;
-        QBrush b;
-        QByteArray cellData = QCA::hexToArray(result);
-        QDataStream in(&cellData, QIODevice::ReadOnly);
-        in >> f >> b >> b >> val;
-        return val;
+        return result;
     }
     else
         return "#####";
 }
 
+void SpreadSheet::setLinkProvider(const LinkProvider *provider)
+{
+    links = provider;
+}
+
+void SpreadSheet::beginUpdate()
+{
+    if (update_depth == 0)
+        refresh_start_repaints = repaints;
+    update_depth++;
+}
+
+void SpreadSheet::endUpdate()
+{
+    if (update_depth == 0)
+        return;
+    update_depth--;
+    if (update_depth > 0)
+        return;
+
+    if (dirty)
+    {
+        dirty = false;
+        repaintViewport();
+    }
+    last_refresh_repaints = repaints - refresh_start_repaints;
+    emit updateFinished(last_refresh_repaints);
+}
+
+void SpreadSheet::markDirty()
+{
+    if (update_depth > 0)
+        dirty = true;
+    else
+        repaintViewport();
+}
+
+int SpreadSheet::repaintCount() const
+{
+    return repaints;
+}
+
+int SpreadSheet::lastRefreshRepaints() const
+{
+    return last_refresh_repaints;
+}
+
+void SpreadSheet::repaintViewport()
+{
+    repaints++;
+    if (Trace::isEnabled())
+        Trace::instant("repaint request", "ui",
+                       QString("\"depth\": %1").arg(update_depth));
+    viewport()->update();
+}
+
+void SpreadSheet::paintEvent(QPaintEvent *event)
+{
+    TraceSpan span("paint", "ui");
+    QElapsedTimer clock;
+    clock.start();
+    QTableWidget::paintEvent(event);
+    last_paint_usecs = clock.nsecsElapsed() / 1000;
+}
+
+//painting evaluates the formulas of every visible cell
+qint64 SpreadSheet::lastPaintTime() const
+{
+    return last_paint_usecs;
+}
+
 void SpreadSheet::clear()
 {
     setRowCount(rowCount());
@@ -486,45 +528,93 @@ void SpreadSheet::cut()
 
 void SpreadSheet::copy()
 {
-    QMultiMap<int,int> range = selectedItemIndexes();
-    QList<int> rows = range.uniqueKeys();
-    QString str = "";
-    
-    QList<int> cols = range.values();
-    qSort(cols);
-    int firstCol = cols.first(), lastCol = cols.last();
-    
-    for (int i=rows.first(); i<=rows.last(); i++)
+    QList<QTableWidgetSelectionRange> range = selectedItemRanges();
+    if (range.isEmpty())
+        return;
+
+    int firstRow = range.first().topRow(), lastRow = range.first().bottomRow();
+    int firstCol = range.first().leftColumn(), lastCol = range.first().rightColumn();
+    QListIterator<QTableWidgetSelectionRange> it(range);
+    while (it.hasNext())
+    {
+        const QTableWidgetSelectionRange &r = it.next();
+        lastRow = qMax(lastRow, r.bottomRow());
+        firstCol = qMin(firstCol, r.leftColumn());
+        lastCol = qMax(lastCol, r.rightColumn());
+    }
+    int width = lastCol - firstCol + 1;
+
+    QVector<QBitArray> selected(lastRow - firstRow + 1);
+    it.toFront();
+    while (it.hasNext())
     {
-        if (rows.contains(i))
+        const QTableWidgetSelectionRange &r = it.next();
+        for (int i=r.topRow(); i<=r.bottomRow(); i++)
         {
-            QList<int> columns = range.values(i);
-            qSort(columns);
-            
-            for (int j=firstCol; j<=lastCol; j++)
-            {
-                if (columns.contains(j))
-                    str += formula(i, j);
-                str += "\t";
-            }
-            str.chop(1);
+            QBitArray &row = selected[i - firstRow];
+            if (row.isEmpty())
+                row.resize(width);
+            row.fill(true, r.leftColumn() - firstCol, r.rightColumn() - firstCol + 1);
+        }
+    }
+    //overlapping ranges select a cell once, so count the bitmap
+    int cellCount = 0;
+    for (int i=0; i<selected.size(); i++)
+        cellCount += selected.at(i).count(true);
+
+    QString str;
+    str.reserve(cellCount * 8 + selected.size() * width);
+    QByteArray cells;
+    QDataStream out(&cells, QIODevice::WriteOnly);
+    out << (qint32)selected.size() << (qint32)width << (qint32)cellCount;
+
+    for (int i=0; i<selected.size(); i++)
+    {
+        const QBitArray &row = selected.at(i);
+        if (i > 0)
+            str += '\n';
+        if (row.isEmpty())
+            continue;
+        for (int j=0; j<width; j++)
+        {
+            if (j > 0)
+                str += '\t';
+            if (!row.testBit(j))
+                continue;
+            Cell *c = cell(firstRow + i, firstCol + j);
+            QString f = (c)?c->formula():QString();
+            str += f;
+            out << (qint32)i << (qint32)j << (bool)(c != 0);
+            if (c)
+                out << c->font() << c->foreground() << c->background();
+            out << f;
         }
-        str += "\n";
     }
-    str.chop(1);
-    QApplication::clipboard()->setText(str);
+
+    QMimeData *mime = new QMimeData();
+    mime->setText(str);
+    mime->setData(cellsMimeType, cells);
+    QApplication::clipboard()->setMimeData(mime);
 }
 
 void SpreadSheet::paste()
 {
-    QMultiMap<int,int> range = selectedItemIndexes();
-    QMapIterator<int,int> it(range);
-    it.next();
-    int firstRow = it.key(), firstCol = it.value();
+    QList<QTableWidgetSelectionRange> range = selectedItemRanges();
+    if (range.isEmpty())
+        return;
+    int firstRow = range.first().topRow(), firstCol = range.first().leftColumn();
+
+    const QMimeData *mime = QApplication::clipboard()->mimeData();
+    if (mime && mime->hasFormat(cellsMimeType))
+    {
+        pasteCells(mime->data(cellsMimeType), range, firstRow, firstCol);
+        return;
+    }
     
     QString str = QApplication::clipboard()->text();
     QStringList rows = str.split('\n');
     int numRows = rows.size();
+    beginUpdate();
     for (int r=0; r<numRows; r++)
     {
         QStringList columnData = rows.at(r).split('\t');
@@ -532,10 +622,55 @@ void SpreadSheet::paste()
         for (int c=0; c<numColumns; c++)
         {
             int destRow = firstRow+r, destCol = firstCol+c;
-            if (range.contains(destRow, destCol))
+            if (selectionContains(range, destRow, destCol))
                 setFormula(destRow, destCol, columnData.at(c));
         }
     }
+    endUpdate();
+}
+
+void SpreadSheet::pasteCells(const QByteArray &cells,
+                             const QList<QTableWidgetSelectionRange> &range,
+                             int firstRow, int firstCol)
+{
+    QDataStream in(cells);
+    qint32 rows, columns, count;
+    in >> rows >> columns >> count;
+
+    beginUpdate();
+    for (int i=0; i<count && in.status() == QDataStream::Ok; i++)
+    {
+        qint32 r, c;
+        bool styled;
+        QFont font;
+        QBrush foreground, background;
+        QString f;
+        in >> r >> c >> styled;
+        if (styled)
+            in >> font >> foreground >> background;
+        in >> f;
+
+        int destRow = firstRow+r, destCol = firstCol+c;
+        if (!selectionContains(range, destRow, destCol) ||
+            destRow >= rowCount() || destCol >= columnCount())
+            continue;
+        if (styled)
+        {
+            Cell *item = cell(destRow, destCol);
+            if (!item)
+            {
+                item = new Cell();
+                setItem(destRow, destCol, item);
+            }
+            bool blocked = blockSignals(true);
+            item->setFont(font);
+            item->setForeground(foreground);
+            item->setBackground(background);
+            blockSignals(blocked);
+        }
+        setFormula(destRow, destCol, f);
+    }
+    endUpdate();
 }
 
 void SpreadSheet::del()
@@ -543,28 +678,21 @@ void SpreadSheet::del()
     QList<QTableWidgetItem *> items = selectedItems();
     if (!items.isEmpty())
     {
+        beginUpdate();
         for (int i=0; i<items.length(); i++)
             if (items[i] != 0)
                 items[i]->setData(Qt::EditRole, "");
+        endUpdate();
         somethingChanged(currentItem());
     }
 }
 
-void SpreadSheet::setSelectedItemIndexes(const QMultiMap<int, int> &items)
+void SpreadSheet::setSelectedItemRanges(const QList<QTableWidgetSelectionRange> &items)
 {
     clearSelection();
-    QMapIterator<int, int> it(items);
+    QListIterator<QTableWidgetSelectionRange> it(items);
     while (it.hasNext())
-    {
-        it.next();
-        Cell *c = cell(it.key(), it.value());
-        if (!c)
-        {
-            c = new Cell();
-            setItem(it.key(), it.value(), c);
-        }
-        c->setSelected(true);
-    }
+        setRangeSelected(it.next(), true);
 }
 
 void SpreadSheet::setCurrentColumnHeaderText(const QString &text)
@@ -578,25 +706,31 @@ void SpreadSheet::setCurrentColumnHeaderText(const QString &text)
 void SpreadSheet::setCurrentCellsFont(const QFont &f)
 {
     QList<QTableWidgetItem*> items = selectedItems();
+    beginUpdate();
     for (int i=0; i<items.length(); i++)
         if (items[i])
             items[i]->setFont(f);
+    endUpdate();
 }
 
 void SpreadSheet::setFontColor(const QColor &c)
 {
     QList<QTableWidgetItem*> items = selectedItems();
+    beginUpdate();
     for (int i=0; i<items.length(); i++)
         if (items[i])
             items[i]->setForeground(QBrush(c));
+    endUpdate();
 }
 
 void SpreadSheet::setBackgroundColor(const QColor &c)
 {
     QList<QTableWidgetItem*> items = selectedItems();
+    beginUpdate();
     for (int i=0; i<items.length(); i++)
         if (items[i])
             items[i]->setBackgroundColor(c);
+    endUpdate();
 }
 
 void SpreadSheet::setRowsSize(const QMap<int, int> size)
@@ -681,6 +815,8 @@ void SpreadSheet::removeColumns(const QList <int> column_ids)
 
 void SpreadSheet::setRights(const QList<int> columns)
 {
+    TraceSpan span("setRights", "ui");
+    beginUpdate();
     for (int col=0; col<columnCount(); col++)
         if (!columns.contains(col))
             for (int row=0; row<rowCount(); row++)
@@ -706,6 +842,7 @@ void SpreadSheet::setRights(const QList<int> columns)
                 if (!(c->flags() & Qt::ItemIsEditable))
                     c->setFlags(c->flags() | Qt::ItemIsEditable);
             }
+    endUpdate();
 }
 
 void SpreadSheet::setSize(int rows, int columns)
@@ -719,58 +856,153 @@ void SpreadSheet::setSize(int rows, int columns)
 
 void SpreadSheet::emitSelectionChanged()
 {
-    emit itemSelectionChanged(selectedItemIndexes());
+    emit itemSelectionChanged(selectedItemRanges());
 }
 
 void SpreadSheet::somethingChanged(QTableWidgetItem *cell)
 {
-    if (cell == 0)
+    //never write back a cell that could not be decrypted
+    if (cell == 0 || cell->data(Qt::UserRole).isValid())
         return;
     
     if (cell->font().family() == "")
         cell->setFont(QApplication::font());
-    QByteArray cellData;
-    QDataStream out(&cellData, QIODevice::WriteOnly);
-    out << cell->font() << cell->foreground() << cell->background() << 
-           cell->data(Qt::EditRole).toString();
-    
-    QString aux = QString("%1\n%2\n%3").
-                    arg(row(cell)).
-                    arg(column(cell)).
-                    arg(QCA::arrayToHex(cellData));
-    emit modified(aux);
+    CellStyle style;
+    style.font = cell->font();
+    style.foreground = cell->foreground();
+    style.background = cell->background();
+    emit modified(row(cell), column(cell),
+                  CellCodec::encode(style, cell->data(Qt::EditRole).toString()));
 }
 
-void SpreadSheet::loadData(const QMap<int, QString> &data)
+void SpreadSheet::loadData(const QMap<int, QList<QByteArray> > &data)
 {
-    QStringList aux;
-    QMapIterator<int, QString> it(data);
+    TraceSpan span("loadData", "ui");
+    applyData(RefreshPayload::decode(data));
+}
+
+void SpreadSheet::applyData(const RefreshPayload &data)
+{
+    TraceSpan span("applyData", "ui");
+    span.setArgs(QString("\"cells\": %1").arg(data.cells.size()));
+    QElapsedTimer frame;
+    frame.start();
+    beginUpdate();
+    bool blocked = blockSignals(true);
+    QListIterator<CellRecord> it(data.cells);
     while (it.hasNext())
     {
-        it.next();
-        aux = ((QString)it.value()).split('\n');
-        for (int c=0; c<aux.length(); c++)
+        const CellRecord &record = it.next();
+        if (record.row >= rowCount() || record.column >= columnCount())
+            continue;
+        const CellStyle &style = data.styles.at(record.style);
+
+        Cell *item = cell(record.row, record.column);
+        if (!item)
         {
-            QFont font;
-            QBrush foreground, background;
-            QString formula;
-            
-            QByteArray cellData = QCA::hexToArray(aux.at(c));
-            QDataStream in(&cellData, QIODevice::ReadOnly);
-            in >> font >> foreground >> background >> formula;
-                    
-            Cell *item = cell(it.key(), c);
-            if (!item)
+            item = new Cell();
+            setItem(record.row, record.column, item);
+        }
+        if (item->formula() != record.formula)
+            item->setData(Qt::EditRole, record.formula);
+        //cells that could not be decrypted are locked until they can be,
+        //the role keeps whether the cell was editable before
+        QVariant locked = item->data(Qt::UserRole);
+        if (!record.readable && !locked.isValid())
+        {
+            item->setData(Qt::UserRole,
+                          (bool)(item->flags() & Qt::ItemIsEditable));
+            item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+            item->setToolTip("This cell could not be decrypted");
+        }
+        else if (record.readable && locked.isValid())
+        {
+            if (locked.toBool())
+                item->setFlags(item->flags() | Qt::ItemIsEditable);
+            item->setData(Qt::UserRole, QVariant());
+            item->setToolTip("");
+        }
+        if (item->font() != style.font)
+            item->setFont(style.font);
+        if (item->foreground() != style.foreground)
+            item->setForeground(style.foreground);
+        if (item->background() != style.background)
+            item->setBackground(style.background);
+    }
+    blockSignals(blocked);
+    endUpdate();
+    recordFrame(frame.nsecsElapsed() / 1000);
+}
+
+void SpreadSheet::recordFrame(qint64 usec)
+{
+    frame_times.add(usec);
+}
+
+const Histogram &SpreadSheet::frameTimes() const
+{
+    return frame_times;
+}
+
+//fonts and brushes are implicitly shared, so each distinct one counts once
+SheetMemory SpreadSheet::memoryUsage() const
+{
+    SheetMemory usage;
+    QSet<QString> fonts;
+    QSet<QString> brushes;
+    for (int r=0; r<rowCount(); r++)
+        for (int c=0; c<columnCount(); c++)
+        {
+            Cell *item = cell(r, c);
+            if (item == 0)
+                continue;
+            int roles = 1;
+            usage.items++;
+            usage.formulaBytes += SheetMemory::stringBytes(item->formula());
+            QVariant font = item->data(Qt::FontRole);
+            if (font.isValid())
             {
-                item = new Cell();
-                setItem(it.key(), c, item);
+                roles++;
+                fonts.insert(font.value<QFont>().key());
             }
-            item->setData(Qt::EditRole, formula);
-            item->setFont(font);
-            item->setForeground(foreground);
-            item->setBackground(background);
+            QVariant foreground = item->data(Qt::ForegroundRole);
+            if (foreground.isValid())
+            {
+                roles++;
+                QBrush brush = foreground.value<QBrush>();
+                brushes.insert(QString("%1/%2").arg(brush.color().rgba()).
+                               arg(brush.style()));
+            }
+            QVariant background = item->data(Qt::BackgroundRole);
+            if (background.isValid())
+            {
+                roles++;
+                QBrush brush = background.value<QBrush>();
+                brushes.insert(QString("%1/%2").arg(brush.color().rgba()).
+                               arg(brush.style()));
+            }
+            usage.itemBytes += sizeof(Cell) + roles * itemDataBytes;
         }
+    usage.styleBytes = fonts.size() * fontBytes + brushes.size() * brushBytes;
+
+    QMapIterator<int,QString> it(*timestamps);
+    while (it.hasNext())
+    {
+        it.next();
+        usage.timestampBytes += mapNodeBytes +
+                                SheetMemory::stringBytes(it.value());
+    }
+
+    for (int c=0; c<columnCount(); c++)
+    {
+        QTableWidgetItem *header = horizontalHeaderItem(c);
+        if (header == 0)
+            continue;
+        usage.items++;
+        usage.itemBytes += sizeof(QTableWidgetItem) + itemDataBytes;
+        usage.headerBytes += SheetMemory::stringBytes(header->text());
     }
+    return usage;
 }
 
 void SpreadSheet::currentSelectionChanged()
@@ -5,10 +5,31 @@
 #include <QtGui>
 #include <QtCrypto>
 #include "DBManager.h"
+#include "CellRecord.h"
+#include "Histogram.h"
+#include "CellSource.h"
 
 class Cell;
 
-class SpreadSheet : public QTableWidget
+//estimated heap bytes held by an open sheet and the manager behind it
+struct SheetMemory
+{
+    int items;
+    qint64 itemBytes;
+    qint64 formulaBytes;
+    qint64 styleBytes;
+    qint64 timestampBytes;
+    qint64 headerBytes;
+    qint64 decodedBytes;
+    qint64 keyCacheBytes;
+
+    SheetMemory();
+    qint64 total() const;
+    QString toString() const;
+    static qint64 stringBytes(const QString &text);
+};
+
+class SpreadSheet : public QTableWidget, public CellSource
 {
     Q_OBJECT
 public:
@@ -22,9 +43,11 @@ public:
     QString getLocation(int row, int column) const;
     QString currentFormula() const;
     static QPair<int,int> getLocation(const QString &cellId);
-    static bool selectionsEquals(const QMultiMap<int,int> &first,
-                                const QMultiMap<int,int> &second);
-    QMultiMap<int,int> selectedItemIndexes() const;
+    static bool selectionsEquals(const QList<QTableWidgetSelectionRange> &first,
+                                 const QList<QTableWidgetSelectionRange> &second);
+    static bool selectionContains(const QList<QTableWidgetSelectionRange> &selection,
+                                  int row, int column);
+    QList<QTableWidgetSelectionRange> selectedItemRanges() const;
     QTimer *getTimer() const;
     void setRefreshTime(int sec) const;
     void replaceTimestamp(int index, const QString &newVal) const;
@@ -36,41 +59,68 @@ public:
     QString headerText(int column);
     void setHeaderText(int column, const QString &text);
     QFont currentFont() const;
+    QVariant cellValue(int row, int column) const;
     QString getLinkData(const QString &formula,
                         const QHash<QString,QString> &matches) const;
+    void setLinkProvider(const LinkProvider *provider);
+    void beginUpdate();
+    void endUpdate();
+    void markDirty();
+    int repaintCount() const;
+    int lastRefreshRepaints() const;
+    void recordFrame(qint64 usec);
+    const Histogram &frameTimes() const;
+    SheetMemory memoryUsage() const;
+    qint64 lastPaintTime() const;
+
+protected:
+    void paintEvent(QPaintEvent *event);
 
 private:
     QTimer *refresh_timer;
+    int update_depth;
+    bool dirty;
+    int repaints;
+    int refresh_start_repaints;
+    int last_refresh_repaints;
+    qint64 last_paint_usecs;
+    Histogram frame_times;
+    void repaintViewport();
     void clear();
     Cell* cell(int row,int column) const;
     QString text(int row, int column) const;
     QString formula(int row, int column) const;
     void setFormula(int row, int column, const QString &formula);
+    void pasteCells(const QByteArray &cells,
+                    const QList<QTableWidgetSelectionRange> &range,
+                    int firstRow, int firstCol);
     mutable QMap<int,QString> *timestamps;
-    const DBManager *mng;
+    const LinkProvider *links;
 
 signals:
-    void modified(const QString &cellData);
+    void modified(int row, int column, const QByteArray &cellData);
     void invalidFormula(const QString &message) const;
+    void printProgress(int page, int pages) const;
     void columnResize(int logicalIndex, int oldSize, int newSize);
     void rowResize(int logicalIndex, int oldSize, int newSize);
     void columnHeaderTextChanged(int column, const QString &text);
     void currentSelectionChanged(const QFont &font, 
                                  const QBrush &background,
                                  const QBrush &foreground);
-    void itemSelectionChanged(const QMultiMap<int,int> &selection);
+    void itemSelectionChanged(const QList<QTableWidgetSelectionRange> &selection);
+    void updateFinished(int repaints);
 
 public slots:
     void setFormula(const QString &formula,
-                    const QMultiMap<int,int> &selection);
+                    const QList<QTableWidgetSelectionRange> &selection);
     void setFormula(const QString &table,
-                    const QMultiMap<int,int> &from,
-                    const QMultiMap<int,int> &to);
+                    const QList<QTableWidgetSelectionRange> &from,
+                    const QList<QTableWidgetSelectionRange> &to);
     void cut();
     void copy();
     void paste();
     void del();
-    void setSelectedItemIndexes(const QMultiMap<int,int> &items);
+    void setSelectedItemRanges(const QList<QTableWidgetSelectionRange> &items);
     void setCurrentColumnHeaderText(const QString &text);
     void setCurrentCellsFont(const QFont &f);
     void setFontColor(const QColor &c);
@@ -89,7 +139,8 @@ public slots:
 
 private slots:
     void somethingChanged(QTableWidgetItem *cell);
-    void loadData(const QMap<int, QString> &data);
+    void loadData(const QMap<int, QList<QByteArray> > &data);
+    void applyData(const RefreshPayload &data);
     void currentSelectionChanged();
 };
 
@@ -0,0 +1,183 @@
+#include "SpreadSheetPrinter.h"
+
+static const int minimumRowHeight = 20;
+
+SpreadSheetPrinter::SpreadSheetPrinter(const QTableWidget *table)
+{
+    this->table = table;
+}
+
+bool SpreadSheetPrinter::print(const QString &fileName)
+{
+    QPrinter printer;
+    printer.setOutputFormat(QPrinter::PdfFormat);
+    printer.setOutputFileName(fileName);
+
+    snapshot(&printer);
+    paginate(printer.height());
+
+    QPainter painter;
+    if (!painter.begin(&printer))
+        return false;
+
+    int batch = qMax(QThread::idealThreadCount(), 1) * 2;
+    for (int first=0; first<pages.size(); first+=batch)
+    {
+        QList<Page> jobs = pages.mid(first, batch);
+        QFutureWatcher<QPicture> watcher;
+        QEventLoop loop;
+        connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+        watcher.setFuture(QtConcurrent::mapped(jobs, renderPage));
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+
+        QList<QPicture> rendered = watcher.future().results();
+        for (int i=0; i<rendered.size(); i++)
+        {
+            if (first+i > 0)
+                printer.newPage();
+            painter.drawPicture(0, 0, rendered.at(i));
+            emit progress(first+i+1, pages.size());
+        }
+    }
+    painter.end();
+    return true;
+}
+
+void SpreadSheetPrinter::snapshot(QPrinter *printer)
+{
+    int columns = table->columnCount();
+    int tableWidth = 0;
+    for (int j=0; j<columns; j++)
+        tableWidth += table->columnWidth(j);
+    int diff = (columns == 0)?0:(printer->width() - tableWidth) / columns;
+    for (int j=0; j<columns; j++)
+        layout.columns_width.append(table->columnWidth(j) + diff);
+
+    layout.default_font = table->font();
+    QFontMetrics defaultMetrics(layout.default_font, printer);
+
+    layout.header.height = minimumRowHeight;
+    for (int j=0; j<columns; j++)
+        layout.header.cells.append(addCell(table->horizontalHeaderItem(j), j,
+                                           defaultMetrics, printer,
+                                           layout.header.height));
+    for (int i=0; i<table->rowCount(); i++)
+    {
+        PrintRow row;
+        row.height = minimumRowHeight;
+        row.cells.reserve(columns);
+        for (int j=0; j<columns; j++)
+            row.cells.append(addCell(table->item(i, j), j,
+                                     defaultMetrics, printer, row.height));
+        layout.rows.append(row);
+    }
+}
+
+int SpreadSheetPrinter::addCell(const QTableWidgetItem *item, int column,
+                                const QFontMetrics &defaultMetrics,
+                                QPrinter *printer, int &height)
+{
+    if (!item)
+        return -1;
+
+    PrintCell c;
+    c.text = item->text();
+    c.font = item->font();
+    if (c.font.family().isEmpty())
+        c.font = layout.default_font;
+    c.foreground = item->foreground().color();
+    if (!c.foreground.isValid())
+        c.foreground = Qt::black;
+    c.background = item->background();
+    if (item == table->horizontalHeaderItem(column))
+        c.alignment = Qt::AlignCenter;
+    else
+        c.alignment = item->textAlignment();
+
+    if (!c.text.isEmpty())
+    {
+        QRect r(0, 0, layout.columns_width.at(column) - 4, minimumRowHeight);
+        int flags = c.alignment | Qt::TextWrapAnywhere;
+        int required;
+        if (c.font == layout.default_font)
+            required = defaultMetrics.boundingRect(r, flags, c.text).height();
+        else
+            required = QFontMetrics(c.font, printer).
+                       boundingRect(r, flags, c.text).height();
+        height = qMax(height, required);
+    }
+
+    layout.cells.append(c);
+    return layout.cells.size() - 1;
+}
+
+void SpreadSheetPrinter::paginate(int pageHeight)
+{
+    int available = qMax(pageHeight - layout.header.height, minimumRowHeight);
+    int first = 0;
+    int y = 0;
+    for (int i=0; i<layout.rows.size(); i++)
+    {
+        PrintRow &row = layout.rows[i];
+        row.height = qMin(row.height, available);
+        if (y + row.height > available && i > first)
+        {
+            Page page = { &layout, first, i-1 };
+            pages.append(page);
+            first = i;
+            y = 0;
+        }
+        y += row.height;
+    }
+    Page page = { &layout, first, layout.rows.size()-1 };
+    pages.append(page);
+}
+
+QPicture SpreadSheetPrinter::renderPage(const Page &page)
+{
+    QPicture picture;
+    QPainter painter(&picture);
+    painter.setPen(QPen(QBrush(Qt::black), 0.5));
+
+    int y = 0;
+    renderRow(&painter, page.layout, page.layout->header, y);
+    y += page.layout->header.height;
+    for (int i=page.first_row; i<=page.last_row; i++)
+    {
+        const PrintRow &row = page.layout->rows.at(i);
+        renderRow(&painter, page.layout, row, y);
+        y += row.height;
+    }
+    painter.end();
+    return picture;
+}
+
+void SpreadSheetPrinter::renderRow(QPainter *painter, const Layout *layout,
+                                   const PrintRow &row, int y)
+{
+    QPen grid = painter->pen();
+    int x = 0;
+    for (int j=0; j<row.cells.size(); j++)
+    {
+        int width = layout->columns_width.at(j);
+        QRect r(x, y, width, row.height);
+        int index = row.cells.at(j);
+        if (index < 0)
+        {
+            painter->setBrush(Qt::NoBrush);
+            painter->drawRect(r);
+        }
+        else
+        {
+            const PrintCell &c = layout->cells.at(index);
+            painter->setBrush(c.background);
+            painter->drawRect(r);
+            painter->setFont(c.font);
+            painter->setPen(c.foreground);
+            painter->drawText(r.adjusted(2, 0, -2, 0),
+                              c.alignment | Qt::TextWrapAnywhere, c.text);
+            painter->setPen(grid);
+        }
+        x += width;
+    }
+}
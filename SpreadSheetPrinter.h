@@ -0,0 +1,63 @@
+#ifndef SPREADSHEETPRINTER_H
+#define SPREADSHEETPRINTER_H
+
+#include <QtCore>
+#include <QtGui>
+
+class SpreadSheetPrinter : public QObject
+{
+    Q_OBJECT
+public:
+    SpreadSheetPrinter(const QTableWidget *table);
+    bool print(const QString &fileName);
+
+    struct PrintCell
+    {
+        QString text;
+        QFont font;
+        QColor foreground;
+        QBrush background;
+        int alignment;
+    };
+
+    struct PrintRow
+    {
+        int height;
+        QVector<int> cells;
+    };
+
+    struct Layout
+    {
+        QList<int> columns_width;
+        QList<PrintCell> cells;
+        QList<PrintRow> rows;
+        PrintRow header;
+        QFont default_font;
+    };
+
+    struct Page
+    {
+        const Layout *layout;
+        int first_row;
+        int last_row;
+    };
+
+signals:
+    void progress(int page, int pages);
+
+private:
+    const QTableWidget *table;
+    Layout layout;
+    QList<Page> pages;
+
+    void snapshot(QPrinter *printer);
+    int addCell(const QTableWidgetItem *item, int column,
+                const QFontMetrics &defaultMetrics, QPrinter *printer,
+                int &height);
+    void paginate(int pageHeight);
+    static QPicture renderPage(const Page &page);
+    static void renderRow(QPainter *painter, const Layout *layout,
+                          const PrintRow &row, int y);
+};
+
+#endif // SPREADSHEETPRINTER_H
@@ -0,0 +1,70 @@
+#include "Startup.h"
+
+static QElapsedTimer startupClock;
+static qint64 lastMark = 0;
+static qint64 totalUsecs = -1;
+static QList<QPair<QString, qint64> > phases;
+
+void Startup::begin()
+{
+    startupClock.start();
+    lastMark = 0;
+    totalUsecs = -1;
+    phases.clear();
+}
+
+//time spent since the previous mark is charged to phase
+void Startup::mark(const QString &phase)
+{
+    if (!startupClock.isValid() || totalUsecs != -1)
+        return;
+    qint64 now = startupClock.nsecsElapsed() / 1000;
+    phases.append(qMakePair(phase, now - lastMark));
+    lastMark = now;
+}
+
+//called from the first event loop iteration after the window is shown
+qint64 Startup::finish()
+{
+    if (!startupClock.isValid() || totalUsecs != -1)
+        return totalUsecs;
+    mark("first event loop");
+    totalUsecs = lastMark;
+    //SEM_STARTUP_PROFILE names a file for the report of each start
+    QString fileName = QString::fromLocal8Bit(qgetenv("SEM_STARTUP_PROFILE"));
+    if (!fileName.isEmpty())
+        dump(fileName);
+    return totalUsecs;
+}
+
+bool Startup::isFinished()
+{
+    return totalUsecs != -1;
+}
+
+qint64 Startup::total()
+{
+    return totalUsecs;
+}
+
+QString Startup::report()
+{
+    QString result("== startup\n");
+    for (int i=0; i<phases.size(); i++)
+        result.append(QString("%1\t%2 ms\n").arg(phases.at(i).first).
+                      arg(phases.at(i).second / 1000.0, 0, 'f', 1));
+    if (totalUsecs != -1)
+        result.append(QString("interactive after\t%1 ms\n").
+                      arg(totalUsecs / 1000.0, 0, 'f', 1));
+    return result;
+}
+
+bool Startup::dump(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+    QTextStream out(&file);
+    out << report();
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <QtCore>
+
+//wall clock phases from main() until the window first takes input
+class Startup
+{
+public:
+    static void begin();
+    static void mark(const QString &phase);
+    static qint64 finish();
+    static bool isFinished();
+    static qint64 total();
+    static QString report();
+    static bool dump(const QString &fileName);
+};
+
+#endif // STARTUP_H
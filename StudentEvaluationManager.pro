@@ -21,7 +21,15 @@ SOURCES += main.cpp\
     CFGManager.cpp \
     Security.cpp \
     TableDialog.cpp \
-    ConfigurationDialog.cpp
+    ConfigurationDialog.cpp \
+    CellRecord.cpp \
+    Histogram.cpp \
+    QueryStats.cpp \
+    SlowQueryLog.cpp \
+    CommandLine.cpp \
+    Trace.cpp \
+    Startup.cpp \
+    SpreadSheetPrinter.cpp
 
 HEADERS  += MainWindow.h \
     Cell.h \
@@ -31,7 +39,17 @@ HEADERS  += MainWindow.h \
     CFGManager.h \
     Security.h \
     TableDialog.h \
-    ConfigurationDialog.h
+    ConfigurationDialog.h \
+    CellRecord.h \
+    Histogram.h \
+    QueryStats.h \
+    SlowQueryLog.h \
+    CommandLine.h \
+    Trace.h \
+    Startup.h \
+    LinkProvider.h \
+    CellSource.h \
+    SpreadSheetPrinter.h
 
 INCLUDEPATH += $$quote(qca-2.0.3/include/QtCrypto)
 
@@ -44,3 +62,13 @@ unix {
 win32 {
     LIBS += -L$$quote(qca-2.0.3/lib) -lqca2
 }
+
+#make benchmarks builds the benchmark programs and QtTest suites,
+#make benchcheck runs the suites against benchmarks/baseline.json
+benchmarks.commands = cd $$PWD/benchmarks && $(QMAKE) benchmarks.pro && $(MAKE)
+benchcheck.commands = python $$PWD/benchmarks/compare.py
+benchcheck.depends = benchmarks
+#both names are actions, not files (benchmarks is also a directory)
+phony.target = .PHONY
+phony.depends = benchmarks benchcheck
+QMAKE_EXTRA_TARGETS += benchmarks benchcheck phony
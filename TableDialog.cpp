@@ -370,7 +370,7 @@ void NewTableDialog::checkValidity()
     this->close();
 }
 
-ImportDataDialog::ImportDataDialog(const QMultiMap<int, int> &currentSelection, QWidget *parent) :
+ImportDataDialog::ImportDataDialog(const QList<QTableWidgetSelectionRange> &currentSelection, QWidget *parent) :
     TableDialog("Import data", "Enter table name", parent)
 {
     setMinimumSize(800, 600);
@@ -406,7 +406,7 @@ void ImportDataDialog::checkValidity()
         showMessage("No document selected");
         return;
     }
-    QMultiMap<int,int> selectedIndexes = table->selectedItemIndexes();
+    QList<QTableWidgetSelectionRange> selectedIndexes = table->selectedItemRanges();
     if (!SpreadSheet::selectionsEquals(selection, selectedIndexes))
     {
         showMessage("Main selection size must be equal to "
@@ -435,7 +435,7 @@ void ImportDataDialog::setRights()
     table->setRights(QList<int>());
 }
 
-void ImportDataDialog::setSelectedItems(const QMultiMap<int, int> &items)
+void ImportDataDialog::setSelectedItems(const QList<QTableWidgetSelectionRange> &items)
 {
     selection = items;
 }
@@ -93,7 +93,7 @@ class ImportDataDialog : public TableDialog
 {
     Q_OBJECT
 public:
-    ImportDataDialog(const QMultiMap<int,int> &currentSelection, 
+    ImportDataDialog(const QList<QTableWidgetSelectionRange> &currentSelection, 
                      QWidget *parent = 0);
     SpreadSheet *getSpreadsheet() const;
     ~ImportDataDialog();
@@ -102,19 +102,19 @@ public slots:
     void checkValidity();
     void getData();
     void setRights();
-    void setSelectedItems(const QMultiMap<int,int> &items);
+    void setSelectedItems(const QList<QTableWidgetSelectionRange> &items);
 
 private:
     SpreadSheet *table;
     QPushButton *load;
-    QMultiMap<int,int> selection;
+    QList<QTableWidgetSelectionRange> selection;
     QString table_name;
 
 signals:
     void getDataSignal(const QString &table);
     void link(const QString &table, 
-              const QMultiMap<int,int> &from, 
-              const QMultiMap<int,int> &to);
+              const QList<QTableWidgetSelectionRange> &from, 
+              const QList<QTableWidgetSelectionRange> &to);
 };
 
 #endif // TABLEDIALOG_H
@@ -0,0 +1,132 @@
+#include "Trace.h"
+
+//events are flushed after this many writes and at the end of each refresh
+static const int eventsPerFlush = 256;
+
+static QMutex traceMutex;
+static QFile *traceFile = 0;
+static QElapsedTimer traceClock;
+static QAtomicInt traceEnabled;
+static int unflushed = 0;
+static bool firstEvent = true;
+
+//SEM_TRACE overrides the file configured in config.xml
+bool Trace::start(const QString &configuredFile)
+{
+    QString fileName = QString::fromLocal8Bit(qgetenv("SEM_TRACE"));
+    if (fileName.isEmpty())
+        fileName = configuredFile;
+    if (fileName.isEmpty())
+        return false;
+
+    QMutexLocker locker(&traceMutex);
+    if (traceFile != 0)
+        return true;
+    traceFile = new QFile(fileName);
+    if (!traceFile->open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        delete traceFile;
+        traceFile = 0;
+        return false;
+    }
+    //the array format stays readable when the closing bracket is missing
+    traceFile->write("[\n");
+    firstEvent = true;
+    unflushed = 0;
+    traceClock.start();
+    traceEnabled = 1;
+    return true;
+}
+
+void Trace::stop()
+{
+    QMutexLocker locker(&traceMutex);
+    if (traceFile == 0)
+        return;
+    traceEnabled = 0;
+    traceFile->write("\n]\n");
+    traceFile->close();
+    delete traceFile;
+    traceFile = 0;
+}
+
+void Trace::flush()
+{
+    QMutexLocker locker(&traceMutex);
+    if (traceFile == 0)
+        return;
+    traceFile->flush();
+    unflushed = 0;
+}
+
+bool Trace::isEnabled()
+{
+    return traceEnabled != 0;
+}
+
+qint64 Trace::now()
+{
+    return traceClock.nsecsElapsed() / 1000;
+}
+
+void Trace::complete(const char *name, const char *category,
+                     qint64 start, qint64 duration, const QString &args)
+{
+    if (!isEnabled())
+        return;
+    write(QString("{\"name\": \"%1\", \"cat\": \"%2\", \"ph\": \"X\", "
+                  "\"ts\": %3, \"dur\": %4, \"pid\": %5, \"tid\": %6%7}").
+          arg(name).arg(category).arg(start).arg(duration).
+          arg(QCoreApplication::applicationPid()).
+          arg((quintptr)QThread::currentThreadId()).
+          arg(args.isEmpty()?QString():QString(", \"args\": {%1}").arg(args)));
+}
+
+void Trace::instant(const char *name, const char *category,
+                    const QString &args)
+{
+    if (!isEnabled())
+        return;
+    write(QString("{\"name\": \"%1\", \"cat\": \"%2\", \"ph\": \"i\", "
+                  "\"s\": \"t\", \"ts\": %3, \"pid\": %4, \"tid\": %5%6}").
+          arg(name).arg(category).arg(now()).
+          arg(QCoreApplication::applicationPid()).
+          arg((quintptr)QThread::currentThreadId()).
+          arg(args.isEmpty()?QString():QString(", \"args\": {%1}").arg(args)));
+}
+
+void Trace::write(const QString &event)
+{
+    QMutexLocker locker(&traceMutex);
+    if (traceFile == 0)
+        return;
+    if (!firstEvent)
+        traceFile->write(",\n");
+    firstEvent = false;
+    traceFile->write(event.toUtf8());
+    if (++unflushed >= eventsPerFlush)
+    {
+        traceFile->flush();
+        unflushed = 0;
+    }
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category)
+{
+    this->name = name;
+    this->category = category;
+    enabled = Trace::isEnabled();
+    start = enabled?Trace::now():0;
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (enabled)
+        Trace::complete(name, category, start, Trace::now() - start, args);
+}
+
+void TraceSpan::setArgs(const QString &args)
+{
+    if (enabled)
+        this->args = args;
+}
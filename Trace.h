@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore>
+
+//Chrome trace-event output (chrome://tracing, Perfetto), one file per run
+class Trace
+{
+public:
+    static bool start(const QString &configuredFile);
+    static void stop();
+    static void flush();
+    static bool isEnabled();
+    static qint64 now();
+    static void complete(const char *name, const char *category,
+                         qint64 start, qint64 duration,
+                         const QString &args = QString());
+    static void instant(const char *name, const char *category,
+                        const QString &args = QString());
+
+private:
+    static void write(const QString &event);
+};
+
+//records the enclosing scope as a complete event when tracing is on
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name, const char *category);
+    ~TraceSpan();
+    void setArgs(const QString &args);
+
+private:
+    const char *name;
+    const char *category;
+    qint64 start;
+    bool enabled;
+    QString args;
+};
+
+#endif // TRACE_H
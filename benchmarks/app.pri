@@ -0,0 +1,42 @@
+#-------------------------------------------------
+#
+# Application sources linked into the benchmarks, the spreadsheet core
+# by default and the database layer with CONFIG += app_database
+#
+#-------------------------------------------------
+
+QT += gui
+
+SOURCES += $$ROOT/SpreadSheet.cpp \
+    $$ROOT/SpreadSheetPrinter.cpp \
+    $$ROOT/Cell.cpp \
+    $$ROOT/CellRecord.cpp \
+    $$ROOT/Histogram.cpp \
+    $$ROOT/Trace.cpp
+
+HEADERS += $$ROOT/SpreadSheet.h \
+    $$ROOT/SpreadSheetPrinter.h \
+    $$ROOT/Cell.h \
+    $$ROOT/CellRecord.h \
+    $$ROOT/Histogram.h \
+    $$ROOT/LinkProvider.h \
+    $$ROOT/CellSource.h \
+    $$ROOT/Trace.h
+
+app_database {
+    QT += sql xml
+
+    DEFINES += ROOT_DIR=\\\"$$ROOT\\\"
+
+    SOURCES += $$ROOT/DBManager.cpp \
+        $$ROOT/CFGManager.cpp \
+        $$ROOT/Security.cpp \
+        $$ROOT/QueryStats.cpp \
+        $$ROOT/SlowQueryLog.cpp
+
+    HEADERS += $$ROOT/DBManager.h \
+        $$ROOT/CFGManager.h \
+        $$ROOT/Security.h \
+        $$ROOT/QueryStats.h \
+        $$ROOT/SlowQueryLog.h
+}
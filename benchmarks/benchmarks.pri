@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Shared settings for the headless benchmark programs
+#
+#-------------------------------------------------
+
+QT       += core sql
+QT       -= gui
+
+CONFIG += release console crypto
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+ROOT = $$PWD/..
+
+INCLUDEPATH += $$ROOT \
+    $$PWD/common \
+    $$quote($$ROOT/qca-2.0.3/include/QtCrypto)
+
+#option parsing, measurement loop and schema setup of every benchmark
+SOURCES += $$PWD/common/Benchmark.cpp
+
+HEADERS += $$PWD/common/Benchmark.h
+
+unix {
+    QMAKE_LFLAGS += -Wl,--rpath=$$quote($$ROOT/qca-2.0.3/lib)
+    LIBS += -L$$quote($$ROOT/qca-2.0.3/lib) -lqca
+}
+
+win32 {
+    LIBS += -L$$quote($$ROOT/qca-2.0.3/lib) -lqca2
+}
@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Benchmark programs and the QtTest suites tracked by compare.py
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += storage \
+    formula \
+    load \
+    suites/formula \
+    suites/crypto \
+    suites/serialization \
+    suites/database \
+    suites/memory
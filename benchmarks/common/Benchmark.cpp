@@ -0,0 +1,62 @@
+#include <QtSql>
+#include "Benchmark.h"
+
+qint64 benchmarkSink = 0;
+
+QString option(const QStringList &args, const QString &name,
+               const QString &defaultValue)
+{
+    int i = args.indexOf(name);
+    if (i != -1 && i+1 < args.size())
+        return args.at(i+1);
+    return defaultValue;
+}
+
+QString jsonString(const QString &text)
+{
+    QString result = text;
+    result.replace('\\', "\\\\").replace('"', "\\\"");
+    return QString("\"%1\"").arg(result);
+}
+
+//runs tables.sql statement by statement, drivers reject batches
+bool createSchema(const QString &driver, const QString &server, int port,
+                  const QString &database, const QString &schema)
+{
+    QFile file(schema);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning("Unable to read %s", qPrintable(schema));
+        return false;
+    }
+    QStringList statements = QString(file.readAll()).split(';');
+
+    bool ok = true;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(driver, "setup");
+        db.setHostName(server);
+        db.setPort(port);
+        db.setDatabaseName(database);
+        if (!db.open())
+        {
+            qWarning("%s", qPrintable(db.lastError().text()));
+            ok = false;
+        }
+        QSqlQuery query(db);
+        for (int i=0; ok && i<statements.size(); i++)
+        {
+            QString statement = statements.at(i).trimmed();
+            if (statement.isEmpty())
+                continue;
+            if (!query.exec(statement))
+            {
+                qWarning("%s\n%s", qPrintable(statement),
+                         qPrintable(query.lastError().text()));
+                ok = false;
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("setup");
+    return ok;
+}
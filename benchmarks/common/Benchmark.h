@@ -0,0 +1,51 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QtCore>
+
+//helpers shared by the benchmark programs and the QtTest suites
+
+//every measurement runs at least this long, doubling the operation count
+static const qint64 minNsecs = 200000000;
+
+struct Measurement
+{
+    qint64 ops;
+    qint64 nsecs;
+};
+
+//keeps the measured calls from being optimized away
+extern qint64 benchmarkSink;
+
+inline int weight(int value) { return value; }
+inline int weight(bool value) { return value?1:0; }
+inline int weight(const QString &value) { return value.size(); }
+inline int weight(const QByteArray &value) { return value.size(); }
+
+template <typename Op>
+Measurement measure(const Op &op, qint64 maxOps)
+{
+    Measurement result;
+    QElapsedTimer timer;
+    for (qint64 ops=1; ; ops*=2)
+    {
+        timer.start();
+        for (qint64 i=0; i<ops; i++)
+            benchmarkSink += weight(op());
+        qint64 nsecs = timer.nsecsElapsed();
+        if (nsecs >= minNsecs || ops >= maxOps)
+        {
+            result.ops = ops;
+            result.nsecs = nsecs;
+            return result;
+        }
+    }
+}
+
+QString option(const QStringList &args, const QString &name,
+               const QString &defaultValue);
+QString jsonString(const QString &text);
+bool createSchema(const QString &driver, const QString &server, int port,
+                  const QString &database, const QString &schema);
+
+#endif // BENCHMARK_H
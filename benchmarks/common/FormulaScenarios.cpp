@@ -0,0 +1,140 @@
+#include "FormulaScenarios.h"
+#include "SpreadSheet.h"
+#include "Cell.h"
+
+MockLinks::MockLinks() : lookups(0)
+{
+}
+
+QHash<QString,QString> MockLinks::getLinkData(const QHash<QString,QString> &matches) const
+{
+    QHash<QString,QString> result;
+    QHashIterator<QString,QString> it(matches);
+    while (it.hasNext())
+    {
+        it.next();
+        QString link = QString("%1:%2").arg(it.key()).arg(it.value());
+        result.insertMulti(link, QString::number(5 + qHash(link) % 50 / 10.0,
+                                                 'f', 1));
+        lookups++;
+    }
+    return result;
+}
+
+Cell *Scenario::formula(int index) const
+{
+    const QPair<int,int> &pos = formulas.at(index);
+    return static_cast<Cell*>(sheet->item(pos.first, pos.second));
+}
+
+QString Scenario::checkedValue() const
+{
+    QPair<int,int> pos = SpreadSheet::getLocation(check);
+    QTableWidgetItem *item = sheet->item(pos.first, pos.second);
+    return (item == 0)?QString():item->data(Qt::DisplayRole).toString();
+}
+
+QString cellName(int row, int column)
+{
+    return QString("%1%2").arg(QChar('A' + column)).arg(row + 1);
+}
+
+static Scenario newScenario(const QString &name, int rows, int columns,
+                            const LinkProvider *links)
+{
+    Scenario scenario;
+    scenario.name = name;
+    scenario.sheet = new SpreadSheet(rows, columns);
+    scenario.sheet->getTimer()->stop();
+    scenario.sheet->setLinkProvider(links);
+    return scenario;
+}
+
+static void setCell(Scenario &scenario, int row, int column,
+                    const QString &text)
+{
+    scenario.sheet->setItem(row, column, new Cell(text));
+    if (text.startsWith('='))
+        scenario.formulas << qMakePair(row, column);
+}
+
+static QString grade(int row)
+{
+    return QString::number(1 + (row * 7) % 10);
+}
+
+//A1=1, An=A(n-1)+1: every value walks the whole chain above it
+static Scenario chain(int depth, const LinkProvider *links)
+{
+    Scenario scenario = newScenario("chain", depth, 1, links);
+    setCell(scenario, 0, 0, "1");
+    for (int r=1; r<depth; r++)
+        setCell(scenario, r, 0, QString("=%1+1").arg(cellName(r-1, 0)));
+    scenario.check = cellName(depth-1, 0);
+    scenario.expected = QString::number(depth);
+    return scenario;
+}
+
+//sum/avg/count over a whole column of grades
+static Scenario fan(int width, const LinkProvider *links)
+{
+    Scenario scenario = newScenario("fan", width, 2, links);
+    QStringList cells;
+    double total = 0;
+    for (int r=0; r<width; r++)
+    {
+        setCell(scenario, r, 0, grade(r));
+        cells << cellName(r, 0);
+        total += grade(r).toDouble();
+    }
+    QString range = cells.join(";");
+    QStringList functions;
+    functions << "sum" << "avg" << "count";
+    for (int r=0; r<qMin(width, 30); r++)
+        setCell(scenario, r, 1,
+                QString("=%1(%2)").arg(functions.at(r % 3)).arg(range));
+    scenario.check = cellName(0, 1);
+    scenario.expected = QString::number(total);
+    return scenario;
+}
+
+//if on each grade plus a countif window, as pass/fail columns are written
+static Scenario conditional(int rows, const LinkProvider *links)
+{
+    Scenario scenario = newScenario("conditional", rows, 2, links);
+    for (int r=0; r<rows; r++)
+        setCell(scenario, r, 0, grade(r));
+    for (int r=0; r<rows; r++)
+    {
+        QStringList window;
+        for (int w=r; w<qMin(rows, r+10); w++)
+            window << cellName(w, 0);
+        setCell(scenario, r, 1,
+                QString("=if(%1>=5;1;0)+countif(%2;>=5)*(%1-1)/2").
+                arg(cellName(r, 0)).arg(window.join(";")));
+    }
+    return scenario;
+}
+
+//final grade from two linked tables, resolved by the link provider
+static Scenario linked(int rows, const LinkProvider *links)
+{
+    Scenario scenario = newScenario("links", rows, 2, links);
+    for (int r=0; r<rows; r++)
+    {
+        setCell(scenario, r, 0, grade(r));
+        setCell(scenario, r, 1,
+                QString("=(%1+lab:%1*2+exam:%2*3)/6").arg(cellName(r, 0)).
+                arg(cellName(r, 1)));
+    }
+    return scenario;
+}
+
+QList<Scenario> formulaScenarios(int depth, int width,
+                                 const LinkProvider *links)
+{
+    QList<Scenario> scenarios;
+    scenarios << chain(depth, links) << fan(width, links)
+              << conditional(width, links) << linked(width, links);
+    return scenarios;
+}
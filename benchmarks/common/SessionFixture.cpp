@@ -0,0 +1,152 @@
+#include <QtGui>
+#include "CFGManager.h"
+#include "DBManager.h"
+#include "SpreadSheet.h"
+#include "Benchmark.h"
+#include "SessionFixture.h"
+
+//key pair generation for the new account runs on the thread pool
+static const int loginTimeout = 120000;
+static const int refreshTimeout = 30000;
+
+SessionFixture::SessionFixture(const QString &name)
+{
+    this->name = name;
+    init = new QCA::Initializer();
+    cfg = 0;
+    db = 0;
+    spreadsheet = 0;
+    error_count = 0;
+    refresh_count = 0;
+    logged_in = false;
+}
+
+SessionFixture::~SessionFixture()
+{
+    closeTable();
+    delete db;
+    delete cfg;
+    delete init;
+    QFile::remove(name + ".xml");
+    QFile::remove(name + ".db");
+}
+
+//login and refresh finish on the thread pool, their signals end the wait
+void SessionFixture::waitFor(const char *signal, int msecs)
+{
+    QEventLoop loop;
+    connect(db, signal, &loop, SLOT(quit()));
+    connect(db, SIGNAL(queryError(QString)), &loop, SLOT(quit()));
+    QTimer::singleShot(msecs, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+bool SessionFixture::login()
+{
+    QFile::remove(name + ".db");
+    if (!createSchema("QSQLITE", QString(), 0, name + ".db",
+                      ROOT_DIR "/tables.sql"))
+        return false;
+
+    cfg = new CFGManager(name + ".xml");
+    cfg->setDBType("QSQLITE");
+    cfg->setDBName(name + ".db");
+    cfg->saveDoc();
+
+    db = new DBManager(cfg, name);
+    connect(db, SIGNAL(queryError(QString)), this, SLOT(failed(QString)));
+    connect(db, SIGNAL(tableCreated(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(tableOpened(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(loggedIn(int)), this, SLOT(loggedIn()));
+    connect(db, SIGNAL(dataDecoded(RefreshPayload)), this, SLOT(refreshed()));
+
+    db->connectDB("bench", "bench-password");
+    if (!logged_in && error_count == 0)
+        waitFor(SIGNAL(loggedIn(int)), loginTimeout);
+    return logged_in && error_count == 0;
+}
+
+//what MainWindow does before it loads another table
+void SessionFixture::closeTable()
+{
+    if (db != 0)
+        db->removeCurrentData();
+    delete spreadsheet;
+    spreadsheet = 0;
+}
+
+bool SessionFixture::createTable(const QString &table,
+                                 const QString &format, int columns, int rows)
+{
+    int errorsBefore = error_count;
+    closeTable();
+    cfg->setStorageFormat(format);
+    db->createTable(table, columns, rows, "Root");
+    return spreadsheet != 0 && error_count == errorsBefore;
+}
+
+bool SessionFixture::openTable(const QString &table, int columns, int rows)
+{
+    int errorsBefore = error_count;
+    closeTable();
+    db->openTable(table, columns, rows, "");
+    return spreadsheet != 0 && error_count == errorsBefore;
+}
+
+//one getData round trip, decrypted on the pool and applied to the sheet
+bool SessionFixture::refresh()
+{
+    int errorsBefore = error_count;
+    int refreshesBefore = refresh_count;
+    db->getData();
+    if (refresh_count == refreshesBefore)
+        waitFor(SIGNAL(dataDecoded(RefreshPayload)), refreshTimeout);
+    return refresh_count == refreshesBefore + 1 && error_count == errorsBefore;
+}
+
+CFGManager *SessionFixture::config() const
+{
+    return cfg;
+}
+
+DBManager *SessionFixture::manager() const
+{
+    return db;
+}
+
+SpreadSheet *SessionFixture::sheet() const
+{
+    return spreadsheet;
+}
+
+int SessionFixture::errors() const
+{
+    return error_count;
+}
+
+void SessionFixture::failed(const QString &error)
+{
+    qWarning("%s", qPrintable(error));
+    error_count++;
+}
+
+void SessionFixture::loggedIn()
+{
+    logged_in = true;
+}
+
+void SessionFixture::refreshed()
+{
+    refresh_count++;
+}
+
+void SessionFixture::tableReady(const QString &name, int columns, int rows)
+{
+    Q_UNUSED(name);
+    delete spreadsheet;
+    spreadsheet = new SpreadSheet(rows, columns, 0, db);
+    spreadsheet->getTimer()->stop();
+    db->setCurrentSpreadSheet(spreadsheet);
+}
@@ -0,0 +1,51 @@
+#ifndef SESSIONFIXTURE_H
+#define SESSIONFIXTURE_H
+
+#include <QtCore>
+#include <QtCrypto>
+
+class CFGManager;
+class DBManager;
+class SpreadSheet;
+
+//a logged in DBManager on a fresh SQLite database named after the suite,
+//with the sheet of the open table attached the way MainWindow does it
+class SessionFixture : public QObject
+{
+    Q_OBJECT
+public:
+    SessionFixture(const QString &name);
+    ~SessionFixture();
+
+    bool login();
+    void closeTable();
+    bool createTable(const QString &table, const QString &format,
+                     int columns, int rows);
+    bool openTable(const QString &table, int columns, int rows);
+    bool refresh();
+
+    CFGManager *config() const;
+    DBManager *manager() const;
+    SpreadSheet *sheet() const;
+    int errors() const;
+
+private:
+    QString name;
+    QCA::Initializer *init;
+    CFGManager *cfg;
+    DBManager *db;
+    SpreadSheet *spreadsheet;
+    int error_count;
+    int refresh_count;
+    bool logged_in;
+
+    void waitFor(const char *signal, int msecs);
+
+private slots:
+    void failed(const QString &error);
+    void loggedIn();
+    void refreshed();
+    void tableReady(const QString &name, int columns, int rows);
+};
+
+#endif // SESSIONFIXTURE_H
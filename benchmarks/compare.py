@@ -0,0 +1,220 @@
+#!/usr/bin/env python
+#
+# Runs the QBENCHMARK suites and compares every result against a stored
+# baseline. Exits with 1 when a metric got slower than the allowed
+# threshold, a baseline metric is missing or was never measured, or there
+# is no baseline at all, 2 when a suite failed to run.
+#
+#   compare.py                      run the suites, compare to baseline.json
+#   compare.py --update             run the suites, store them as baseline
+#   compare.py --threshold 5        allow 5% instead of the default 10%
+#   compare.py results/*.xml        compare already written -xml results
+#
+# Per metric thresholds can be set in baseline.json, they survive --update:
+#   "thresholds": {"DatabaseBenchmark/getData:row": 25}
+#
+# A metric stored with a null value is tracked but not measured yet, it
+# fails until --update is run on the reference machine.
+
+import json
+import os
+import subprocess
+import sys
+import xml.etree.ElementTree as ET
+from optparse import OptionParser
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SUITES = ["formula", "crypto", "serialization", "database",
+          "memory"]
+
+
+#the QtTest class name, which prefixes every metric of the suite
+def suite_name(suite):
+    return suite.capitalize() + "Benchmark"
+
+
+def suite_binary(bin_dir, suite):
+    name = "tst_%s" % suite
+    for candidate in [os.path.join(bin_dir, "suites", suite, name),
+                      os.path.join(bin_dir, "suites", suite, "release",
+                                   name + ".exe"),
+                      os.path.join(bin_dir, "suites", suite, name + ".exe")]:
+        if os.path.isfile(candidate):
+            return candidate
+    return None
+
+
+def run_suites(options, suites):
+    if not os.path.isdir(options.results):
+        os.makedirs(options.results)
+    files = []
+    for suite in suites:
+        binary = suite_binary(options.bin_dir, suite)
+        if binary is None:
+            sys.stderr.write("tst_%s is not built, run make benchmarks\n"
+                             % suite)
+            return None
+        output = os.path.join(options.results, "tst_%s.xml" % suite)
+        command = [binary, "-xml", "-o", output]
+        if options.median > 1:
+            command += ["-median", str(options.median)]
+        #the database suite keeps its SQLite file next to the binary
+        status = subprocess.call(command, cwd=os.path.dirname(binary))
+        if status != 0:
+            sys.stderr.write("%s failed with status %d, see %s\n"
+                             % (os.path.basename(binary), status, output))
+            return None
+        files.append(output)
+    return files
+
+
+#QtTest writes the total of all iterations, the metric is per iteration
+def parse_results(fileName):
+    results = {}
+    root = ET.parse(fileName).getroot()
+    suite = root.get("name")
+    if suite is None:
+        suite = os.path.splitext(os.path.basename(fileName))[0]
+    for function in root.iter("TestFunction"):
+        for result in function.iter("BenchmarkResult"):
+            key = "%s/%s" % (suite, function.get("name"))
+            if result.get("tag"):
+                key += ":" + result.get("tag")
+            iterations = max(1, int(result.get("iterations", "1")))
+            results[key] = {"metric": result.get("metric"),
+                            "value": float(result.get("value")) / iterations}
+    return results
+
+
+def load_baseline(fileName):
+    if not os.path.isfile(fileName):
+        return None
+    with open(fileName) as f:
+        return json.load(f)
+
+
+#metrics of suites that were not run are kept as they were
+def save_baseline(fileName, results, previous, suites=None):
+    baseline = {"metrics": {}, "thresholds": {}}
+    if previous is not None:
+        baseline["thresholds"] = previous.get("thresholds", {})
+        for key, value in previous.get("metrics", {}).items():
+            if suites is not None and key.split("/")[0] not in suites:
+                baseline["metrics"][key] = value
+    baseline["metrics"].update(results)
+    with open(fileName, "w") as f:
+        json.dump(baseline, f, indent=2, sort_keys=True)
+        f.write("\n")
+
+
+def compare(results, baseline, threshold, suites=None):
+    regressions = 0
+    unmeasured = 0
+    metrics = baseline.get("metrics", {})
+    thresholds = baseline.get("thresholds", {})
+    print("%-50s %14s %14s %9s" % ("benchmark", "baseline", "current",
+                                   "change"))
+    for key in sorted(results):
+        current = results[key]
+        old = metrics.get(key)
+        if old is None or old["metric"] != current["metric"]:
+            print("%-50s %14s %14.4f %9s" % (key, "-", current["value"],
+                                             "new"))
+            continue
+        if old["value"] is None:
+            print("%-50s %14s %14.4f %9s" % (key, "-", current["value"],
+                                             "UNMEASURED"))
+            unmeasured += 1
+            continue
+        if old["value"] <= 0:
+            continue
+        change = (current["value"] - old["value"]) * 100.0 / old["value"]
+        allowed = thresholds.get(key, threshold)
+        mark = ""
+        if change > allowed:
+            mark = "  REGRESSION (> %g%%)" % allowed
+            regressions += 1
+        print("%-50s %14.4f %14.4f %+8.1f%%%s" % (key, old["value"],
+                                                  current["value"], change,
+                                                  mark))
+    #a dropped or renamed benchmark fails until the baseline is updated
+    missing = 0
+    for key in sorted(set(metrics) - set(results)):
+        if suites is not None and key.split("/")[0] not in suites:
+            continue
+        old = metrics[key]["value"]
+        if old is not None:
+            old = "%.4f" % old
+        print("%-50s %14s %14s %9s" % (key, old or "-", "-", "MISSING"))
+        missing += 1
+    return regressions, missing, unmeasured
+
+
+def main():
+    parser = OptionParser(usage="%prog [options] [results.xml ...]")
+    parser.add_option("--baseline", default=os.path.join(HERE,
+                                                         "baseline.json"),
+                      help="stored baseline (default %default)")
+    parser.add_option("--threshold", type="float", default=10.0,
+                      help="allowed slowdown in percent (default %default)")
+    parser.add_option("--update", action="store_true", default=False,
+                      help="store the results as the new baseline")
+    parser.add_option("--bin-dir", default=HERE,
+                      help="build directory of benchmarks.pro")
+    parser.add_option("--results", default=os.path.join(HERE, "results"),
+                      help="where the -xml results are written")
+    parser.add_option("--suite", action="append", choices=SUITES,
+                      help="run only this suite, can be repeated")
+    parser.add_option("--median", type="int", default=5,
+                      help="runs per benchmark, the median is kept")
+    options, files = parser.parse_args()
+
+    #checked before the suites run for minutes
+    baseline = load_baseline(options.baseline)
+    if baseline is None and not options.update:
+        sys.stderr.write("%s not found, run with --update to store the "
+                         "results as baseline\n" % options.baseline)
+        return 1
+
+    files_given = bool(files)
+    if not files:
+        files = run_suites(options, options.suite or SUITES)
+        if files is None:
+            return 2
+    results = {}
+    for fileName in files:
+        results.update(parse_results(fileName))
+    if not results:
+        sys.stderr.write("no benchmark results found\n")
+        return 2
+
+    #metrics of suites that were not run are not missing
+    suites = None
+    if files_given:
+        suites = set(key.split("/")[0] for key in results)
+    elif options.suite:
+        suites = set(suite_name(suite) for suite in options.suite)
+
+    if options.update:
+        save_baseline(options.baseline, results, baseline, suites)
+        print("stored %d results as baseline in %s" % (len(results),
+                                                       options.baseline))
+        return 0
+
+    regressions, missing, unmeasured = compare(results, baseline,
+                                               options.threshold, suites)
+    if regressions:
+        print("\n%d benchmark(s) regressed" % regressions)
+    if missing:
+        print("\n%d benchmark(s) missing, run with --update if they were "
+              "removed on purpose" % missing)
+    if unmeasured:
+        print("\n%d benchmark(s) have no baseline value, run with --update "
+              "on the reference machine" % unmeasured)
+    if regressions or missing or unmeasured:
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
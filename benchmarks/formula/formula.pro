@@ -0,0 +1,11 @@
+include(../benchmarks.pri)
+include(../app.pri)
+
+QT += sql
+
+TARGET = formula_benchmark
+
+SOURCES += main.cpp \
+    $$ROOT/benchmarks/common/FormulaScenarios.cpp
+
+HEADERS += $$ROOT/benchmarks/common/FormulaScenarios.h
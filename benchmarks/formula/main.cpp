@@ -0,0 +1,212 @@
+#include <QtGui>
+#include "SpreadSheet.h"
+#include "Cell.h"
+#include "Benchmark.h"
+#include "FormulaScenarios.h"
+
+static const qint64 maxOps = 1 << 20;
+
+struct Result
+{
+    QString scenario;
+    QString phase;
+    int cells;
+    Measurement time;
+};
+
+template <typename Op>
+static Result measure(const Scenario &scenario, const QString &phase,
+                      const Op &op)
+{
+    Result result;
+    result.scenario = scenario.name;
+    result.phase = phase;
+    result.cells = scenario.formulas.size();
+    result.time = measure(op, maxOps);
+    return result;
+}
+
+//rewrites every formula of the sheet into its evaluable form
+struct Parse
+{
+    Parse(const Scenario &scenario) : scenario(scenario) {}
+    int operator()() const
+    {
+        int length = 0;
+        for (int i=0; i<scenario.formulas.size(); i++)
+        {
+            Cell *cell = scenario.formula(i);
+            length += cell->expression(cell->formula()).size();
+        }
+        return length;
+    }
+    const Scenario &scenario;
+};
+
+//evaluates the already rewritten formulas
+struct Evaluate
+{
+    Evaluate(const Scenario &scenario) : scenario(scenario)
+    {
+        for (int i=0; i<scenario.formulas.size(); i++)
+        {
+            Cell *cell = scenario.formula(i);
+            expressions << cell->expression(cell->formula());
+        }
+    }
+    int operator()() const
+    {
+        int valid = 0;
+        for (int i=0; i<scenario.formulas.size(); i++)
+            if (scenario.formula(i)->computeFormula(expressions.at(i),
+                                                    scenario.sheet).isValid())
+                valid++;
+        return valid;
+    }
+    const Scenario &scenario;
+    QStringList expressions;
+};
+
+//what a repaint of the whole sheet costs, every cell asked for its value
+struct Recalc
+{
+    Recalc(const Scenario &scenario) : scenario(scenario) {}
+    int operator()() const
+    {
+        int length = 0;
+        SpreadSheet *sheet = scenario.sheet;
+        for (int r=0; r<sheet->rowCount(); r++)
+            for (int c=0; c<sheet->columnCount(); c++)
+            {
+                QTableWidgetItem *item = sheet->item(r, c);
+                if (item != 0)
+                    length += item->data(Qt::DisplayRole).toString().size();
+            }
+        return length;
+    }
+    const Scenario &scenario;
+};
+
+static bool writeJson(const QString &fileName, const QList<Result> &results,
+                      qint64 lookups)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QTextStream out(&file);
+    out << "{\n  \"benchmark\": \"formula\",\n"
+        << "  \"link_lookups\": " << lookups << ",\n  \"results\": [\n";
+    for (int i=0; i<results.size(); i++)
+    {
+        const Result &r = results.at(i);
+        out << "    {\"scenario\": " << jsonString(r.scenario)
+            << ", \"phase\": " << jsonString(r.phase)
+            << ", \"cells\": " << r.cells
+            << ", \"ops\": " << r.time.ops
+            << ", \"ns_per_op\": "
+            << QString::number((double)r.time.nsecs / r.time.ops, 'f', 1)
+            << ", \"ns_per_cell\": "
+            << QString::number((double)r.time.nsecs / r.time.ops /
+                               qMax(1, r.cells), 'f', 1)
+            << "}" << ((i < results.size()-1)?",":"") << "\n";
+    }
+    out << "  ]\n}\n";
+    return true;
+}
+
+//the generated sheets, so the same formulas can be replayed elsewhere
+static bool writeCorpus(const QString &fileName,
+                        const QList<Scenario> &scenarios)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    QTextStream out(&file);
+    for (int s=0; s<scenarios.size(); s++)
+    {
+        SpreadSheet *sheet = scenarios.at(s).sheet;
+        for (int r=0; r<sheet->rowCount(); r++)
+            for (int c=0; c<sheet->columnCount(); c++)
+                if (sheet->item(r, c) != 0)
+                    out << scenarios.at(s).name << "\t" << cellName(r, c) << "\t"
+                        << static_cast<Cell*>(sheet->item(r, c))->formula() << "\n";
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+
+    QStringList args = app.arguments();
+    QString output = option(args, "--json", "formula_benchmark.json");
+    QString corpus = option(args, "--corpus", "");
+    int depth = qBound(2, option(args, "--depth", "100").toInt(), 999);
+    int width = qBound(1, option(args, "--width", "200").toInt(), 999);
+
+    MockLinks provider;
+    QList<Scenario> scenarios = formulaScenarios(depth, width, &provider);
+
+    //timing a wrong result is meaningless, fail before measuring
+    bool correct = true;
+    for (int s=0; s<scenarios.size(); s++)
+    {
+        const Scenario &scenario = scenarios.at(s);
+        if (scenario.check.isEmpty())
+            continue;
+        QString value = scenario.checkedValue();
+        if (value != scenario.expected)
+        {
+            qWarning("%s: %s is %s, expected %s", qPrintable(scenario.name),
+                     qPrintable(scenario.check), qPrintable(value),
+                     qPrintable(scenario.expected));
+            correct = false;
+        }
+    }
+    if (!correct)
+    {
+        for (int s=0; s<scenarios.size(); s++)
+            delete scenarios.at(s).sheet;
+        return 3;
+    }
+
+    QList<Result> results;
+    provider.lookups = 0;
+    for (int s=0; s<scenarios.size(); s++)
+    {
+        const Scenario &scenario = scenarios.at(s);
+        results << measure(scenario, "parse", Parse(scenario));
+        results << measure(scenario, "evaluate", Evaluate(scenario));
+        results << measure(scenario, "recalc", Recalc(scenario));
+    }
+
+    QTextStream out(stdout);
+    out << "scenario\tphase\tcells\tops\tns_per_op\tns_per_cell" << endl;
+    for (int r=0; r<results.size(); r++)
+    {
+        const Result &result = results.at(r);
+        out << result.scenario << "\t" << result.phase << "\t"
+            << result.cells << "\t" << result.time.ops << "\t"
+            << QString::number((double)result.time.nsecs / result.time.ops,
+                               'f', 1)
+            << "\t"
+            << QString::number((double)result.time.nsecs / result.time.ops /
+                               qMax(1, result.cells), 'f', 1)
+            << endl;
+    }
+    out << "link_lookups\t" << provider.lookups << endl;
+
+    bool ok = writeJson(output, results, provider.lookups);
+    if (!ok)
+        qWarning("Unable to write %s", qPrintable(output));
+    if (!corpus.isEmpty() && !writeCorpus(corpus, scenarios))
+    {
+        qWarning("Unable to write %s", qPrintable(corpus));
+        ok = false;
+    }
+
+    for (int s=0; s<scenarios.size(); s++)
+        delete scenarios.at(s).sheet;
+    //keeps the measured calls from being optimized away
+    return !ok?1:(benchmarkSink == -1)?2:0;
+}
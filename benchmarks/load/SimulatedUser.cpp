@@ -0,0 +1,204 @@
+#include "SimulatedUser.h"
+#include "CFGManager.h"
+#include "DBManager.h"
+#include "SpreadSheet.h"
+
+//key pair generation for a new account runs on the thread pool
+static const int loginTimeout = 120000;
+
+SimulatedUser::SimulatedUser(int id, const LoadOptions &options,
+                             QObject *parent) :
+    QObject(parent), options(options)
+{
+    user_name = QString("bench%1").arg(id);
+    sheet = 0;
+    wait = 0;
+    polling = false;
+    logged_in = false;
+    error_count = 0;
+
+    cfg = new CFGManager(QString("load_%1.xml").arg(user_name));
+    cfg->setDBType(options.driver);
+    cfg->setDBServer(options.server);
+    cfg->setDBPort(options.port);
+    cfg->setDBName(options.database);
+    cfg->saveDoc();
+
+    db = new DBManager(cfg, user_name);
+    connect(db, SIGNAL(queryError(QString)), this, SLOT(failed(QString)));
+    connect(db, SIGNAL(loggedIn(int)), this, SLOT(loggedIn(int)));
+    connect(db, SIGNAL(tableCreated(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(tableOpened(QString,int,int)),
+            this, SLOT(tableReady(QString,int,int)));
+    connect(db, SIGNAL(dataDecoded(RefreshPayload)),
+            this, SLOT(polled(RefreshPayload)));
+
+    editTimer = new QTimer(this);
+    editTimer->setInterval(qMax(1, qRound(1000 / options.editRate)));
+    connect(editTimer, SIGNAL(timeout()), this, SLOT(edit()));
+    pollTimer = new QTimer(this);
+    pollTimer->setInterval(options.pollInterval);
+    connect(pollTimer, SIGNAL(timeout()), this, SLOT(poll()));
+}
+
+SimulatedUser::~SimulatedUser()
+{
+    stop();
+    delete sheet;
+    delete db;
+    delete cfg;
+    QFile::remove(QString("load_%1.xml").arg(user_name));
+}
+
+QString SimulatedUser::name() const
+{
+    return user_name;
+}
+
+QString SimulatedUser::lastError() const
+{
+    return last_error;
+}
+
+bool SimulatedUser::waitFor(int msecs)
+{
+    QEventLoop loop;
+    wait = &loop;
+    QTimer::singleShot(msecs, &loop, SLOT(quit()));
+    int errorsBefore = error_count;
+    loop.exec();
+    wait = 0;
+    return error_count == errorsBefore;
+}
+
+bool SimulatedUser::login()
+{
+    QString password = QString("%1-password").arg(user_name);
+    db->connectDB(user_name, password);
+    if (!logged_in && error_count == 0)
+        waitFor(loginTimeout);
+    if (!logged_in)
+    {
+        if (last_error.isEmpty())
+            last_error = "Login timed out";
+        return false;
+    }
+
+    if (!options.format.isEmpty())
+        cfg->setStorageFormat(options.format);
+    if (!options.profile.isEmpty())
+        cfg->setCipherProfile(options.profile);
+    return true;
+}
+
+bool SimulatedUser::createTable(const QString &table)
+{
+    int errorsBefore = error_count;
+    db->createTable(table, options.columns, options.rows, "Root");
+    return sheet != 0 && error_count == errorsBefore;
+}
+
+bool SimulatedUser::grant(const QString &username)
+{
+    int errorsBefore = error_count;
+    QList<int> columns;
+    for (int i=0; i<options.columns; i++)
+        columns.append(i);
+    db->grantReadAccess(username);
+    db->grantWriteAccess(username, columns);
+    return error_count == errorsBefore;
+}
+
+bool SimulatedUser::openTable(const QString &table)
+{
+    int errorsBefore = error_count;
+    db->openTable(table, options.columns, options.rows, "");
+    return sheet != 0 && error_count == errorsBefore;
+}
+
+void SimulatedUser::start()
+{
+    editTimer->start();
+    pollTimer->start();
+}
+
+void SimulatedUser::stop()
+{
+    editTimer->stop();
+    pollTimer->stop();
+}
+
+const Histogram &SimulatedUser::editLatency() const
+{
+    return edits;
+}
+
+const Histogram &SimulatedUser::pollLatency() const
+{
+    return polls;
+}
+
+int SimulatedUser::errors() const
+{
+    return error_count;
+}
+
+void SimulatedUser::edit()
+{
+    int row = qrand() % options.rows;
+    int column = qrand() % options.columns;
+    QString formula = QString::number(qrand() % 1000 / 100.0, 'f', 2);
+
+    QElapsedTimer clock;
+    clock.start();
+    if (db->writeData(row, column, CellCodec::encode(CellStyle(), formula)))
+        edits.add(clock.nsecsElapsed() / 1000);
+}
+
+void SimulatedUser::poll()
+{
+    if (polling)
+        return;
+    polling = true;
+    poll_clock.start();
+    db->getData();
+}
+
+void SimulatedUser::polled(const RefreshPayload &data)
+{
+    Q_UNUSED(data);
+    if (!polling)
+        return;
+    polling = false;
+    polls.add(poll_clock.nsecsElapsed() / 1000);
+    if (wait != 0)
+        wait->quit();
+}
+
+void SimulatedUser::failed(const QString &error)
+{
+    last_error = error;
+    error_count++;
+    polling = false;
+    if (wait != 0)
+        wait->quit();
+}
+
+void SimulatedUser::loggedIn(int uid)
+{
+    Q_UNUSED(uid);
+    logged_in = true;
+    if (wait != 0)
+        wait->quit();
+}
+
+void SimulatedUser::tableReady(const QString &name, int columns, int rows)
+{
+    Q_UNUSED(name);
+    delete sheet;
+    sheet = new SpreadSheet(rows, columns, 0, db);
+    //polling is driven by the benchmark, not the sheet's refresh timer
+    sheet->getTimer()->stop();
+    db->setCurrentSpreadSheet(sheet);
+}
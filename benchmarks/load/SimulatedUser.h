@@ -0,0 +1,77 @@
+#ifndef SIMULATEDUSER_H
+#define SIMULATEDUSER_H
+
+#include <QtGui>
+#include "Histogram.h"
+
+class CFGManager;
+class DBManager;
+class SpreadSheet;
+class RefreshPayload;
+
+struct LoadOptions
+{
+    QString driver;
+    QString server;
+    int port;
+    QString database;
+    QString format;
+    QString profile;
+    int users;
+    int seconds;
+    double editRate;
+    int pollInterval;
+    int rows;
+    int columns;
+};
+
+//one client session driving DBManager the way MainWindow does
+class SimulatedUser : public QObject
+{
+    Q_OBJECT
+public:
+    SimulatedUser(int id, const LoadOptions &options, QObject *parent = 0);
+    ~SimulatedUser();
+
+    QString name() const;
+    QString lastError() const;
+    bool login();
+    bool createTable(const QString &table);
+    bool grant(const QString &username);
+    bool openTable(const QString &table);
+    void start();
+    void stop();
+
+    const Histogram &editLatency() const;
+    const Histogram &pollLatency() const;
+    int errors() const;
+
+private slots:
+    void edit();
+    void poll();
+    void polled(const RefreshPayload &data);
+    void failed(const QString &error);
+    void loggedIn(int uid);
+    void tableReady(const QString &name, int columns, int rows);
+
+private:
+    QString user_name;
+    QString last_error;
+    LoadOptions options;
+    CFGManager *cfg;
+    DBManager *db;
+    SpreadSheet *sheet;
+    QTimer *editTimer;
+    QTimer *pollTimer;
+    QEventLoop *wait;
+    QElapsedTimer poll_clock;
+    Histogram edits;
+    Histogram polls;
+    bool polling;
+    bool logged_in;
+    int error_count;
+
+    bool waitFor(int msecs);
+};
+
+#endif // SIMULATEDUSER_H
@@ -0,0 +1,11 @@
+include(../benchmarks.pri)
+
+CONFIG += app_database
+include(../app.pri)
+
+TARGET = load_benchmark
+
+SOURCES += main.cpp \
+    SimulatedUser.cpp
+
+HEADERS += SimulatedUser.h
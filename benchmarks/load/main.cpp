@@ -0,0 +1,222 @@
+#include <QtGui>
+#include <QtSql>
+#include <QtCrypto>
+#include "SimulatedUser.h"
+#include "SpreadSheet.h"
+#include "Trace.h"
+#include "Benchmark.h"
+
+static const char *usage =
+    "usage: load_benchmark [options]\n"
+    "  --users N          simulated users (default 4)\n"
+    "  --seconds N        measured run time (default 30)\n"
+    "  --edit-rate R      cell edits per second per user (default 2)\n"
+    "  --poll-ms N        getData refresh interval (default 1000)\n"
+    "  --rows N --columns N   shared table size (default 200 x 10)\n"
+    "  --format F         hex, binary or row (default binary)\n"
+    "  --profile P        cbc or ctr-hmac (default ctr-hmac)\n"
+    "  --driver D         QSQLITE (default) or QMYSQL\n"
+    "  --server S --port N --database NAME\n"
+    "  --schema FILE      schema script (default tables.sql of the tree)\n"
+    "  --json FILE        also write the results as JSON\n"
+    "With QMYSQL the database must be empty and accounts bench0..benchN-1\n"
+    "with password <name>-password must exist, as DBManager logs in with\n"
+    "the application user. Run under xvfb-run on X11 without a display.\n";
+
+static QList<QPair<QString, int> > rowCounts(const LoadOptions &options)
+{
+    QList<QPair<QString, int> > counts;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase(options.driver, "report");
+        db.setHostName(options.server);
+        db.setPort(options.port);
+        db.setDatabaseName(options.database);
+        if (db.open())
+        {
+            QStringList tables;
+            tables << "users" << "files" << "rights" << "access_keys"
+                   << "tables_settings";
+            QSqlQuery query(db);
+            if (query.exec("SELECT table_name FROM files"))
+                while (query.next())
+                    tables << query.value(0).toString();
+            for (int i=0; i<tables.size(); i++)
+            {
+                int count = -1;
+                if (query.exec(QString("SELECT COUNT(*) FROM %1").
+                               arg(tables.at(i))) && query.next())
+                    count = query.value(0).toInt();
+                counts << qMakePair(tables.at(i), count);
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase("report");
+    return counts;
+}
+
+static QString latencyRow(const QString &name, const Histogram &histogram,
+                          int seconds)
+{
+    return QString("%1\t%2\t%3\t%4\t%5\t%6").arg(name).
+            arg(histogram.count()).
+            arg(QString::number((double)histogram.count() / seconds, 'f', 1)).
+            arg(histogram.percentile(50)).arg(histogram.percentile(99)).
+            arg(histogram.max());
+}
+
+static QString latencyJson(const QString &name, const Histogram &histogram,
+                           int seconds)
+{
+    return QString("\"%1\": {\"count\": %2, \"per_sec\": %3, "
+                   "\"p50_us\": %4, \"p99_us\": %5, \"max_us\": %6}").
+            arg(name).arg(histogram.count()).
+            arg(QString::number((double)histogram.count() / seconds, 'f', 1)).
+            arg(histogram.percentile(50)).arg(histogram.percentile(99)).
+            arg(histogram.max());
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QCA::Initializer init;
+
+    QStringList args = app.arguments();
+    if (args.contains("--help"))
+    {
+        QTextStream(stdout) << usage;
+        return 0;
+    }
+
+    LoadOptions options;
+    options.users = qMax(1, option(args, "--users", "4").toInt());
+    options.seconds = qMax(1, option(args, "--seconds", "30").toInt());
+    options.editRate = qMax(0.1, option(args, "--edit-rate", "2").toDouble());
+    options.pollInterval = qMax(10, option(args, "--poll-ms", "1000").toInt());
+    options.rows = qMax(1, option(args, "--rows", "200").toInt());
+    options.columns = qMax(1, option(args, "--columns", "10").toInt());
+    options.format = option(args, "--format", "binary");
+    options.profile = option(args, "--profile", "ctr-hmac");
+    options.driver = option(args, "--driver", "QSQLITE");
+    options.server = option(args, "--server", "localhost");
+    options.port = option(args, "--port", "3306").toInt();
+    options.database = option(args, "--database", "load_benchmark.db");
+    QString schema = option(args, "--schema", QString(ROOT_DIR "/tables.sql"));
+    QString json = option(args, "--json", "");
+
+    if (!QSqlDatabase::drivers().contains(options.driver))
+    {
+        qWarning("Driver %s is not available", qPrintable(options.driver));
+        return 1;
+    }
+    if (options.driver == "QSQLITE")
+        QFile::remove(options.database);
+    if (!createSchema(options.driver, options.server, options.port,
+                      options.database, schema))
+        return 1;
+    qsrand(QDateTime::currentDateTime().toTime_t());
+    //SEM_TRACE records the refresh cycles of all sessions
+    Trace::start(QString());
+
+    QElapsedTimer setup;
+    setup.start();
+    QList<SimulatedUser*> users;
+    for (int i=0; i<options.users; i++)
+    {
+        SimulatedUser *user = new SimulatedUser(i, options);
+        users << user;
+        if (!user->login())
+        {
+            qWarning("%s: %s", qPrintable(user->name()),
+                     qPrintable(user->lastError()));
+            qDeleteAll(users);
+            return 1;
+        }
+    }
+
+    //one shared sheet, the first user owns it and grants the others
+    bool ready = users.first()->createTable("load");
+    for (int i=1; ready && i<users.size(); i++)
+        ready = users.first()->grant(users.at(i)->name()) &&
+                users.at(i)->openTable("load");
+    if (!ready)
+    {
+        for (int i=0; i<users.size(); i++)
+            if (!users.at(i)->lastError().isEmpty())
+                qWarning("%s: %s", qPrintable(users.at(i)->name()),
+                         qPrintable(users.at(i)->lastError()));
+        qDeleteAll(users);
+        return 1;
+    }
+    qint64 setupMsecs = setup.elapsed();
+
+    for (int i=0; i<users.size(); i++)
+        users.at(i)->start();
+    QEventLoop run;
+    QTimer::singleShot(options.seconds * 1000, &run, SLOT(quit()));
+    run.exec();
+    for (int i=0; i<users.size(); i++)
+        users.at(i)->stop();
+
+    QTextStream out(stdout);
+    out << "driver\t" << options.driver << endl
+        << "users\t" << options.users << endl
+        << "format\t" << options.format << "/" << options.profile << endl
+        << "setup_ms\t" << setupMsecs << endl << endl
+        << "user\top\tcount\tper_sec\tp50_us\tp99_us\tmax_us" << endl;
+    Histogram edits, polls;
+    int errors = 0;
+    for (int i=0; i<users.size(); i++)
+    {
+        const SimulatedUser *user = users.at(i);
+        out << user->name() << "\t"
+            << latencyRow("edit", user->editLatency(), options.seconds) << endl
+            << user->name() << "\t"
+            << latencyRow("poll", user->pollLatency(), options.seconds) << endl;
+        edits.merge(user->editLatency());
+        polls.merge(user->pollLatency());
+        errors += user->errors();
+    }
+    out << "all\t" << latencyRow("edit", edits, options.seconds) << endl
+        << "all\t" << latencyRow("poll", polls, options.seconds) << endl
+        << endl << "errors\t" << errors << endl << endl;
+
+    QList<QPair<QString, int> > counts = rowCounts(options);
+    out << "table\trows" << endl;
+    for (int i=0; i<counts.size(); i++)
+        out << counts.at(i).first << "\t" << counts.at(i).second << endl;
+
+    if (!json.isEmpty())
+    {
+        QFile file(json);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qWarning("Unable to write %s", qPrintable(json));
+            qDeleteAll(users);
+            return 1;
+        }
+        QTextStream js(&file);
+        js << "{\n  \"benchmark\": \"load\",\n"
+           << "  \"driver\": \"" << options.driver << "\",\n"
+           << "  \"users\": " << options.users << ",\n"
+           << "  \"seconds\": " << options.seconds << ",\n"
+           << "  " << latencyJson("edit", edits, options.seconds) << ",\n"
+           << "  " << latencyJson("poll", polls, options.seconds) << ",\n"
+           << "  \"errors\": " << errors << ",\n  \"sessions\": [\n";
+        for (int i=0; i<users.size(); i++)
+            js << "    {\"user\": \"" << users.at(i)->name() << "\", "
+               << latencyJson("edit", users.at(i)->editLatency(), options.seconds)
+               << ", "
+               << latencyJson("poll", users.at(i)->pollLatency(), options.seconds)
+               << "}" << ((i < users.size()-1)?",":"") << "\n";
+        js << "  ],\n  \"rows\": {";
+        for (int i=0; i<counts.size(); i++)
+            js << "\"" << counts.at(i).first << "\": " << counts.at(i).second
+               << ((i < counts.size()-1)?", ":"");
+        js << "}\n}\n";
+    }
+
+    qDeleteAll(users);
+    Trace::stop();
+    return 0;
+}
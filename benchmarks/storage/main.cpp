@@ -0,0 +1,143 @@
+#include <QtCore>
+#include <QtGui>
+#include <QtCrypto>
+#include "Security.h"
+#include "CellRecord.h"
+
+static const int columns = 10;
+
+static QByteArray legacyCell(const CellStyle &style, const QString &formula)
+{
+    QByteArray cellData;
+    QDataStream out(&cellData, QIODevice::WriteOnly);
+    out << style.font << style.foreground << style.background << formula;
+    return cellData.toHex();
+}
+
+static void report(const QString &format, int cells, qint64 stored,
+                   qint64 encodeNsecs, qint64 decodeNsecs)
+{
+    QTextStream out(stdout);
+    out << format << "\t" << cells << "\t" << stored << "\t"
+        << QString::number((double)stored / cells, 'f', 1) << "\t"
+        << QString::number(encodeNsecs / 1e6, 'f', 1) << "\t"
+        << QString::number(decodeNsecs / 1e6, 'f', 1) << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    //no display needed, fonts and brushes are only serialized
+    QApplication app(argc, argv, false);
+    QCA::Initializer init;
+
+    QStringList args = app.arguments();
+    int cells = (args.size() > 1)?args.at(1).toInt():100000;
+    if (cells < columns)
+        cells = 100000;
+    int rows = cells / columns;
+    cells = rows * columns;
+
+    QString key = Security::generateAESKey();
+    if (key.isEmpty())
+    {
+        qWarning("aes256-cbc-pkcs7 is not supported by the QCA providers");
+        return 1;
+    }
+
+    QList<CellStyle> styles;
+    CellStyle plain;
+    plain.font = QApplication::font();
+    styles.append(plain);
+    CellStyle marked = plain;
+    marked.font.setBold(true);
+    marked.background = QBrush(Qt::yellow);
+    styles.append(marked);
+
+    QList<QString> formulas;
+    for (int i=0; i<cells; i++)
+        formulas.append((i % columns == columns-1)?
+                        QString("=avg(A%1;I%1)").arg(i / columns + 1):
+                        QString::number(i % 10 + 1));
+
+    QTextStream out(stdout);
+    out << "format\tcells\tstored_bytes\tbytes_per_cell\tencode_ms\tdecode_ms" << endl;
+
+    //legacy: stream, hex, AES-CBC, hex again into VARCHAR columns
+    QElapsedTimer timer;
+    timer.start();
+    QList<QString> legacy;
+    qint64 stored = 0;
+    for (int i=0; i<cells; i++)
+    {
+        QString hex = QString(legacyCell(styles.at(i % 7 == 0), formulas.at(i)));
+        legacy.append(Security::AESEncrypt(hex, key));
+        stored += legacy.last().size();
+    }
+    qint64 encode = timer.nsecsElapsed();
+
+    timer.restart();
+    QMap<int, QList<QByteArray> > data;
+    for (int r=0; r<rows; r++)
+    {
+        QList<QByteArray> row;
+        for (int c=0; c<columns; c++)
+            row.append(Security::AESDecrypt(legacy.at(r*columns+c), key).toAscii());
+        data.insert(r, row);
+    }
+    RefreshPayload payload = RefreshPayload::decode(data);
+    report("hex", payload.cells.size(), stored, encode, timer.nsecsElapsed());
+
+    //binary: compact record, AES-CBC into BLOB columns
+    timer.restart();
+    QList<QByteArray> binary;
+    stored = 0;
+    for (int i=0; i<cells; i++)
+    {
+        binary.append(Security::AESEncryptBytes(
+                          CellCodec::encode(styles.at(i % 7 == 0), formulas.at(i)),
+                          key));
+        stored += binary.last().size();
+    }
+    encode = timer.nsecsElapsed();
+
+    timer.restart();
+    data.clear();
+    for (int r=0; r<rows; r++)
+    {
+        QList<QByteArray> row;
+        for (int c=0; c<columns; c++)
+            row.append(Security::AESDecryptBytes(binary.at(r*columns+c), key));
+        data.insert(r, row);
+    }
+    payload = RefreshPayload::decode(data);
+    report("binary", payload.cells.size(), stored, encode, timer.nsecsElapsed());
+
+    //row: one AES-CBC envelope per row with an index of the cell records
+    timer.restart();
+    QList<QByteArray> envelopes;
+    stored = 0;
+    for (int r=0; r<rows; r++)
+    {
+        RowEnvelope envelope;
+        for (int c=0; c<columns; c++)
+        {
+            int i = r*columns + c;
+            envelope.setCell(c, CellCodec::encode(styles.at(i % 7 == 0),
+                                                  formulas.at(i)));
+        }
+        envelopes.append(Security::AESEncryptBytes(envelope.toBytes(), key));
+        stored += envelopes.last().size();
+    }
+    encode = timer.nsecsElapsed();
+
+    timer.restart();
+    data.clear();
+    for (int r=0; r<rows; r++)
+        data.insert(r, RowEnvelope::fromBytes(
+                        Security::AESDecryptBytes(envelopes.at(r), key)).
+                    cells(columns));
+    payload = RefreshPayload::decode(data);
+    report("row", payload.cells.size(), stored, encode, timer.nsecsElapsed());
+
+    return 0;
+}
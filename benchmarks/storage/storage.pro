@@ -0,0 +1,12 @@
+include(../benchmarks.pri)
+
+QT += gui
+
+TARGET = storage_benchmark
+
+SOURCES += main.cpp \
+    $$ROOT/Security.cpp \
+    $$ROOT/CellRecord.cpp
+
+HEADERS += $$ROOT/Security.h \
+    $$ROOT/CellRecord.h
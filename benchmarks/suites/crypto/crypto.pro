@@ -0,0 +1,8 @@
+include(../suites.pri)
+
+TARGET = tst_crypto
+
+SOURCES += tst_crypto.cpp \
+    $$ROOT/Security.cpp
+
+HEADERS += $$ROOT/Security.h
@@ -0,0 +1,367 @@
+#include <QtCore>
+#include <QtTest>
+#include <QtCrypto>
+#include "Security.h"
+
+//getData result sets are decrypted in batches of this many cells
+static const int cellsPerBatch = 1024;
+
+//the cipher setup done by every cell before contexts were cached
+static QString uncachedDecrypt(const QString &data, const QString &key)
+{
+    QCA::Initializer init;
+    if (!QCA::isSupported("aes256-cbc-pkcs7") || key.length() != 64)
+        return "";
+
+    QCA::InitializationVector iv(QCA::hexToArray("f76a7571ebbdccd46175b2d53829ebb9"));
+    QCA::SymmetricKey k(QCA::hexToArray(key));
+    QCA::SecureArray dataToDecrypt = QCA::hexToArray(data);
+    QCA::Cipher cipher = QCA::Cipher(QString("aes256"), QCA::Cipher::CBC,
+            QCA::Cipher::DefaultPadding, QCA::Decode, k, iv);
+
+    QCA::SecureArray result = cipher.process(dataToDecrypt);
+    if (!cipher.ok())
+        return "";
+
+    return QString(result.data());
+}
+
+struct DecryptBatch
+{
+    typedef QList<QByteArray> result_type;
+    DecryptBatch(const QString &key, int profile) : key(key), profile(profile) {}
+    QList<QByteArray> operator()(const QList<QByteArray> &batch) const
+    {
+        return Security::AESDecryptBatch(batch, key, profile);
+    }
+    QString key;
+    int profile;
+};
+
+class CryptoBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    QCA::Initializer *init;
+    QString key;
+    QString passphrase;
+    QPair<QString, QString> keys;
+    Security *security;
+
+    static QByteArray comment();
+    void payloads();
+    void paths(bool uncached);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void hexEncrypt_data();
+    void hexEncrypt();
+    void hexDecrypt_data();
+    void hexDecrypt();
+    void aesEncrypt_data();
+    void aesEncrypt();
+    void aesDecrypt_data();
+    void aesDecrypt();
+    void aesDecryptBatch_data();
+    void aesDecryptBatch();
+    void aesDecryptParallel_data();
+    void aesDecryptParallel();
+    void rsaEncrypt_data();
+    void rsaEncrypt();
+    void rsaDecrypt_data();
+    void rsaDecrypt();
+    void rsaSign_data();
+    void rsaSign();
+    void rsaVerify();
+    void hash();
+};
+
+void CryptoBenchmark::initTestCase()
+{
+    init = new QCA::Initializer();
+    security = 0;
+    key = Security::generateAESKey();
+    passphrase = Security::getHash("benchmark");
+    keys = Security::generateKeyPair(passphrase);
+    if (key.isEmpty() || keys.first.isEmpty())
+        QSKIP("AES-256 or RSA is not supported by the QCA providers", SkipAll);
+    security = new Security();
+    QVERIFY(security->setAESkey(key));
+    QVERIFY(security->setRSAkeys(keys.first, keys.second, passphrase));
+}
+
+void CryptoBenchmark::cleanupTestCase()
+{
+    delete security;
+    delete init;
+}
+
+QByteArray CryptoBenchmark::comment()
+{
+    QByteArray text;
+    while (text.size() < 512)
+        text.append("Lab work handed in late, oral exam passed. ");
+    return text;
+}
+
+//cell payloads as the spreadsheet stores them, for both cipher profiles
+void CryptoBenchmark::payloads()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("profile");
+
+    QTest::newRow("grade/cbc") << QByteArray("9.50") << (int)Security::CBCProfile;
+    QTest::newRow("grade/ctr-hmac") << QByteArray("9.50") << (int)Security::CTRProfile;
+    QTest::newRow("comment/cbc") << comment() << (int)Security::CBCProfile;
+    QTest::newRow("comment/ctr-hmac") << comment() << (int)Security::CTRProfile;
+}
+
+//the static calls DBManager makes with the table key, the instance calls
+//with the key set on the session, and for decryption the pre-cache setup
+void CryptoBenchmark::paths(bool uncached)
+{
+    QTest::addColumn<QString>("data");
+    QTest::addColumn<QString>("path");
+
+    QStringList texts;
+    texts << "9.50" << "=avg(A1;I1)" << QString(comment());
+    QStringList names;
+    names << "grade" << "formula" << "comment";
+    for (int i=0; i<texts.size(); i++)
+    {
+        QTest::newRow(qPrintable(names.at(i) + "/static"))
+                << texts.at(i) << "static";
+        QTest::newRow(qPrintable(names.at(i) + "/instance"))
+                << texts.at(i) << "instance";
+        if (uncached)
+            QTest::newRow(qPrintable(names.at(i) + "/uncached"))
+                    << texts.at(i) << "uncached";
+    }
+}
+
+void CryptoBenchmark::hexEncrypt_data()
+{
+    paths(false);
+}
+
+//hex storage, the format of tables created before binary storage
+void CryptoBenchmark::hexEncrypt()
+{
+    QFETCH(QString, data);
+    QFETCH(QString, path);
+    QString encrypted;
+    bool instance = path == "instance";
+    QBENCHMARK
+    {
+        encrypted = instance?security->AESEncrypt(data):
+                             Security::AESEncrypt(data, key);
+    }
+    QCOMPARE(Security::AESDecrypt(encrypted, key), data);
+}
+
+void CryptoBenchmark::hexDecrypt_data()
+{
+    paths(true);
+}
+
+void CryptoBenchmark::hexDecrypt()
+{
+    QFETCH(QString, data);
+    QFETCH(QString, path);
+    QString encrypted = Security::AESEncrypt(data, key);
+    QString decrypted;
+    bool instance = path == "instance", uncached = path == "uncached";
+    QBENCHMARK
+    {
+        decrypted = instance?security->AESDecrypt(encrypted):
+                    uncached?uncachedDecrypt(encrypted, key):
+                             Security::AESDecrypt(encrypted, key);
+    }
+    QCOMPARE(decrypted, data);
+}
+
+void CryptoBenchmark::aesEncrypt_data()
+{
+    payloads();
+}
+
+void CryptoBenchmark::aesEncrypt()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, profile);
+    QByteArray encrypted;
+    QBENCHMARK
+    {
+        encrypted = Security::AESEncryptBytes(data, key, profile);
+    }
+    QVERIFY(!encrypted.isEmpty());
+}
+
+void CryptoBenchmark::aesDecrypt_data()
+{
+    payloads();
+}
+
+void CryptoBenchmark::aesDecrypt()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, profile);
+    QByteArray encrypted = Security::AESEncryptBytes(data, key, profile);
+    QByteArray decrypted;
+    QBENCHMARK
+    {
+        decrypted = Security::AESDecryptBytes(encrypted, key, profile);
+    }
+    QCOMPARE(decrypted, data);
+}
+
+void CryptoBenchmark::aesDecryptBatch_data()
+{
+    payloads();
+}
+
+//one getData result set of 2000 cells
+void CryptoBenchmark::aesDecryptBatch()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, profile);
+    QList<QByteArray> batch;
+    for (int i=0; i<2000; i++)
+        batch.append(Security::AESEncryptBytes(data, key, profile));
+    QList<QByteArray> decrypted;
+    QBENCHMARK
+    {
+        decrypted = Security::AESDecryptBatch(batch, key, profile);
+    }
+    QCOMPARE(decrypted.size(), batch.size());
+    QCOMPARE(decrypted.last(), data);
+}
+
+void CryptoBenchmark::aesDecryptParallel_data()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<int>("threads");
+
+    int threads[] = { 1, 2, 4 };
+    for (int i=0; i<3; i++)
+    {
+        QTest::newRow(qPrintable(QString("cbc/%1").arg(threads[i])))
+                << (int)Security::CBCProfile << threads[i];
+        QTest::newRow(qPrintable(QString("ctr-hmac/%1").arg(threads[i])))
+                << (int)Security::CTRProfile << threads[i];
+    }
+}
+
+//16 batches of a large sheet on the pool, as DBManager::getData runs them
+void CryptoBenchmark::aesDecryptParallel()
+{
+    QFETCH(int, profile);
+    QFETCH(int, threads);
+    QList<QList<QByteArray> > batches;
+    QByteArray cell = QByteArray(72, '\x01').toHex() + "=A1+B2*3";
+    for (int b=0; b<16; b++)
+    {
+        QList<QByteArray> batch;
+        for (int i=0; i<cellsPerBatch; i++)
+            batch.append(Security::AESEncryptBytes(cell, key, profile));
+        batches.append(batch);
+    }
+
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int maxThreads = pool->maxThreadCount();
+    pool->setMaxThreadCount(threads);
+    QList<QList<QByteArray> > decrypted;
+    QBENCHMARK
+    {
+        decrypted = QtConcurrent::blockingMapped(batches,
+                                                 DecryptBatch(key, profile));
+    }
+    pool->setMaxThreadCount(maxThreads);
+    QCOMPARE(decrypted.size(), batches.size());
+    QCOMPARE(decrypted.last().last(), cell);
+}
+
+//RSA is only applied to table access keys
+void CryptoBenchmark::rsaEncrypt_data()
+{
+    QTest::addColumn<QString>("path");
+    QTest::newRow("static") << "static";
+    QTest::newRow("instance") << "instance";
+}
+
+void CryptoBenchmark::rsaEncrypt()
+{
+    QFETCH(QString, path);
+    QString accessKey;
+    bool instance = path == "instance";
+    QBENCHMARK
+    {
+        accessKey = instance?security->RSAEncrypt(key):
+                             Security::RSAEncrypt(key, keys.first);
+    }
+    QCOMPARE(Security::RSADecrypt(accessKey, keys.second, passphrase), key);
+}
+
+void CryptoBenchmark::rsaDecrypt_data()
+{
+    rsaEncrypt_data();
+}
+
+void CryptoBenchmark::rsaDecrypt()
+{
+    QFETCH(QString, path);
+    QString accessKey = Security::RSAEncrypt(key, keys.first);
+    QString decrypted;
+    bool instance = path == "instance";
+    QBENCHMARK
+    {
+        decrypted = instance?security->RSADecrypt(accessKey):
+                             Security::RSADecrypt(accessKey, keys.second,
+                                                  passphrase);
+    }
+    QCOMPARE(decrypted, key);
+}
+
+void CryptoBenchmark::rsaSign_data()
+{
+    rsaEncrypt_data();
+}
+
+void CryptoBenchmark::rsaSign()
+{
+    QFETCH(QString, path);
+    QString signature;
+    bool instance = path == "instance";
+    QBENCHMARK
+    {
+        signature = instance?security->RSASign(key):
+                             Security::RSASign(key, keys.second, passphrase);
+    }
+    QVERIFY(Security::RSAVerifySignature(key, signature, keys.first));
+}
+
+void CryptoBenchmark::rsaVerify()
+{
+    QString signature = Security::RSASign(key, keys.second, passphrase);
+    bool valid = false;
+    QBENCHMARK
+    {
+        valid = Security::RSAVerifySignature(key, signature, keys.first);
+    }
+    QVERIFY(valid);
+}
+
+void CryptoBenchmark::hash()
+{
+    QString hash;
+    QBENCHMARK
+    {
+        hash = Security::getHash(key);
+    }
+    QVERIFY(!hash.isEmpty());
+}
+
+QTEST_MAIN(CryptoBenchmark)
+#include "tst_crypto.moc"
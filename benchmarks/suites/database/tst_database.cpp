@@ -0,0 +1,131 @@
+#include <QtGui>
+#include <QtSql>
+#include <QtTest>
+#include "DBManager.h"
+#include "SpreadSheet.h"
+#include "SessionFixture.h"
+
+static const int rows = 200;
+static const int columns = 10;
+static const int importRows = 50;
+
+class DatabaseBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    SessionFixture *session;
+    DBManager *db;
+    QStringList tables;
+
+    bool useTable(const QString &format);
+    void formats();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void writeData_data();
+    void writeData();
+    void writeRows_data();
+    void writeRows();
+    void getData_data();
+    void getData();
+};
+
+void DatabaseBenchmark::initTestCase()
+{
+    session = new SessionFixture("tst_database");
+    QVERIFY(session->login());
+    db = session->manager();
+}
+
+void DatabaseBenchmark::cleanupTestCase()
+{
+    delete session;
+}
+
+//one table per storage format, created on first use
+bool DatabaseBenchmark::useTable(const QString &format)
+{
+    QString name = QString("bench_%1").arg(format);
+    if (tables.contains(name))
+        return session->openTable(name, columns, rows);
+    tables << name;
+    return session->createTable(name, format, columns, rows);
+}
+
+void DatabaseBenchmark::formats()
+{
+    QTest::addColumn<QString>("format");
+    QTest::newRow("hex") << "hex";
+    QTest::newRow("binary") << "binary";
+    QTest::newRow("row") << "row";
+}
+
+void DatabaseBenchmark::writeData_data()
+{
+    formats();
+}
+
+void DatabaseBenchmark::writeData()
+{
+    QFETCH(QString, format);
+    QVERIFY(useTable(format));
+    int cell = 0;
+    QBENCHMARK
+    {
+        QString formula = QString::number(cell % 100 / 10.0, 'f', 1);
+        db->writeData(cell / columns % rows, cell % columns,
+                      CellCodec::encode(CellStyle(), formula));
+        cell++;
+    }
+    QCOMPARE(session->errors(), 0);
+}
+
+void DatabaseBenchmark::writeRows_data()
+{
+    formats();
+}
+
+//the batched path of the command line import
+void DatabaseBenchmark::writeRows()
+{
+    QFETCH(QString, format);
+    QVERIFY(useTable(format));
+    QMap<int, QList<QByteArray> > block;
+    for (int r=0; r<importRows; r++)
+    {
+        QList<QByteArray> row;
+        for (int c=0; c<columns; c++)
+            row.append(CellCodec::encode(CellStyle(),
+                                         QString::number((r + c) % 10 + 1)));
+        block.insert(r, row);
+    }
+    bool ok = true;
+    QBENCHMARK
+    {
+        ok = db->writeRows(block) && ok;
+    }
+    QVERIFY(ok);
+}
+
+void DatabaseBenchmark::getData_data()
+{
+    formats();
+}
+
+//select, decrypt on the thread pool and apply to the sheet
+void DatabaseBenchmark::getData()
+{
+    QFETCH(QString, format);
+    QVERIFY(useTable(format));
+    bool ok = true;
+    QBENCHMARK
+    {
+        ok = session->refresh() && ok;
+    }
+    QVERIFY(ok);
+}
+
+QTEST_MAIN(DatabaseBenchmark)
+#include "tst_database.moc"
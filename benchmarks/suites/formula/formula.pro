@@ -0,0 +1,11 @@
+include(../suites.pri)
+include(../../app.pri)
+
+QT += sql
+
+TARGET = tst_formula
+
+SOURCES += tst_formula.cpp \
+    $$ROOT/benchmarks/common/FormulaScenarios.cpp
+
+HEADERS += $$ROOT/benchmarks/common/FormulaScenarios.h
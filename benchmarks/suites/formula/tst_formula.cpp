@@ -0,0 +1,119 @@
+#include <QtGui>
+#include <QtTest>
+#include "SpreadSheet.h"
+#include "Cell.h"
+#include "FormulaScenarios.h"
+
+class FormulaBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    MockLinks links;
+    QList<Scenario> sheets;
+
+    void scenarios();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void parse_data();
+    void parse();
+    void evaluate_data();
+    void evaluate();
+    void recalc_data();
+    void recalc();
+};
+
+void FormulaBenchmark::initTestCase()
+{
+    sheets = formulaScenarios(100, 200, &links);
+    for (int s=0; s<sheets.size(); s++)
+        if (!sheets.at(s).check.isEmpty())
+            QCOMPARE(sheets.at(s).checkedValue(), sheets.at(s).expected);
+}
+
+void FormulaBenchmark::cleanupTestCase()
+{
+    for (int s=0; s<sheets.size(); s++)
+        delete sheets.at(s).sheet;
+    sheets.clear();
+}
+
+void FormulaBenchmark::scenarios()
+{
+    QTest::addColumn<int>("scenario");
+    for (int s=0; s<sheets.size(); s++)
+        QTest::newRow(qPrintable(sheets.at(s).name)) << s;
+}
+
+void FormulaBenchmark::parse_data()
+{
+    scenarios();
+}
+
+void FormulaBenchmark::parse()
+{
+    QFETCH(int, scenario);
+    const Scenario &sheet = sheets.at(scenario);
+    int length = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<sheet.formulas.size(); i++)
+        {
+            Cell *cell = sheet.formula(i);
+            length += cell->expression(cell->formula()).size();
+        }
+    }
+    QVERIFY(length > 0);
+}
+
+void FormulaBenchmark::evaluate_data()
+{
+    scenarios();
+}
+
+void FormulaBenchmark::evaluate()
+{
+    QFETCH(int, scenario);
+    const Scenario &sheet = sheets.at(scenario);
+    QStringList expressions;
+    for (int i=0; i<sheet.formulas.size(); i++)
+        expressions << sheet.formula(i)->expression(sheet.formula(i)->formula());
+    int valid = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<sheet.formulas.size(); i++)
+            if (sheet.formula(i)->computeFormula(expressions.at(i),
+                                                 sheet.sheet).isValid())
+                valid++;
+    }
+    QVERIFY(valid > 0);
+}
+
+void FormulaBenchmark::recalc_data()
+{
+    scenarios();
+}
+
+//what a repaint of the whole sheet costs, every cell asked for its value
+void FormulaBenchmark::recalc()
+{
+    QFETCH(int, scenario);
+    SpreadSheet *sheet = sheets.at(scenario).sheet;
+    int length = 0;
+    QBENCHMARK
+    {
+        for (int r=0; r<sheet->rowCount(); r++)
+            for (int c=0; c<sheet->columnCount(); c++)
+            {
+                QTableWidgetItem *item = sheet->item(r, c);
+                if (item != 0)
+                    length += item->data(Qt::DisplayRole).toString().size();
+            }
+    }
+    QVERIFY(length > 0);
+}
+
+QTEST_MAIN(FormulaBenchmark)
+#include "tst_formula.moc"
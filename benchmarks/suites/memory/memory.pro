@@ -0,0 +1,11 @@
+include(../suites.pri)
+
+CONFIG += app_database
+include(../../app.pri)
+
+TARGET = tst_memory
+
+SOURCES += tst_memory.cpp \
+    $$ROOT/benchmarks/common/SessionFixture.cpp
+
+HEADERS += $$ROOT/benchmarks/common/SessionFixture.h
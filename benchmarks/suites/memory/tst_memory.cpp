@@ -0,0 +1,156 @@
+#include <QtGui>
+#include <QtSql>
+#include <QtTest>
+#include <new>
+#include <cstdlib>
+#include "DBManager.h"
+#include "SpreadSheet.h"
+#include "SessionFixture.h"
+
+static const int rows = 200;
+static const int columns = 10;
+//the first opens fill the statement and style caches
+static const int warmupCycles = 5;
+static const int cycles = 50;
+
+//every object allocated with new and not deleted yet, in any thread
+static QBasicAtomicInt liveAllocations = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+void *operator new(size_t size)
+{
+    void *p = malloc(size? size:1);
+    if (p == 0)
+        throw std::bad_alloc();
+    liveAllocations.fetchAndAddRelaxed(1);
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) throw()
+{
+    void *p = malloc(size? size:1);
+    if (p != 0)
+        liveAllocations.fetchAndAddRelaxed(1);
+    return p;
+}
+
+void *operator new[](size_t size, const std::nothrow_t &nothrow) throw()
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void *p) throw()
+{
+    if (p == 0)
+        return;
+    liveAllocations.fetchAndAddRelaxed(-1);
+    free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) throw()
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) throw()
+{
+    operator delete(p);
+}
+
+class MemoryBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    SessionFixture *session;
+    DBManager *db;
+
+    bool reopen(const QString &name);
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void reopenCycles_data();
+    void reopenCycles();
+};
+
+void MemoryBenchmark::initTestCase()
+{
+    session = new SessionFixture("tst_memory");
+    QVERIFY(session->login());
+    db = session->manager();
+}
+
+void MemoryBenchmark::cleanupTestCase()
+{
+    delete session;
+}
+
+//closes the sheet the way MainWindow does, loads it again and refreshes it
+bool MemoryBenchmark::reopen(const QString &name)
+{
+    return session->openTable(name, columns, rows) && session->refresh();
+}
+
+void MemoryBenchmark::reopenCycles_data()
+{
+    QTest::addColumn<QString>("format");
+    QTest::newRow("hex") << "hex";
+    QTest::newRow("binary") << "binary";
+    QTest::newRow("row") << "row";
+}
+
+//after the warmup every open must give back all it allocates, so the live
+//allocations may not grow by one per cycle and the sheet estimate not at all
+void MemoryBenchmark::reopenCycles()
+{
+    QFETCH(QString, format);
+    QString name = QString("memory_%1").arg(format);
+    QVERIFY(session->createTable(name, format, columns, rows));
+
+    QMap<int, QList<QByteArray> > block;
+    for (int r=0; r<rows; r++)
+    {
+        QList<QByteArray> row;
+        for (int c=0; c<columns; c++)
+            row.append(CellCodec::encode(CellStyle(),
+                                         QString::number((r + c) % 10 + 1)));
+        block.insert(r, row);
+    }
+    QVERIFY(db->writeRows(block));
+
+    qint64 firstSheet = 0, lastSheet = 0;
+    int firstLive = 0, lastLive = 0;
+    for (int c=1; c<=warmupCycles+cycles; c++)
+    {
+        QVERIFY2(reopen(name), qPrintable(QString("cycle %1").arg(c)));
+        SheetMemory usage = session->sheet()->memoryUsage();
+        db->memoryUsage(&usage);
+        lastSheet = usage.total();
+        lastLive = liveAllocations;
+        if (c == warmupCycles)
+        {
+            firstSheet = lastSheet;
+            firstLive = lastLive;
+        }
+    }
+    QVERIFY2(lastSheet == firstSheet,
+             qPrintable(QString("sheet memory went from %1 to %2 bytes").
+                        arg(firstSheet).arg(lastSheet)));
+    QVERIFY2(lastLive - firstLive < cycles,
+             qPrintable(QString("%1 allocations outlived %2 opens").
+                        arg(lastLive - firstLive).arg(cycles)));
+    QCOMPARE(session->errors(), 0);
+}
+
+QTEST_MAIN(MemoryBenchmark)
+#include "tst_memory.moc"
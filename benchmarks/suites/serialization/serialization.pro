@@ -0,0 +1,10 @@
+include(../suites.pri)
+
+QT += gui
+
+TARGET = tst_serialization
+
+SOURCES += tst_serialization.cpp \
+    $$ROOT/CellRecord.cpp
+
+HEADERS += $$ROOT/CellRecord.h
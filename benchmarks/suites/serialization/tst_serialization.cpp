@@ -0,0 +1,148 @@
+#include <QtGui>
+#include <QtTest>
+#include "CellRecord.h"
+
+static const int rows = 200;
+static const int columns = 10;
+
+class SerializationBenchmark : public QObject
+{
+    Q_OBJECT
+
+private:
+    QList<CellStyle> styles;
+    QList<QString> formulas;
+    QList<QByteArray> records;
+
+private slots:
+    void initTestCase();
+    void encode();
+    void decode();
+    void toLegacy();
+    void fromLegacy();
+    void envelope();
+    void openEnvelope();
+    void refreshPayload();
+};
+
+void SerializationBenchmark::initTestCase()
+{
+    CellStyle plain;
+    plain.font = QApplication::font();
+    styles.append(plain);
+    CellStyle marked = plain;
+    marked.font.setBold(true);
+    marked.background = QBrush(Qt::yellow);
+    styles.append(marked);
+
+    for (int i=0; i<rows*columns; i++)
+    {
+        formulas.append((i % columns == columns-1)?
+                        QString("=avg(A%1;I%1)").arg(i / columns + 1):
+                        QString::number(i % 10 + 1));
+        records.append(CellCodec::encode(styles.at(i % 7 == 0), formulas.last()));
+    }
+}
+
+void SerializationBenchmark::encode()
+{
+    qint64 bytes = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<formulas.size(); i++)
+            bytes += CellCodec::encode(styles.at(i % 7 == 0),
+                                       formulas.at(i)).size();
+    }
+    QVERIFY(bytes > 0);
+}
+
+void SerializationBenchmark::decode()
+{
+    CellStyle style;
+    QString formula;
+    int decoded = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<records.size(); i++)
+            if (CellCodec::decode(records.at(i), &style, &formula))
+                decoded++;
+    }
+    QVERIFY(decoded > 0);
+}
+
+void SerializationBenchmark::toLegacy()
+{
+    qint64 bytes = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<records.size(); i++)
+            bytes += CellCodec::toLegacy(records.at(i)).size();
+    }
+    QVERIFY(bytes > 0);
+}
+
+void SerializationBenchmark::fromLegacy()
+{
+    QList<QByteArray> legacy;
+    for (int i=0; i<records.size(); i++)
+        legacy.append(CellCodec::toLegacy(records.at(i)));
+    qint64 bytes = 0;
+    QBENCHMARK
+    {
+        for (int i=0; i<legacy.size(); i++)
+            bytes += CellCodec::fromLegacy(legacy.at(i)).size();
+    }
+    QVERIFY(bytes > 0);
+}
+
+void SerializationBenchmark::envelope()
+{
+    qint64 bytes = 0;
+    QBENCHMARK
+    {
+        for (int r=0; r<rows; r++)
+        {
+            RowEnvelope row;
+            for (int c=0; c<columns; c++)
+                row.setCell(c, records.at(r*columns + c));
+            bytes += row.toBytes().size();
+        }
+    }
+    QVERIFY(bytes > 0);
+}
+
+void SerializationBenchmark::openEnvelope()
+{
+    QList<QByteArray> envelopes;
+    for (int r=0; r<rows; r++)
+    {
+        RowEnvelope row;
+        for (int c=0; c<columns; c++)
+            row.setCell(c, records.at(r*columns + c));
+        envelopes.append(row.toBytes());
+    }
+    int cells = 0;
+    QBENCHMARK
+    {
+        for (int r=0; r<envelopes.size(); r++)
+            cells += RowEnvelope::fromBytes(envelopes.at(r)).cells(columns).size();
+    }
+    QVERIFY(cells > 0);
+}
+
+//what the refresh decoder does with a decrypted result set
+void SerializationBenchmark::refreshPayload()
+{
+    QMap<int, QList<QByteArray> > data;
+    for (int r=0; r<rows; r++)
+        data.insert(r, records.mid(r*columns, columns));
+    RefreshPayload payload;
+    QBENCHMARK
+    {
+        payload = RefreshPayload::decode(data);
+    }
+    QCOMPARE(payload.cells.size(), rows*columns);
+}
+
+QTEST_MAIN(SerializationBenchmark)
+#include "tst_serialization.moc"
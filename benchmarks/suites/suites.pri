@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# QBENCHMARK suites, run by compare.py with -xml output
+#
+#-------------------------------------------------
+
+include($$PWD/../benchmarks.pri)
+
+QT += testlib
+
+CONFIG += testcase
@@ -1,9 +1,21 @@
 #include <QtGui/QApplication>
 #include "MainWindow.h"
+#include "CommandLine.h"
+#include "Startup.h"
 
 int main(int argc, char *argv[])
 {
+    Startup::begin();
+    //--cli runs a bulk job without creating any widget or display connection
+    if (argc > 1 && QString(argv[1]) == "--cli")
+    {
+        QApplication a(argc, argv, false);
+        CommandLine cli(a.arguments().mid(2));
+        return cli.exec();
+    }
+
     QApplication a(argc, argv);
+    Startup::mark("application");
     MainWindow w("Student Evaluation Manager");
     w.show();
 
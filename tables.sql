@@ -6,6 +6,12 @@ CREATE TABLE files (
 	owner INT NOT NULL,
 	row_count INT NOT NULL,
 	folder INT NOT NULL,
+	storage_format INT DEFAULT 0 NOT NULL,
+	column_count INT DEFAULT 0 NOT NULL,
+	cipher_profile INT DEFAULT 0 NOT NULL,
+	key_version INT DEFAULT 0 NOT NULL,
+	rotation_key VARCHAR(256),
+	rotation_row INT DEFAULT 0 NOT NULL,
     CONSTRAINT files_pk PRIMARY KEY (file_id)
 );
 DROP TABLE IF EXISTS backup;
@@ -49,7 +55,9 @@ CREATE TABLE access_keys (
 	table_id INT NOT NULL,
 	user_id INT NOT NULL,
 	access_key VARCHAR(256) NOT NULL,
-	signed_key VARCHAR(256) NOT NULL
+	signed_key VARCHAR(256) NOT NULL,
+	rotation_key VARCHAR(256),
+	rotation_signed_key VARCHAR(256)
 );
 DROP TABLE IF EXISTS tables_settings;
 CREATE TABLE tables_settings (